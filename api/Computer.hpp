@@ -14,12 +14,14 @@
 extern "C" {
 #include <lua.h>
 }
+#include <atomic>
 #include <csetjmp>
 #include <cstdint>
 #include <condition_variable>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <queue>
 #include <string>
 #include <tuple>
@@ -67,11 +69,11 @@ struct Computer {
     
     // These properties will likely be of little use to anything outside of CraftOS-PC. They store info about the internal state of the computer, and modifying these values may break things.
     // Do not use these unless you know what you're doing! (They would be private, but there are many non-members that use these values and would need to be listed as friends.)
-    std::queue<std::string> eventQueue; // A queue holding the names of each event in the queue
-    lua_State * paramQueue; // A Lua stack that stores the parameters for each event in the queue
+    std::queue<std::string> eventQueue; // Deprecated: always empty since 12.1, when events moved to event_queue_ctx - only kept so the structure layout doesn't change
+    lua_State * paramQueue; // A Lua stack that stores the parameters for each event in the queue, back to back
     std::queue<SDL_Event> termEventQueue; // A queue holding all UI events that have not been processed yet
     std::mutex termEventQueueMutex; // A mutex locking access to the termEventQueue queue
-    std::queue<std::pair<event_provider, void*> > event_provider_queue; // A queue holding events that have been queued from C++ (use queueEvent, don't modify this directly!)
+    std::queue<std::pair<event_provider, void*> > event_provider_queue; // A queue holding events that have been queued from C++ and didn't fit in the event ring (use queueEvent, don't modify this directly!)
     std::mutex event_provider_queue_mutex; // A mutex locking access to the event_provider_queue queue
     std::chrono::high_resolution_clock::time_point last_event = std::chrono::high_resolution_clock::now(); // The last time an event was waited for
     std::condition_variable event_lock; // A condition variable that is notified when an event is available in the queue
@@ -137,6 +139,24 @@ struct Computer {
 
     struct allocators * allocator_ctx = NULL; // Private: context for allocators
 
+    // The following fields are available in API version 12.1 and later.
+    class EventQueue * event_queue_ctx = NULL; // Private: lock-free event ring and parameter arena
+    uint64_t runTime = 0; // The total time the computer has spent running Lua code, in microseconds
+    size_t memoryUsage = 0; // The number of bytes currently allocated by the Lua state
+    size_t memoryPeak = 0; // The highest value memoryUsage has reached since the computer booted
+    uint64_t allocationCount = 0; // The number of new blocks the Lua state has allocated since the computer booted
+    size_t memoryLimit = 0; // The maximum number of bytes the Lua state may allocate (0 to use the computerMemoryLimit setting)
+    bool memoryLimitEnabled = false; // Private: whether the limit is enforced (off while booting and shutting down)
+    struct mount_cache * mount_cache_ctx = NULL; // Private: mount trie and cache of resolved paths
+    std::atomic<unsigned> mountGeneration {0}; // Bumped whenever mounts changes, to invalidate mount_cache_ctx and virtualMountIndexes (increment this after editing mounts, virtualMounts or a mounted FileEntry directly)
+    std::mutex mountCacheMutex; // Private: locks mount_cache_ctx, since paths may be resolved from other threads
+    std::unordered_map<unsigned, std::shared_ptr<const class VFSIndex> > virtualMountIndexes; // Private: flat indexes of virtualMounts, shared between computers
+    unsigned virtualMountIndexGeneration = 0; // Private: value of mountGeneration when virtualMountIndexes was filled
+    std::mutex virtualMountIndexesMutex; // Private: locks virtualMountIndexes, since raw mode file requests look up files from the input thread
+    struct dir_cache * dir_cache_ctx = NULL; // Private: cached listings of host directories
+    std::mutex dirCacheMutex; // Private: locks dir_cache_ctx, since raw mode file requests use it from the input thread
+    struct file_watches * file_watches_ctx = NULL; // Private: paths watched with fs.watch
+
 private:
     // The constructor is marked private to avoid having to implement it in this file.
     // It isn't necessary to construct a Computer directly; just use the startComputer function instead.
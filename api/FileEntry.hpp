@@ -16,7 +16,6 @@
 #include <filesystem>
 #include <locale>
 #include <map>
-#include <regex>
 #include <sstream>
 #include <string>
 
@@ -54,6 +53,17 @@ struct FileEntry {
     FileEntry& operator[](std::string key) noexcept(false) {if (!isDir) throw std::runtime_error("Attempted to index a file"); return this->dir.at(key);}
     const FileEntry& operator[](std::string key) const noexcept(false) {if (!isDir) throw std::runtime_error("Attempted to index a file"); return this->dir.at(key);}
 
+    /**
+     * Checks whether a path component is a virtual mount prefix ("<digits>:").
+     * @param str The path component to check
+     * @return Whether the component names a virtual mount
+     */
+    static bool isMountIndex(const std::filesystem::path::string_type& str) {
+        if (str.size() < 2 || str.back() != ':') return false;
+        for (size_t i = 0; i + 1 < str.size(); i++) if (str[i] < '0' || str[i] > '9') return false;
+        return true;
+    }
+
     /**
      * Traverses a path string and returns the associated file entry.
      * @param path The path to traverse
@@ -63,7 +73,7 @@ struct FileEntry {
      */
     FileEntry& path(std::filesystem::path path) noexcept(false) {
         FileEntry * retval = this;
-        for (const auto& item : path) if (item.string() != "." && !std::regex_match(item.native(), std::basic_regex<std::filesystem::path::value_type>(std::filesystem::path("\\d+:").native()))) retval = &(*retval)[item.string()];
+        for (const auto& item : path) if (item.string() != "." && !isMountIndex(item.native())) retval = &(*retval)[item.string()];
         return *retval;
     }
     FileEntry& path(std::string path) noexcept(false) {
@@ -74,7 +84,7 @@ struct FileEntry {
     }
     const FileEntry& path(std::filesystem::path path) const noexcept(false) {
         const FileEntry * retval = this;
-        for (const auto& item : path) if (item.string() != "." && !std::regex_match(item.native(), std::basic_regex<std::filesystem::path::value_type>(std::filesystem::path("\\d+:").native()))) retval = &(*retval)[item.string()];
+        for (const auto& item : path) if (item.string() != "." && !isMountIndex(item.native())) retval = &(*retval)[item.string()];
         return *retval;
     }
     const FileEntry& path(std::string path) const noexcept(false) {
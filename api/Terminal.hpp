@@ -12,6 +12,8 @@
 #ifndef CRAFTOS_PC_TERMINAL_HPP
 #define CRAFTOS_PC_TERMINAL_HPP
 
+#include <algorithm>
+#include <climits>
 #include <cstdint>
 #include <cstring>
 #include <chrono>
@@ -117,6 +119,52 @@ public:
     T* data() { return vec.data(); }
 };
 
+// Stores which character cells of a terminal need to be redrawn since the last frame. (API 12.1+)
+// Renderers take the damage with Terminal::takeDamage, and then only repaint the cells that are marked.
+struct TerminalDamage {
+    bool full = true; // Whether the entire screen must be redrawn (cells/rows are not valid if this is set)
+    unsigned width = 0; // The width of the terminal the damage was recorded for
+    unsigned left = UINT_MAX, top = UINT_MAX, right = 0, bottom = 0; // The bounding rectangle of all damaged cells (right/bottom are exclusive)
+    std::vector<bool> cells; // One flag per character cell, set if the cell is damaged
+    std::vector<bool> rows; // One flag per row, set if any cell in the row is damaged
+
+    // Returns whether no cells are damaged.
+    bool empty() const {return !full && right == 0;}
+    // Returns whether any cell in a row is damaged.
+    bool row(unsigned y) const {return full || (y < rows.size() && rows[y]);}
+    // Returns whether a single cell is damaged.
+    bool cell(unsigned x, unsigned y) const {return full || ((size_t)y * width + x < cells.size() && cells[(size_t)y * width + x]);}
+    // Clears all damage, resizing the bitmaps for a new terminal size if needed.
+    void reset(unsigned w, unsigned h) {
+        if (full || width != w || cells.size() != (size_t)w * h) {
+            cells.assign((size_t)w * h, false);
+            rows.assign(h, false);
+        } else {
+            for (unsigned y = top; y < bottom && y < h; y++) {
+                if (!rows[y]) continue;
+                std::fill(cells.begin() + ((size_t)y * w + left), cells.begin() + ((size_t)y * w + right), false);
+                rows[y] = false;
+            }
+        }
+        width = w;
+        full = false;
+        left = top = UINT_MAX;
+        right = bottom = 0;
+    }
+};
+
+// A copy of a terminal's contents that a renderer can draw from without holding the terminal lock. (API 12.1+)
+// Renderers should keep one snapshot per terminal and refresh it with Terminal::takeFrame, which only copies damaged rows.
+struct TerminalSnapshot {
+    vector2d<unsigned char> screen = vector2d<unsigned char>(0, 0, ' ');
+    vector2d<unsigned char> colors = vector2d<unsigned char>(0, 0, 0xF0);
+    vector2d<unsigned char> pixels = vector2d<unsigned char>(0, 0, 0x0F);
+    Color palette[256];
+    unsigned width = 0; // The width of the snapshot in characters
+    unsigned height = 0; // The height of the snapshot in characters
+    uint64_t generation = 0; // Incremented every time a frame is taken into this snapshot
+};
+
 class TerminalFactory;
 
 // The Terminal class is the base class for all renderers. It stores the basic info about all terminal objects, as well as its contents.
@@ -129,7 +177,7 @@ public:
     unsigned height; // The height of the terminal in characters
     static constexpr unsigned fontWidth = 6; // A constant storing the standard width of one character in pixels @1x
     static constexpr unsigned fontHeight = 9; // A constant storing the standard height of one character in pixels @1x
-    bool changed = true; // Whether the terminal's data has been changed and needs to be redrawn - the renderer will not update your changes until you set this!
+    bool changed = true; // Whether the terminal's data has been changed and needs to be redrawn - the renderer will not update your changes until you set this! (In 12.1+, prefer markDirty to only redraw the modified cells; setting this redraws the whole screen.)
     bool gotResizeEvent = false; // Whether a resize event was sent and is awaiting processing
     unsigned newWidth = 0, newHeight = 0; // If a resize event was sent, these store the new size of the window
     std::string title; // The window's title
@@ -164,6 +212,83 @@ public:
     // The following fields are available in API version 10.8 and later.
     TerminalFactory * factory = NULL; // Stores the factory that created this terminal. Factories must always set this.
 
+    // The following fields are available in API version 12.1 and later.
+    TerminalDamage damage; // The cells that have been modified since the last frame - use markDirty/markAllDirty instead of modifying this directly
+    bool damaged = false; // Whether any cells were marked with markDirty since the last frame - `changed` is only set for changes that weren't marked
+
+    // Returns whether the terminal needs to be redrawn, either because cells were marked or because `changed` was set. Renderers should check this instead of `changed`.
+    bool needsRedraw() const {return changed || damaged;}
+    // Marks a region of character cells as needing to be redrawn. Lock the terminal before calling this!
+    // Setting `changed` directly (as code written before 12.1 does) makes renderers redraw the entire screen, even if some damage was marked too.
+    void markDirty(int x, int y, int w = 1, int h = 1) {
+        if (x < 0) {w += x; x = 0;}
+        if (y < 0) {h += y; y = 0;}
+        if (w <= 0 || h <= 0 || (unsigned)x >= width || (unsigned)y >= height) return;
+        if ((unsigned)(x + w) > width) w = width - x;
+        if ((unsigned)(y + h) > height) h = height - y;
+        damaged = true;
+        if (damage.full) return;
+        if (damage.width != width || damage.cells.size() != (size_t)width * height) {
+            // the terminal was resized without resetting the damage
+            damage.full = true;
+            return;
+        }
+        for (int yy = y; yy < y + h; yy++) {
+            damage.rows[yy] = true;
+            std::fill(damage.cells.begin() + ((size_t)yy * width + x), damage.cells.begin() + ((size_t)yy * width + x + w), true);
+        }
+        if ((unsigned)x < damage.left) damage.left = x;
+        if ((unsigned)y < damage.top) damage.top = y;
+        if ((unsigned)(x + w) > damage.right) damage.right = x + w;
+        if ((unsigned)(y + h) > damage.bottom) damage.bottom = y + h;
+    }
+    // Marks the character cells covering a region of graphics mode pixels as needing to be redrawn. Lock the terminal before calling this!
+    void markPixelsDirty(int x, int y, int w = 1, int h = 1) {
+        if (x < 0) {w += x; x = 0;}
+        if (y < 0) {h += y; y = 0;}
+        if (w <= 0 || h <= 0) return;
+        markDirty(x / fontWidth, y / fontHeight, (x + w + fontWidth - 1) / fontWidth - x / fontWidth, (y + h + fontHeight - 1) / fontHeight - y / fontHeight);
+    }
+    // Marks the entire screen as needing to be redrawn (e.g. after changing the palette, mode or size).
+    void markAllDirty() {
+        damage.full = true;
+        damaged = true;
+    }
+    // Moves the damage recorded since the last frame into `out`, and clears the terminal's damage and `changed`. Lock the terminal before calling this!
+    // `out` should be kept between frames to avoid reallocating the bitmaps.
+    void takeDamage(TerminalDamage& out) {
+        // Something wrote to the buffers without marking what it changed
+        if (changed || damage.width != width || damage.cells.size() != (size_t)width * height) damage.full = true;
+        std::swap(out, damage);
+        damage.reset(width, height);
+        changed = damaged = false;
+    }
+    // Takes the damage since the last frame, copies the damaged parts of the terminal into `snap`, and clears `changed`. Lock the terminal before calling this!
+    // After the first frame, only damaged rows are copied, and no memory is allocated unless the terminal was resized.
+    void takeFrame(TerminalSnapshot& snap, TerminalDamage& out) {
+        takeDamage(out);
+        if (out.full || snap.width != width || snap.height != height) {
+            // copy assignment reuses the snapshot's existing storage when it's big enough
+            snap.screen = screen;
+            snap.colors = colors;
+            snap.pixels = pixels;
+            out.full = true;
+        } else if (!out.empty()) {
+            const unsigned left = out.left, len = out.right - out.left;
+            for (unsigned y = out.top; y < out.bottom; y++) {
+                if (!out.rows[y]) continue;
+                memcpy(snap.screen.data() + (size_t)y * width + left, screen.data() + (size_t)y * width + left, len);
+                memcpy(snap.colors.data() + (size_t)y * width + left, colors.data() + (size_t)y * width + left, len);
+                for (unsigned py = y * fontHeight; py < (y + 1) * fontHeight; py++)
+                    memcpy(snap.pixels.data() + (size_t)py * width * fontWidth + left * fontWidth, pixels.data() + (size_t)py * width * fontWidth + left * fontWidth, len * fontWidth);
+            }
+        }
+        memcpy(snap.palette, palette, sizeof(snap.palette));
+        snap.width = width;
+        snap.height = height;
+        snap.generation++;
+    }
+
 protected:
     // Initial constructor to fill the contents with their defaults for the specified width and height
     Terminal(unsigned w, unsigned h): width(w), height(h), screen(w, h, ' '), colors(w, h, 0xF0), pixels(w*fontWidth, h*fontHeight, 0x0F) {
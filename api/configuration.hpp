@@ -95,6 +95,13 @@ struct configuration {
 
     // The following fields are available in API version 10.8 and later.
     bool useDFPWM;
+
+    // The following fields are available in API version 12.1 and later.
+    int rawCompressionLevel; // The deflate level for compressed raw mode packets (1-9, 0 to disable)
+    int schedulerThreads; // The number of worker threads to run computers on (0 to give each computer its own thread)
+    int computerMemoryLimit; // The maximum number of bytes each computer's Lua state may allocate (0 for no limit)
+    bool slabAllocator; // Whether to allocate small Lua objects from per-computer size-class slabs instead of the system allocator
+    int maximumFileWatches; // The maximum number of paths each computer may watch with fs.watch (0 to disable watching)
 };
 
 // A smaller structure that holds the configuration for a single computer.
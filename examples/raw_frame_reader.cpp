@@ -219,25 +219,40 @@ int main(int argc, const char * argv[]) {
 		unsigned char c = std::cin.get();
 		if (c == '!' && std::cin.get() == 'C' && std::cin.get() == 'P') {
 			char mode = std::cin.get();
-			char size[13];
-			if (mode == 'C') std::cin.read(size, 4);
-			else if (mode == 'D') std::cin.read(size, 12);
-			else {std::cout << "Unknown frame type '" << mode << "'!\n"; continue;}
-			long sizen = strtol(size, NULL, 16);
-			std::cout << "Got frame of size " << sizen << "\n";
-			char * tmp = new char[sizen + 1];
-			tmp[sizen] = 0;
-			std::cin.read(tmp, sizen);
-			std::string ddata = base64_decode(tmp);
-			uint32_t sum = useBinaryChecksum ? rc_crc32(0, ddata.c_str(), ddata.size()) : rc_crc32(0, tmp, sizen);
-			delete[] tmp;
-			uint32_t getsum = 0;
-			scanf("%08x", &getsum);
+			char size[13] = {0};
+			std::string ddata;
+			uint32_t sum = 0, getsum = 0;
+			if (mode == 'B') {
+				uint32_t sizen = 0;
+				std::cin.read((char*)&sizen, 4);
+				std::cout << "Got binary frame of size " << sizen << "\n";
+				ddata.resize(sizen);
+				std::cin.read(&ddata[0], sizen);
+				std::cin.read((char*)&getsum, 4);
+				sum = rc_crc32(0, ddata.c_str(), ddata.size());
+			} else {
+				if (mode == 'C') std::cin.read(size, 4);
+				else if (mode == 'D') std::cin.read(size, 12);
+				else {std::cout << "Unknown frame type '" << mode << "'!\n"; continue;}
+				long sizen = strtol(size, NULL, 16);
+				std::cout << "Got frame of size " << sizen << "\n";
+				char * tmp = new char[sizen + 1];
+				tmp[sizen] = 0;
+				std::cin.read(tmp, sizen);
+				ddata = base64_decode(tmp);
+				sum = useBinaryChecksum ? rc_crc32(0, ddata.c_str(), ddata.size()) : rc_crc32(0, tmp, sizen);
+				delete[] tmp;
+				scanf("%08x", &getsum);
+			}
 			if (sum == getsum) printf("> Checksums match (%08X)\n", getsum);
 			else printf("\n> Checksums don't match! (%08X vs. expected %08X)\n", sum, getsum);
 			std::stringstream in(ddata);
 			uint8_t type = in.get();
-			std::cout << "> Frame is of type " << (int)type << " for window ID " << (int)in.get() << "\n";
+			std::cout << "> Frame is of type " << (int)(type & ~CCPC_RAW_COMPRESSED_TYPE) << " for window ID " << (int)in.get() << "\n";
+			if (type & CCPC_RAW_COMPRESSED_TYPE) {
+				std::cout << "> Payload is compressed (" << ddata.size() - 3 << " bytes)" << (in.get() & CCPC_RAW_COMPRESSED_RESET ? ", stream restarted\n" : "\n");
+				continue;
+			}
 			switch (type) {
 			case CCPC_RAW_TERMINAL_DATA: {
 				uint16_t width = 0, height = 0, cursorX = 0, cursorY = 0;
@@ -250,7 +265,10 @@ int main(int argc, const char * argv[]) {
 				in.read((char*)&cursorY, 2);
 				std::cout << "> Cursor X: " << cursorX << ", Y: " << cursorY << "\n";
 				std::cout << "> Grayscale? " << (in.get() ? "Yes\n" : "No\n");
-				in.seekg((long)in.tellg() + 3);
+				in.get();
+				uint16_t seq = 0;
+				in.read((char*)&seq, 2);
+				std::cout << "> Frame sequence (if using delta frames): " << seq << "\n";
 				int i = 0;
 				if (mode == 0) {
 					if (!noterm) std::cout << "> Terminal contents:\n";
@@ -348,8 +366,9 @@ int main(int argc, const char * argv[]) {
 				if (flags & CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS) std::cout << "  * Send all windows\n";
 				if (flags & CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES) {
 					std::cout << "  * Extended flags:\n";
-					// if (eflags && CCPC_RAW_FEATURE_FLAG_EXTENDED_) std::cout << "    * \n";
-					// none present
+					if (eflags & CCPC_RAW_EXTENDED_FEATURE_FLAG_DELTA_FRAMES) std::cout << "    * Delta frames\n";
+					if (eflags & CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES) std::cout << "    * Binary framing\n";
+					if (eflags & CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION) std::cout << "    * Compressed payloads\n";
 				}
 				break;
 			} case CCPC_RAW_FILE_REQUEST: {
@@ -453,6 +472,49 @@ int main(int argc, const char * argv[]) {
 				else if (noterm) std::cout << "> Data size: " << size << "\n";
 				else std::cout << "> Data:\n" << str << "\n";
 				break;
+			} case CCPC_RAW_TERMINAL_DELTA: {
+				uint16_t seq = 0, base = 0, nspans = 0, npalette = 0;
+				if (ddata.size() <= 4) {
+					// client -> server resynchronization request
+					in.read((char*)&base, 2);
+					std::cout << "> Keyframe requested, last applied frame: " << base << "\n";
+					break;
+				}
+				uint16_t width = 0, height = 0, cursorX = 0, cursorY = 0;
+				uint8_t mode = in.get();
+				std::cout << "> Graphics mode: " << (int)mode << "\n> Cursor showing/blinking? " << (in.get() ? "Yes\n" : "No\n");
+				in.read((char*)&width, 2);
+				in.read((char*)&height, 2);
+				std::cout << "> Width: " << width << ", height: " << height << "\n";
+				in.read((char*)&cursorX, 2);
+				in.read((char*)&cursorY, 2);
+				std::cout << "> Cursor X: " << cursorX << ", Y: " << cursorY << "\n";
+				std::cout << "> Grayscale? " << (in.get() ? "Yes\n" : "No\n");
+				in.get();
+				in.read((char*)&seq, 2);
+				in.read((char*)&base, 2);
+				in.read((char*)&nspans, 2);
+				std::cout << "> Frame sequence: " << seq << ", based on frame " << base << "\n> Changed spans: " << nspans << "\n";
+				for (int i = 0; i < nspans; i++) {
+					uint16_t row = 0, start = 0, length = 0;
+					in.read((char*)&row, 2);
+					in.read((char*)&start, 2);
+					in.read((char*)&length, 2);
+					std::string text(length, ' ');
+					in.read(&text[0], length);
+					if (mode == 0) in.seekg((long)in.tellg() + length);
+					std::cout << "  Row " << row << ", columns " << start << "-" << start + length - 1;
+					if (mode == 0 && !noterm) std::cout << ": " << text;
+					std::cout << "\n";
+				}
+				in.read((char*)&npalette, 2);
+				std::cout << "> Changed palette entries: ";
+				for (int i = 0; i < npalette; i++) {
+					uint8_t idx = in.get(), r = in.get(), g = in.get(), b = in.get();
+					printf("%s%d = #%02x%02x%02x", (i == 0 ? "" : ", "), idx, r, g, b);
+				}
+				std::cout << "\n";
+				break;
 			}}
 		}
 	}
@@ -0,0 +1,72 @@
+-- CraftOS-PC file read benchmark
+-- This program measures how fast file handles read large files, in text and
+-- binary mode. It writes a 1 MB and a 100 MB test file to the computer's
+-- root, so make sure there's enough free space, and deletes them afterwards.
+
+local function time(name, size, fn)
+    local start = os.epoch "utc"
+    fn()
+    local ms = math.max(os.epoch "utc" - start, 1)
+    print(("%s: %d ms (%.1f MB/s)"):format(name, ms, size / 1048576 / (ms / 1000)))
+    os.queueEvent("nosleep")
+    os.pullEvent()
+end
+
+local function makeFile(path, size)
+    -- Lines of varying length with CRLF endings, so text mode has something to convert
+    local lines = {}
+    for i = 1, 64 do lines[i] = ("%d %s\r\n"):format(i, ("x"):rep(i * 3 % 97)) end
+    local block = table.concat(lines)
+    block = block:rep(math.ceil(65536 / #block)):sub(1, 65536)
+    local file = assert(fs.open(path, "wb"))
+    for _ = 1, size / 65536 do file.write(block) end
+    file.close()
+end
+
+local function benchmark(path, size)
+    time("readAll (text)", size, function()
+        local file = fs.open(path, "r")
+        file.readAll()
+        file.close()
+    end)
+    time("readAll (binary)", size, function()
+        local file = fs.open(path, "rb")
+        file.readAll()
+        file.close()
+    end)
+    time("read(4096) (text)", size, function()
+        local file = fs.open(path, "r")
+        while file.read(4096) do end
+        file.close()
+    end)
+    time("read(4096) (binary)", size, function()
+        local file = fs.open(path, "rb")
+        while file.read(4096) do end
+        file.close()
+    end)
+    if size <= 1048576 then
+        time("read() (binary)", size, function()
+            local file = fs.open(path, "rb")
+            while file.read() do end
+            file.close()
+        end)
+    end
+    time("readLine", size, function()
+        local file = fs.open(path, "r")
+        while file.readLine() do end
+        file.close()
+    end)
+end
+
+term.setTextColor(colors.yellow)
+print("File read benchmark")
+for _, size in ipairs {1048576, 104857600} do
+    local path = "/.benchmark_read_" .. size
+    term.setTextColor(colors.yellow)
+    print(("%d MB file:"):format(size / 1048576))
+    term.setTextColor(colors.white)
+    makeFile(path, size)
+    local ok, err = pcall(benchmark, path, size)
+    fs.delete(path)
+    if not ok then error(err, 0) end
+end
@@ -0,0 +1,54 @@
+-- CraftOS-PC filesystem benchmark
+-- This program measures how fast the fs API resolves and matches paths. The
+-- ROM is a virtual mount in standalone builds, so the ROM lookups also cover
+-- the VFS there.
+
+local function time(name, count, fn)
+    local start = os.epoch "utc"
+    for i = 1, count do fn(i) end
+    local ms = math.max(os.epoch "utc" - start, 1)
+    print(("%s: %d calls in %d ms (%d calls/s)"):format(name, count, ms, count / (ms / 1000)))
+    os.queueEvent("nosleep")
+    os.pullEvent()
+end
+
+if not fs.exists("rom/programs") then error("This program requires the ROM to be installed.") end
+local romFiles = fs.list("rom/programs")
+
+term.setTextColor(colors.yellow)
+print("Filesystem benchmark")
+term.setTextColor(colors.white)
+time("fs.find(\"rom/*/*\")", 200, function() fs.find("rom/*/*") end)
+time("fs.find(\"rom/programs/?s*\")", 500, function() fs.find("rom/programs/?s*") end)
+time("fs.combine", 100000, function(i) fs.combine("rom/programs", "../apis", romFiles[i % #romFiles + 1]) end)
+time("fs.exists", 50000, function(i) fs.exists("rom/programs/" .. romFiles[i % #romFiles + 1]) end)
+time("fs.isDir", 50000, function(i) fs.isDir("rom/programs/" .. romFiles[i % #romFiles + 1]) end)
+time("fs.attributes", 20000, function(i) fs.attributes("rom/programs/" .. romFiles[i % #romFiles + 1]) end)
+time("fs.list", 5000, function() fs.list("rom/programs") end)
+time("fs.complete", 5000, function() fs.complete("pr", "rom") end)
+
+-- The same calls on a large directory on the computer's drive
+local dir = "/.benchmark_find"
+term.setTextColor(colors.yellow)
+print("Large directory (20 directories of 100 files):")
+term.setTextColor(colors.white)
+for i = 1, 20 do
+    for j = 1, 100 do
+        local file = fs.open(("%s/dir%d/file%d.%s"):format(dir, i, j, j % 2 == 0 and "lua" or "txt"), "w")
+        file.close()
+    end
+end
+local ok, err = pcall(function()
+    time("fs.find(\"*/*/*.lua\")", 50, function() fs.find(dir .. "/*/*.lua") end)
+    time("fs.find(\"*/dir1?/file5*\")", 200, function() fs.find(dir .. "/dir1?/file5*") end)
+    time("fs.list", 1000, function(i) fs.list(dir .. "/dir" .. (i % 20 + 1)) end)
+    time("fs.list + fs.attributes", 50, function(i)
+        local path = dir .. "/dir" .. (i % 20 + 1)
+        for _, name in ipairs(fs.list(path)) do fs.attributes(path .. "/" .. name) end
+    end)
+    time("fs.listAttributes", 50, function(i) fs.listAttributes(dir .. "/dir" .. (i % 20 + 1)) end)
+    time("fs.isDir", 50000, function(i) fs.isDir(dir .. "/dir1/file" .. (i % 100 + 1) .. ".txt") end)
+    time("fs.complete", 1000, function() fs.complete("file1", dir .. "/dir1") end)
+end)
+fs.delete(dir)
+if not ok then error(err, 0) end
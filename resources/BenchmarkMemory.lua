@@ -0,0 +1,108 @@
+-- CraftOS-PC allocator benchmark
+-- This program compares the speed of allocation-heavy Lua code with the slab
+-- allocator turned on and off. Run it from the shell; it reboots the computer
+-- once between the two halves of the test.
+
+local function time(name, fn)
+    collectgarbage()
+    local start = os.epoch "utc"
+    fn()
+    local ms = os.epoch "utc" - start
+    print(name .. ": " .. ms .. " ms")
+    os.queueEvent("nosleep")
+    os.pullEvent()
+    return ms
+end
+
+local function runTests()
+    local results = {}
+    -- Lots of short-lived small tables
+    results[1] = time("Table churn", function()
+        for i = 1, 1000000 do
+            local t = {i, i + 1, x = i}
+            t.y = t[1] + t.x
+        end
+    end)
+    -- Closures and upvalues
+    results[2] = time("Closures", function()
+        local sum = 0
+        for i = 1, 500000 do
+            local f = function() sum = sum + i end
+            f()
+        end
+    end)
+    -- Short strings that get interned and collected
+    results[3] = time("Short strings", function()
+        local t = {}
+        for i = 1, 500000 do t[i % 1000 + 1] = "key" .. i end
+    end)
+    -- Serialising nested tables, which does all of the above
+    results[4] = time("Serialisation", function()
+        local data = {}
+        for i = 1, 200 do data[i] = {id = i, name = "item" .. i, tags = {"a", "b", "c"}, pos = {x = i, y = -i, z = i * 2}} end
+        for _ = 1, 20 do textutils.unserialize(textutils.serialize(data)) end
+    end)
+    -- Tables that grow and shrink
+    results[5] = time("Table resizing", function()
+        for _ = 1, 2000 do
+            local t = {}
+            for i = 1, 200 do t[i] = i end
+            for i = 200, 1, -1 do t[i] = nil end
+        end
+    end)
+    return results
+end
+
+local names = {"Table churn", "Closures", "Short strings", "Serialisation", "Table resizing"}
+
+if shell == nil then error("This program must be run from the shell.") end
+
+local mode = ...
+if mode ~= "system" then
+    if config.get("slabAllocator") == false then
+        config.set("slabAllocator", true)
+        print("Please reboot the computer and try again.")
+        return
+    end
+    term.setTextColor(colors.yellow)
+    term.clear()
+    term.setCursorPos(1, 1)
+    print("This program will compare the slab allocator with the system allocator. It will take a few minutes to complete, and the computer will reboot once mid-way through.\n\nPress enter to continue.")
+    read()
+    term.setTextColor(colors.white)
+    print("Slab allocator:")
+    local results = runTests()
+    local file = fs.open(".benchmark_results", "w")
+    file.write(textutils.serialize(results))
+    file.close()
+    if fs.exists("/startup.lua") then fs.move("/startup.lua", "/startup.f8CyMWNJ.lua") end
+    file = fs.open("/startup.lua", "w")
+    file.write("shell.run(\"" .. shell.getRunningProgram() .. " system\")")
+    file.close()
+    config.set("slabAllocator", false)
+    os.reboot()
+else
+    term.setTextColor(colors.white)
+    print("System allocator:")
+    local results = runTests()
+    config.set("slabAllocator", true)
+    local file = fs.open(".benchmark_results", "r")
+    if file == nil then
+        printError("Could not open results for slab allocator test, did you run them before this?")
+        return
+    end
+    local slab = textutils.unserialize(file.readAll())
+    file.close()
+    fs.delete(".benchmark_results")
+    fs.delete("/startup.lua")
+    if fs.exists("/startup.f8CyMWNJ.lua") then fs.move("/startup.f8CyMWNJ.lua", "/startup.lua") end
+    term.clear()
+    term.setCursorPos(1, 1)
+    term.setTextColor(colors.yellow)
+    print("Results (slab / system):")
+    for i, name in ipairs(names) do
+        term.setTextColor(slab[i] <= results[i] and colors.green or colors.red)
+        print(("%s: %d ms / %d ms (%.2fx)"):format(name, slab[i], results[i], results[i] / math.max(slab[i], 1)))
+    end
+    term.setTextColor(colors.white)
+end
@@ -294,9 +294,56 @@ testStart "fs"
 	callLocal("file.close", file.close)
 	call("delete", "test_file.txt")
 	test("exists", false, "test_file.txt")
+	file = call("open", "/rom/apis/keys.lua", "rb")
+	testLocal("file.seek", callLocal("file.seek", file.seek, "end"), s)
+	testLocal("file.seek", callLocal("file.seek", file.seek, "set", 1), 1)
+	testLocal("file.readAll", #callLocal("file.readAll", file.readAll), s - 1)
+	callLocal("file.close", file.close)
+	testLocal("fs.attributes", call("attributes", "/rom/apis/keys.lua").size, s)
+	local romAttributes, romList = call("listAttributes", "/rom"), call("list", "/rom")
+	if romAttributes and romList and testLocal("#fs.listAttributes", #romAttributes, #romList) then
+		for i, name in ipairs(romList) do
+			testLocal("fs.listAttributes[" .. i .. "].name", romAttributes[i].name, name)
+			testLocal("fs.listAttributes[" .. i .. "].isDir", romAttributes[i].isDir, call("isDir", "/rom/" .. name))
+		end
+	end
 	test("combine", "rom/programs/shell.lua", "/rom/programs", "shell.lua")
 	test("find", {{"rom/apis/help.lua", "rom/help/help.txt", "rom/programs/help.lua"}}, "/rom/*/help.*")
 	test("complete", {{"abel.lua", "ist.lua", "ua.lua"}}, "l", "/rom/programs")
+	call("makeDir", "test_dir/a")
+	test("list", {{"a"}}, "test_dir")
+	test("find", {{"test_dir/a"}}, "test_dir/*")
+	file = call("open", "test_dir/b.txt", "w")
+	callLocal("file.close", file.close)
+	test("list", {{"a", "b.txt"}}, "test_dir")
+	local attributes = call("listAttributes", "test_dir")
+	if testLocal("#fs.listAttributes", #attributes, 2) then
+		testLocal("fs.listAttributes[1].name", attributes[1].name, "a")
+		testLocal("fs.listAttributes[1].isDir", attributes[1].isDir, true)
+		testLocal("fs.listAttributes[2].name", attributes[2].name, "b.txt")
+		testLocal("fs.listAttributes[2].size", attributes[2].size, 0)
+		testLocal("fs.listAttributes[2].modified", attributes[2].modified, call("attributes", "test_dir/b.txt").modified)
+	end
+	test("find", {{"test_dir/a", "test_dir/b.txt"}}, "test_dir/*")
+	call("move", "test_dir/b.txt", "test_dir/a/c.txt")
+	test("find", {{"test_dir/a/c.txt"}}, "test_dir/*/*")
+	call("delete", "test_dir/a")
+	test("list", {{}}, "test_dir")
+	test("isDir", false, "test_dir/a")
+	-- Watching isn't available on every platform
+	if fs.watch and pcall(fs.watch, "test_dir") then
+		file = call("open", "test_dir/d.txt", "w")
+		callLocal("file.close", file.close)
+		local timer = os.startTimer(2)
+		local event, path, changes
+		repeat event, path, changes = os.pullEvent() until event == "fs_change" or (event == "timer" and path == timer)
+		os.cancelTimer(timer)
+		testLocal("fs_change", path, "test_dir")
+		if type(changes) == "table" then testLocal("fs_change[1]", changes[1], "test_dir/d.txt") end
+		test("unwatch", true, "test_dir")
+		test("unwatch", false, "test_dir")
+	end
+	call("delete", "test_dir")
 testEnd()
 
 testStart "help"
@@ -426,6 +473,11 @@ testStart "os"
 	testLocal("os.clock", type(os.clock()), "number")
 	testLocal("os.time", type(os.time()), "number")
 	testLocal("os.day", type(os.day()), "number")
+	if os.memoryInfo then
+		local mem = callLocal("os.memoryInfo", os.memoryInfo) or {}
+		testLocal("os.memoryInfo.used", type(mem.used), "number")
+		testLocal("os.memoryInfo.peak", type(mem.peak) == "number" and mem.peak >= mem.used, true)
+	end
 	local id = call("startTimer", 3)
 	local ev = {call("pullEvent")}
 	while ev[1] ~= "timer" or ev[2] ~= id do ev = {call("pullEvent")} end
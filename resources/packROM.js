@@ -0,0 +1,71 @@
+// Run this script with Node: node packROM.js <ROM directory> <output file>
+// Generates a ROM pack that can be loaded with `craftos --rom <file>`
+// The format is described in src/rompack.hpp.
+const fs = require("fs");
+const path = require("path");
+if (process.argv.length < 4) {
+    console.log("Usage: node packROM.js <ROM directory> <output file>");
+    process.exit(1);
+}
+const romDir = process.argv[2];
+const ALIGNMENT = 64;
+const FLAG_DIR = 1;
+let entries = [];
+function addPath(name) {
+    const full = path.join(romDir, name);
+    if (!fs.existsSync(full)) return;
+    // statSync follows symlinks, so a linked directory is packed as a directory
+    if (fs.statSync(full).isDirectory()) {
+        console.log("Reading directory " + full);
+        entries.push({name: name, dir: true});
+        for (var f of fs.readdirSync(full)) {
+            if (f == "." || f == ".." || f == ".DS_Store" || f == "desktop.ini") continue;
+            addPath(name + "/" + f);
+        }
+    } else {
+        console.log("Reading file " + full);
+        entries.push({name: name, dir: false, data: fs.readFileSync(full)});
+    }
+}
+addPath("bios.lua");
+addPath("rom");
+addPath("debug");
+addPath("hdfont.bmp");
+entries.sort((a, b) => Buffer.compare(Buffer.from(a.name), Buffer.from(b.name)));
+
+let strings = [], stringsSize = 0;
+for (var e of entries) {
+    const name = Buffer.from(e.name);
+    e.nameOffset = stringsSize;
+    e.nameLength = name.length;
+    strings.push(name);
+    stringsSize += name.length;
+}
+const stringsOffset = 32 + entries.length * 32;
+let offset = stringsOffset + stringsSize;
+for (var e of entries) {
+    if (e.dir) {e.offset = 0; e.size = 0; continue;}
+    offset = Math.ceil(offset / ALIGNMENT) * ALIGNMENT;
+    e.offset = offset;
+    e.size = e.data.length;
+    offset += e.size;
+}
+
+let out = Buffer.alloc(offset);
+out.write("CCPCROM1", 0, "latin1");
+out.writeUInt32LE(1, 8);
+out.writeUInt32LE(entries.length, 12);
+out.writeBigUInt64LE(BigInt(stringsOffset), 16);
+out.writeBigUInt64LE(BigInt(stringsSize), 24);
+entries.forEach((e, i) => {
+    const pos = 32 + i * 32;
+    out.writeBigUInt64LE(BigInt(e.offset), pos);
+    out.writeBigUInt64LE(BigInt(e.size), pos + 8);
+    out.writeUInt32LE(e.nameOffset, pos + 16);
+    out.writeUInt32LE(e.nameLength, pos + 20);
+    out.writeUInt32LE(e.dir ? FLAG_DIR : 0, pos + 24);
+    if (!e.dir) e.data.copy(out, e.offset);
+});
+Buffer.concat(strings).copy(out, stringsOffset);
+fs.writeFileSync(process.argv[3], out);
+console.log("Wrote " + entries.length + " entries to " + process.argv[3]);
@@ -18,13 +18,22 @@ extern "C" {
 #include <peripheral.hpp>
 #include <sys/stat.h>
 #include "apis.hpp"
+#include "chunkcache.hpp"
+#include "dircache.hpp"
+#include "diskusage.hpp"
+#include "eventqueue.hpp"
+#include "fswatch.hpp"
 #include "main.hpp"
 #include "mem/cluster.hpp"
+#include "mem/slab.hpp"
 #include "peripheral/computer.hpp"
 #include "platform.hpp"
+#include "rompack.hpp"
 #include "runtime.hpp"
+#include "scheduler.hpp"
 #include "terminal/RawTerminal.hpp"
 #include "termsupport.hpp"
+#include "timerwheel.hpp"
 
 #ifdef __ANDROID__
 extern "C" {extern int Android_JNI_SetupThread(void);}
@@ -36,12 +45,11 @@ extern FileEntry standaloneDebug;
 extern std::string standaloneBIOS;
 #endif
 
-extern Uint32 eventTimeoutEvent(Uint32 interval, void* param);
+extern Uint32 eventTimeoutEvent(Uint32 interval, SDL_TimerID id, void* owner, void* param);
 extern int term_benchmark(lua_State *L);
 extern int onboardingMode;
 ProtectedObject<std::vector<Computer*> > computers;
 std::unordered_set<Computer*> freedComputers; 
-ProtectedObject<std::unordered_set<SDL_TimerID>> freedTimers;
 path_t computerDir;
 std::unordered_map<int, path_t> customDataDirs;
 std::list<path_t> customPlugins;
@@ -66,10 +74,16 @@ struct load_ctx {
 
 // Structure for memory allocators
 struct allocators {
-    ClusterAllocator ropes;
-    ClusterAllocator substrings;
+    SlabAllocator * slab = NULL; // NULL if the slabAllocator setting was off at boot
+    ClusterAllocator * ropes = NULL;
+    ClusterAllocator * substrings = NULL;
+    size_t TStringSize = 0;
 
-    allocators(size_t TStringSize): ropes(TStringSize), substrings(TStringSize) {}
+    ~allocators() {
+        delete ropes;
+        delete substrings;
+        delete slab;
+    }
 };
 
 // Basic CraftOS libraries
@@ -109,8 +123,16 @@ Computer::Computer(int i, bool debug): isDebugger(debug) {
     addVirtualMount(this, standaloneROM, "rom");
     if (debug) addVirtualMount(this, standaloneDebug, "debug");
 #else
-    if (!addMount(this, getROMPath() / "rom", "rom", ::config.romReadOnly)) { if (::config.standardsMode && term) { displayFailure(term, "Cannot mount ROM"); orphanedTerminals.insert(term); } else if (term) term->factory->deleteTerminal(term); throw std::runtime_error("Could not mount ROM"); }
-    if (debug) if (!addMount(this, getROMPath() / "debug", "debug", true)) { if (::config.standardsMode && term) { displayFailure(term, "Cannot mount ROM"); orphanedTerminals.insert(term); } else if (term) term->factory->deleteTerminal(term); throw std::runtime_error("Could not mount debugger ROM"); }
+    if (const FileEntry * packed = getROMPackMount("rom")) {
+        addVirtualMount(this, *packed, "rom");
+        if (debug) {
+            if (const FileEntry * packedDebug = getROMPackMount("debug")) addVirtualMount(this, *packedDebug, "debug");
+            else { if (::config.standardsMode && term) { displayFailure(term, "Cannot mount ROM"); orphanedTerminals.insert(term); } else if (term) term->factory->deleteTerminal(term); throw std::runtime_error("Could not mount debugger ROM"); }
+        }
+    } else {
+        if (!addMount(this, getROMPath() / "rom", "rom", ::config.romReadOnly)) { if (::config.standardsMode && term) { displayFailure(term, "Cannot mount ROM"); orphanedTerminals.insert(term); } else if (term) term->factory->deleteTerminal(term); throw std::runtime_error("Could not mount ROM"); }
+        if (debug) if (!addMount(this, getROMPath() / "debug", "debug", true)) { if (::config.standardsMode && term) { displayFailure(term, "Cannot mount ROM"); orphanedTerminals.insert(term); } else if (term) term->factory->deleteTerminal(term); throw std::runtime_error("Could not mount debugger ROM"); }
+    }
 #endif // STANDALONE_ROM
     // Mount custom directories from the command line
     for (auto m : customMounts) {
@@ -134,6 +156,7 @@ Computer::Computer(int i, bool debug): isDebugger(debug) {
         throw std::runtime_error("Could not create computer data directory: " + e.message());
     }
     config = new computer_configuration(_config);
+    event_queue_ctx = new EventQueue(this);
 }
 
 // Destructor
@@ -162,16 +185,17 @@ Computer::~Computer() {
         }
         if (c == referencers.end()) break;
     }
-    // Mark all currently running timers as invalid
-    {
-        LockGuard lock(freedTimers);
-        for (SDL_TimerID t : timerIDs) freedTimers->insert(t);
-    }
-    // Cancel the mouse_move debounce timer if active
-    if (mouseMoveDebounceTimer != 0) SDL_RemoveTimer(mouseMoveDebounceTimer);
-    if (eventTimeout != 0) SDL_RemoveTimer(eventTimeout);
+    // Cancel all timers, alarms and mouse_move debounces, and the abort watchdog
+    cancelOwnerTimers(this);
     // Stop all open websockets
     while (!openWebsockets.empty()) stopWebsocket(*openWebsockets.begin());
+    // Watches queue events from the watcher thread, so they have to go before the queue does
+    freeFileWatches(this);
+    delete event_queue_ctx;
+    delete allocator_ctx;
+    freeMountCache(this);
+    freeDirectoryCache(this);
+    forgetDiskUsage(this);
 }
 
 extern "C" {
@@ -389,23 +413,57 @@ static const luaL_Reg lualibs[] = {
 
 static int doNothing(lua_State *L) {return 0;}
 
+// Returns whether growing a block from osize to nsize bytes would take the computer over its memory limit
+static bool overMemoryLimit(Computer * comp, size_t osize, size_t nsize) {
+    if (nsize <= osize || !comp->memoryLimitEnabled) return false;
+    const size_t limit = comp->memoryLimit ? comp->memoryLimit : (config.computerMemoryLimit > 0 ? (size_t)config.computerMemoryLimit : 0);
+    return limit && comp->memoryUsage + (nsize - osize) > limit;
+}
+
+static void accountMemory(Computer * comp, size_t osize, size_t nsize) {
+    comp->memoryUsage = comp->memoryUsage - osize + nsize;
+    if (comp->memoryUsage > comp->memoryPeak) comp->memoryPeak = comp->memoryUsage;
+    if (osize == 0 && nsize) comp->allocationCount++;
+}
+
 static void * memAllocator(void * ud, void * ptr, size_t osize, size_t nsize) {
-    // TODO: separate allocator
-    if (nsize) return realloc(ptr, nsize);
-    else {free(ptr); return NULL;}
+    Computer * comp = (Computer*)ud;
+    SlabAllocator * slab = comp->allocator_ctx->slab;
+    if (ptr == NULL) osize = 0; // osize holds the object type for new blocks
+    if (nsize == 0) {
+        if (slab != NULL) slab->free(ptr, osize);
+        else free(ptr);
+        accountMemory(comp, osize, 0);
+        return NULL;
+    }
+    // Returning NULL makes Lua collect garbage and retry, then raise "not enough memory"
+    if (overMemoryLimit(comp, osize, nsize)) return NULL;
+    void * retval = slab != NULL ? slab->realloc(ptr, osize, nsize) : realloc(ptr, nsize);
+    if (retval != NULL) accountMemory(comp, osize, nsize);
+    return retval;
 }
 
 static void * objAllocator(void * ud, void * ptr, int type, size_t osize, size_t nsize) {
     Computer * comp = (Computer*)ud;
     switch (type) {
-        case LUA_TROPSTR: {
-            if (comp->allocator_ctx == NULL) comp->allocator_ctx = new allocators(nsize);
-            if (nsize) return comp->allocator_ctx->ropes.alloc();
-            else {comp->allocator_ctx->ropes.free(ptr); return NULL;}
-        } case LUA_TSUBSTR: {
-            if (comp->allocator_ctx == NULL) comp->allocator_ctx = new allocators(nsize);
-            if (nsize) return comp->allocator_ctx->substrings.alloc();
-            else {comp->allocator_ctx->substrings.free(ptr); return NULL;}
+        case LUA_TROPSTR: case LUA_TSUBSTR: {
+            allocators * ctx = comp->allocator_ctx;
+            if (ctx->ropes == NULL) {
+                ctx->TStringSize = nsize;
+                ctx->ropes = new ClusterAllocator(nsize);
+                ctx->substrings = new ClusterAllocator(nsize);
+            }
+            ClusterAllocator * cluster = type == LUA_TROPSTR ? ctx->ropes : ctx->substrings;
+            if (nsize) {
+                if (overMemoryLimit(comp, 0, ctx->TStringSize)) return NULL;
+                void * retval = cluster->alloc();
+                if (retval != NULL) accountMemory(comp, 0, ctx->TStringSize);
+                return retval;
+            } else {
+                cluster->free(ptr);
+                accountMemory(comp, ctx->TStringSize, 0);
+                return NULL;
+            }
         } default: return memAllocator(ud, ptr, osize, nsize);
     }
 }
@@ -414,366 +472,449 @@ static int errfunc(lua_State *L) {
     throw std::runtime_error("PANIC: unprotected error in call to Lua API (" + std::string(lua_tostring(L, -1)) + ")\n");
 }
 
-// Main computer loop
-void runComputer(Computer * self, const path_t& bios_name, const std::string& bios_data) {
-    self->running = 1;
-    if (self->L != NULL) lua_close(self->L);
-    setjmp(self->on_panic);
-    while (self->running) {
-        int status;
-        if (self->term != NULL) {
-            // Initialize terminal contents
-            std::lock_guard<std::mutex> lock(self->term->locked);
-            self->term->blinkX = 0;
-            self->term->blinkY = 0;
-            self->term->screen = vector2d<unsigned char>(self->term->width, self->term->height, ' ');
-            self->term->colors = vector2d<unsigned char>(self->term->width, self->term->height, 0xF0);
-            self->term->pixels = vector2d<unsigned char>(self->term->width * Terminal::fontWidth, self->term->height * Terminal::fontHeight, 0x0F);
-            memcpy(self->term->palette, defaultPalette, sizeof(defaultPalette));
-            self->term->mode = 0;
-            self->term->blink = false;
-            self->term->canBlink = false;
-            self->term->frozen = false;
-            if (dynamic_cast<SDLTerminal*>(self->term) != NULL) ((SDLTerminal*)self->term)->cursorColor = 0;
-            self->term->changed = true;
+// A compiled BIOS chunk, shared by all computers that boot the same BIOS
+struct bios_image {
+    std::string stamp; // size and modification time of the source it was compiled from
+    std::string bytecode;
+};
+static std::unordered_map<std::string, bios_image> biosImages;
+static std::mutex biosImagesMutex;
+
+// Loads the BIOS function onto the computer's coroutine. The first computer to
+// boot a BIOS parses it and saves the compiled chunk; every later boot and
+// reboot loads that instead, until the file changes.
+static int loadBIOS(Computer * self, const path_t& bios_path, const std::string& bios_data) {
+    int status;
+#ifdef STANDALONE_ROM
+    const std::string key = std::to_string((uintptr_t)bios_data.data());
+    const std::string stamp = std::to_string(bios_data.size());
+#else
+    const std::string key = bios_path.string();
+    std::string stamp;
+    // A packed BIOS can't change while it's mapped, so its address is enough to tell it apart
+    const char * packed = NULL;
+    size_t packedSize = 0;
+    if (getROMPackFile(bios_path.lexically_relative(getROMPath()).generic_string(), &packed, &packedSize)) {
+        stamp = "pack:" + std::to_string((uintptr_t)packed) + ":" + std::to_string(packedSize);
+    } else {
+        std::error_code e;
+        const uintmax_t size = fs::file_size(bios_path, e);
+        const fs::file_time_type mtime = fs::last_write_time(bios_path, e);
+        if (!e) stamp = std::to_string(size) + ":" + std::to_string(mtime.time_since_epoch().count());
+    }
+#endif
+    std::lock_guard<std::mutex> lock(biosImagesMutex);
+    const auto it = biosImages.find(key);
+    if (it != biosImages.end()) {
+        if (!stamp.empty() && it->second.stamp == stamp) {
+            // The image was compiled from source that was already allowed to load, so let it through the bytecode restriction
+            status = loadTrustedChunk(self->coro, it->second.bytecode, "@bios.lua");
+            if (status == 0) return status;
+            lua_pop(self->coro, 1);
         }
-        self->colors = 0xF0;
-        self->system_start = std::chrono::system_clock::now();
-        if (self->allocator_ctx != NULL) {
-            delete self->allocator_ctx;
-            self->allocator_ctx = NULL;
+        biosImages.erase(it);
+    }
+#ifdef STANDALONE_ROM
+    status = luaL_loadbuffer(self->coro, bios_data.c_str(), bios_data.size(), "@bios.lua");
+#else
+    if (packed != NULL) {
+        status = luaL_loadbuffer(self->coro, packed, packedSize, "@bios.lua");
+    } else {
+        std::ifstream bios_file(bios_path);
+        if (bios_file.is_open()) {
+            status = lua_load(self->coro, file_reader, &bios_file, "@bios.lua", NULL);
+            bios_file.close();
+        } else {
+            status = LUA_ERRFILE;
+            lua_pushstring(self->coro, strerror(errno));
         }
+    }
+#endif
+    if (status == 0 && !stamp.empty() && lua_isfunction(self->coro, -1)) {
+        bios_image& image = biosImages[key];
+        image.stamp = stamp;
+        if (!dumpChunk(self->coro, image.bytecode)) biosImages.erase(key);
+    }
+    return status;
+}
 
-        /*
-        * All Lua contexts are held in this structure. We work with it almost
-        * all the time.
-        */
-        lua_State *L = self->L = lua_newstate(memAllocator, self);
-        lua_atpanic(L, errfunc);
-        lua_setobjallocf(L, objAllocator, self);
-        uncache_state(L);
-
-        self->coro = lua_newthread(L);
-        self->paramQueue = lua_newthread(L);
-        if (selectedRenderer == 3) {
-            std::lock_guard<std::mutex> lock(self->rawFileStackMutex);
-            self->rawFileStack = luaL_newstate();
-            lua_pushinteger(self->rawFileStack, 1);
-            lua_pushlightuserdata(self->rawFileStack, self);
-            lua_settable(self->rawFileStack, LUA_REGISTRYINDEX);
-        }
-        while (!self->eventQueue.empty()) self->eventQueue.pop();
-        lua_setlockstate(L, false);
+// Resets the terminal to a blank screen
+static void clearTerminal(Computer * self) {
+    std::lock_guard<std::mutex> lock(self->term->locked);
+    self->term->blinkX = 0;
+    self->term->blinkY = 0;
+    self->term->screen = vector2d<unsigned char>(self->term->width, self->term->height, ' ');
+    self->term->colors = vector2d<unsigned char>(self->term->width, self->term->height, 0xF0);
+    self->term->pixels = vector2d<unsigned char>(self->term->width * Terminal::fontWidth, self->term->height * Terminal::fontHeight, 0x0F);
+    memcpy(self->term->palette, defaultPalette, sizeof(defaultPalette));
+    self->term->mode = 0;
+    self->term->blink = false;
+    self->term->canBlink = false;
+    self->term->frozen = false;
+    if (dynamic_cast<SDLTerminal*>(self->term) != NULL) ((SDLTerminal*)self->term)->cursorColor = 0;
+    self->term->markAllDirty();
+}
 
-        // Reinitialize any peripherals that were connected before rebooting
-        for (auto p : self->peripherals) p.second->reinitialize(L);
+// Creates a new Lua state for the computer and loads the BIOS, returning whether it loaded
+static bool bootComputer(Computer * self, const path_t& bios_name, const std::string& bios_data) {
+    int status;
+    // Initialize terminal contents
+    if (self->term != NULL) clearTerminal(self);
+    self->colors = 0xF0;
+    self->system_start = std::chrono::system_clock::now();
+    delete self->allocator_ctx;
+    self->allocator_ctx = new allocators;
+    if (config.slabAllocator) self->allocator_ctx->slab = new SlabAllocator;
+    self->memoryUsage = self->memoryPeak = 0;
+    self->allocationCount = 0;
+    self->memoryLimitEnabled = false;
 
-        // Push reference to this to the registry
-        lua_pushinteger(L, 1);
-        lua_pushlightuserdata(L, self);
-        lua_settable(L, LUA_REGISTRYINDEX);
-        lua_newtable(L);
-        lua_createtable(L, 0, 1);
-        lua_pushstring(L, "v");
-        lua_setfield(L, -2, "__mode");
-        lua_setmetatable(L, -2);
-        lua_setfield(L, LUA_REGISTRYINDEX, "_coroutine_stack");
-
-        // Load libraries
-        const luaL_Reg *lib = lualibs;
-        /* call open functions from 'loadedlibs' and set results to global table */
-        for (; lib->func; lib++) {
-            luaL_requiref(L, lib->name, lib->func, 1);
-            lua_pop(L, 1);  /* remove lib */
-        }
-        lua_getglobal(L, "os");
-        lua_getfield(L, -1, "date");
-        lua_setglobal(L, "os_date");
-        lua_pop(L, 1);
-        lua_pushnil(L);
-        lua_setglobal(L, "os");
-        // TODO: Fix logErrors since error hooks are no longer enabled
-        if (self->debugger != NULL && !self->isDebugger) lua_sethook(self->coro, termHook, LUA_MASKLINE | LUA_MASKRET | LUA_MASKCALL | LUA_MASKERROR | LUA_MASKRESUME | LUA_MASKYIELD, 0);
-        //else if (!self->isDebugger) lua_sethook(self->coro, termHook, LUA_MASKRET | LUA_MASKCALL | LUA_MASKERROR | LUA_MASKRESUME | LUA_MASKYIELD, 0);
-        //else lua_sethook(self->coro, termHook, LUA_MASKERROR, 0);
-        lua_atpanic(L, termPanic);
-        for (library_t ** lib = libraries; *lib != NULL; lib++) load_library(self, self->coro, **lib);
-        if (config.http_enable) load_library(self, self->coro, http_lib);
-        if (self->isDebugger && self->debugger != NULL) load_library(self, self->coro, *((library_t*)self->debugger));
-        lua_getglobal(self->coro, "redstone");
-        lua_setglobal(self->coro, "rs");
-        lua_getglobal(L, "os");
-        lua_getglobal(L, "os_date");
-        lua_setfield(L, -2, "date");
-        lua_pop(L, 1);
-        lua_pushnil(L);
-        lua_setglobal(L, "os_date");
-        if (config.standardsMode) {
-            // Override the default loader to allow yielding from `load`
-            lua_pushcfunction(L, yieldable_load);
-            lua_setglobal(L, "load");
-            // Disable bytecode
-            lua_setdisableflags(L, LUA_DISABLE_BYTECODE);
-        }
+    /*
+    * All Lua contexts are held in this structure. We work with it almost
+    * all the time.
+    */
+    lua_State *L = self->L = lua_newstate(memAllocator, self);
+    lua_atpanic(L, errfunc);
+    lua_setobjallocf(L, objAllocator, self);
+    uncache_state(L);
 
-        // Replace `os` in `_LOADED` with CC's `os`
-        lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
-        lua_getglobal(L, "os");
-        lua_setfield(L, -2, "os");
-        lua_pop(L, 1);
+    self->coro = lua_newthread(L);
+    self->paramQueue = lua_newthread(L);
+    self->event_queue_ctx->scratch = lua_newthread(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, "_event_scratch");
+    if (selectedRenderer == 3) {
+        std::lock_guard<std::mutex> lock(self->rawFileStackMutex);
+        self->rawFileStack = luaL_newstate();
+        lua_pushinteger(self->rawFileStack, 1);
+        lua_pushlightuserdata(self->rawFileStack, self);
+        lua_settable(self->rawFileStack, LUA_REGISTRYINDEX);
+    }
+    self->event_queue_ctx->clear();
+    lua_setlockstate(L, false);
 
-        // Load any plugins available
-        if (!config.vanilla) {
-            if (!globalPluginErrors.empty()) {
-                lua_getglobal(L, "_CCPC_PLUGIN_ERRORS");
-                if (lua_isnil(L, -1)) {
-                    lua_newtable(L);
-                    lua_pushvalue(L, -1);
-                    lua_setglobal(L, "_CCPC_PLUGIN_ERRORS");
-                }
-                for (const auto& err : globalPluginErrors) {
-                    lua_pushstring(L, err.first.stem().string().c_str());
-                    lua_pushstring(L, err.second.c_str());
-                    lua_settable(L, -3);
-                }
-                lua_pop(L, 1);
+    // Reinitialize any peripherals that were connected before rebooting
+    for (auto p : self->peripherals) p.second->reinitialize(L);
+
+    // Push reference to this to the registry
+    lua_pushinteger(L, 1);
+    lua_pushlightuserdata(L, self);
+    lua_settable(L, LUA_REGISTRYINDEX);
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, "_coroutine_stack");
+
+    // Load libraries
+    const luaL_Reg *lib = lualibs;
+    /* call open functions from 'loadedlibs' and set results to global table */
+    for (; lib->func; lib++) {
+        luaL_requiref(L, lib->name, lib->func, 1);
+        lua_pop(L, 1);  /* remove lib */
+    }
+    lua_getglobal(L, "os");
+    lua_getfield(L, -1, "date");
+    lua_setglobal(L, "os_date");
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_setglobal(L, "os");
+    // TODO: Fix logErrors since error hooks are no longer enabled
+    if (self->debugger != NULL && !self->isDebugger) lua_sethook(self->coro, termHook, LUA_MASKLINE | LUA_MASKRET | LUA_MASKCALL | LUA_MASKERROR | LUA_MASKRESUME | LUA_MASKYIELD, 0);
+    //else if (!self->isDebugger) lua_sethook(self->coro, termHook, LUA_MASKRET | LUA_MASKCALL | LUA_MASKERROR | LUA_MASKRESUME | LUA_MASKYIELD, 0);
+    //else lua_sethook(self->coro, termHook, LUA_MASKERROR, 0);
+    lua_atpanic(L, termPanic);
+    for (library_t ** lib = libraries; *lib != NULL; lib++) load_library(self, self->coro, **lib);
+    if (config.http_enable) load_library(self, self->coro, http_lib);
+    if (self->isDebugger && self->debugger != NULL) load_library(self, self->coro, *((library_t*)self->debugger));
+    lua_getglobal(self->coro, "redstone");
+    lua_setglobal(self->coro, "rs");
+    lua_getglobal(L, "os");
+    lua_getglobal(L, "os_date");
+    lua_setfield(L, -2, "date");
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_setglobal(L, "os_date");
+    if (config.standardsMode) {
+        // Override the default loader to allow yielding from `load`
+        lua_pushcfunction(L, yieldable_load);
+        lua_setglobal(L, "load");
+        // Disable bytecode
+        lua_setdisableflags(L, LUA_DISABLE_BYTECODE);
+    }
+    // Serve ROM files from the shared chunk cache
+    lua_getglobal(L, "load");
+    lua_pushboolean(L, config.standardsMode);
+    lua_pushcclosure(L, cached_load, 2);
+    lua_setglobal(L, "load");
+
+    // Replace `os` in `_LOADED` with CC's `os`
+    lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+    lua_getglobal(L, "os");
+    lua_setfield(L, -2, "os");
+    lua_pop(L, 1);
+
+    // Load any plugins available
+    if (!config.vanilla) {
+        if (!globalPluginErrors.empty()) {
+            lua_getglobal(L, "_CCPC_PLUGIN_ERRORS");
+            if (lua_isnil(L, -1)) {
+                lua_newtable(L);
+                lua_pushvalue(L, -1);
+                lua_setglobal(L, "_CCPC_PLUGIN_ERRORS");
+            }
+            for (const auto& err : globalPluginErrors) {
+                lua_pushstring(L, err.first.stem().string().c_str());
+                lua_pushstring(L, err.second.c_str());
+                lua_settable(L, -3);
             }
-            loadPlugins(self);
+            lua_pop(L, 1);
         }
+        loadPlugins(self);
+    }
 #if defined(__ANDROID__) || defined(__IPHONEOS__)
-        mobile_luaopen(L);
+    mobile_luaopen(L);
 #endif
 
-        // Delete unwanted globals
+    // Delete unwanted globals
+    lua_pushnil(L);
+    lua_setglobal(L, "dofile");
+    lua_pushnil(L);
+    lua_setglobal(L, "loadfile");
+    lua_pushnil(L);
+    lua_setglobal(L, "print");
+    lua_pushnil(L);
+    lua_setglobal(L, "cc.internal.error_info");
+    if (config.vanilla) {
         lua_pushnil(L);
-        lua_setglobal(L, "dofile");
+        lua_setglobal(L, "config");
         lua_pushnil(L);
-        lua_setglobal(L, "loadfile");
+        lua_setglobal(L, "mounter");
         lua_pushnil(L);
-        lua_setglobal(L, "print");
+        lua_setglobal(L, "periphemu");
+        lua_getglobal(L, "term");
         lua_pushnil(L);
-        lua_setglobal(L, "cc.internal.error_info");
-        if (config.vanilla) {
-            lua_pushnil(L);
-            lua_setglobal(L, "config");
-            lua_pushnil(L);
-            lua_setglobal(L, "mounter");
-            lua_pushnil(L);
-            lua_setglobal(L, "periphemu");
-            lua_getglobal(L, "term");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "getGraphicsMode");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "setGraphicsMode");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "getPixel");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "setPixel");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "drawPixels");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "getPixels");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "screenshot");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "showMouse");
-            lua_pushnil(L);
-            lua_setfield(L, -2, "setFrozen");
+        lua_setfield(L, -2, "getGraphicsMode");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "setGraphicsMode");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "getPixel");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "setPixel");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "drawPixels");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "getPixels");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "screenshot");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "showMouse");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "setFrozen");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "getFrozen");
+        lua_pop(L, 1);
+        lua_getglobal(L, "os");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "memoryInfo");
+        lua_pop(L, 1);
+        if (config.http_enable) {
+            lua_getglobal(L, "http");
             lua_pushnil(L);
-            lua_setfield(L, -2, "getFrozen");
-            lua_pop(L, 1);
-            if (config.http_enable) {
-                lua_getglobal(L, "http");
-                lua_pushnil(L);
-                lua_setfield(L, -2, "addListener");
-                lua_pushnil(L);
-                lua_setfield(L, -2, "removeListener");
-                lua_pushnil(L);
-                lua_setfield(L, -2, "websocketServer");
-                lua_pop(L, 1);
-            }
-            lua_getglobal(L, "debug");
+            lua_setfield(L, -2, "addListener");
             lua_pushnil(L);
-            lua_setfield(L, -2, "setbreakpoint");
+            lua_setfield(L, -2, "removeListener");
             lua_pushnil(L);
-            lua_setfield(L, -2, "unsetbreakpoint");
+            lua_setfield(L, -2, "websocketServer");
             lua_pop(L, 1);
         }
-        if (config.serverMode) {
-            if (config.http_enable) {
-                lua_getglobal(L, "http");
-                lua_pushnil(L);
-                lua_setfield(L, -2, "addListener");
-                lua_pushnil(L);
-                lua_setfield(L, -2, "removeListener");
-                lua_pushnil(L);
-                lua_setfield(L, -2, "websocketServer");
-                lua_pop(L, 1);
-            }
+        lua_getglobal(L, "debug");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "setbreakpoint");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "unsetbreakpoint");
+        lua_pop(L, 1);
+    }
+    if (config.serverMode) {
+        if (config.http_enable) {
+            lua_getglobal(L, "http");
             lua_pushnil(L);
-            lua_setglobal(L, "mounter");
+            lua_setfield(L, -2, "addListener");
             lua_pushnil(L);
-            lua_setglobal(L, "config");
+            lua_setfield(L, -2, "removeListener");
+            lua_pushnil(L);
+            lua_setfield(L, -2, "websocketServer");
+            lua_pop(L, 1);
         }
+        lua_pushnil(L);
+        lua_setglobal(L, "mounter");
+        lua_pushnil(L);
+        lua_setglobal(L, "config");
+    }
 
-        // Set default globals
-        lua_pushstring(L, ::config.default_computer_settings.c_str());
-        lua_setglobal(L, "_CC_DEFAULT_SETTINGS");
-        lua_pushboolean(L, ::config.disable_lua51_features);
-        lua_setglobal(L, "_CC_DISABLE_LUA51_FEATURES");
+    // Set default globals
+    lua_pushstring(L, ::config.default_computer_settings.c_str());
+    lua_setglobal(L, "_CC_DEFAULT_SETTINGS");
+    lua_pushboolean(L, ::config.disable_lua51_features);
+    lua_setglobal(L, "_CC_DISABLE_LUA51_FEATURES");
 #if CRAFTOSPC_INDEV == true && defined(CRAFTOSPC_COMMIT)
-        lua_pushstring(L, "ComputerCraft " CRAFTOSPC_CC_VERSION " (CraftOS-PC " CRAFTOSPC_VERSION "@" CRAFTOSPC_COMMIT ")");
+    lua_pushstring(L, "ComputerCraft " CRAFTOSPC_CC_VERSION " (CraftOS-PC " CRAFTOSPC_VERSION "@" CRAFTOSPC_COMMIT ")");
 #else
-        lua_pushstring(L, "ComputerCraft " CRAFTOSPC_CC_VERSION " (CraftOS-PC " CRAFTOSPC_VERSION ")");
+    lua_pushstring(L, "ComputerCraft " CRAFTOSPC_CC_VERSION " (CraftOS-PC " CRAFTOSPC_VERSION ")");
 #endif
-        lua_setglobal(L, "_HOST");
-        if (selectedRenderer == 1) {
-            lua_pushboolean(L, true);
-            lua_setglobal(L, "_HEADLESS");
-        }
-        if (onboardingMode == 1) {
-            lua_pushboolean(L, true);
-            lua_setglobal(L, "_CCPC_FIRST_RUN");
-            onboardingMode = 0;
-            config_save();
-        } else if (onboardingMode == 2) {
-            lua_pushboolean(L, true);
-            lua_setglobal(L, "_CCPC_UPDATED_VERSION");
-            onboardingMode = 0;
-            config_save();
-        }
-        if (!script_file.empty()) {
-            std::string script;
-            if (script_file[0] == '\x1b') script = script_file.substr(1);
-            else {
-                FILE* in = fopen(script_file.c_str(), "r");
-                if (in != NULL) {
-                    char tmp[4096];
-                    while (!feof(in)) {
-                        const size_t read = fread(tmp, 1, 4096, in);
-                        if (read == 0) break;
-                        script += std::string(tmp, read);
-                    }
-                    fclose(in);
-                } else script = "printError('Could not load startup script: " + std::string(strerror(errno)) + "')";
-            }
-            pushstring(L, script);
-            lua_setglobal(L, "_CCPC_STARTUP_SCRIPT");
-        }
-        if (!script_args.empty()) {
-            pushstring(L, script_args);
-            lua_setglobal(L, "_CCPC_STARTUP_ARGS");
+    lua_setglobal(L, "_HOST");
+    if (selectedRenderer == 1) {
+        lua_pushboolean(L, true);
+        lua_setglobal(L, "_HEADLESS");
+    }
+    if (onboardingMode == 1) {
+        lua_pushboolean(L, true);
+        lua_setglobal(L, "_CCPC_FIRST_RUN");
+        onboardingMode = 0;
+        config_save();
+    } else if (onboardingMode == 2) {
+        lua_pushboolean(L, true);
+        lua_setglobal(L, "_CCPC_UPDATED_VERSION");
+        onboardingMode = 0;
+        config_save();
+    }
+    if (!script_file.empty()) {
+        std::string script;
+        if (script_file[0] == '\x1b') script = script_file.substr(1);
+        else {
+            FILE* in = fopen(script_file.c_str(), "r");
+            if (in != NULL) {
+                char tmp[4096];
+                while (!feof(in)) {
+                    const size_t read = fread(tmp, 1, 4096, in);
+                    if (read == 0) break;
+                    script += std::string(tmp, read);
+                }
+                fclose(in);
+            } else script = "printError('Could not load startup script: " + std::string(strerror(errno)) + "')";
         }
-        lua_pushcfunction(L, term_benchmark);
-        lua_setfield(L, LUA_REGISTRYINDEX, "benchmark");
-
-        for (auto it = self->startupCallbacks.begin(); it != self->startupCallbacks.end(); it++) {
-            lua_pushcfunction(L, it->first);
-            lua_pushlightuserdata(L, it->second);
-            lua_call(L, 1, 1);
-            if (lua_toboolean(L, -1)) {
-                it = self->startupCallbacks.erase(it);
-                if (it == self->startupCallbacks.end()) {lua_pop(L, 1); break;}
-            }
-            lua_pop(L, 1);
+        pushstring(L, script);
+        lua_setglobal(L, "_CCPC_STARTUP_SCRIPT");
+    }
+    if (!script_args.empty()) {
+        pushstring(L, script_args);
+        lua_setglobal(L, "_CCPC_STARTUP_ARGS");
+    }
+    lua_pushcfunction(L, term_benchmark);
+    lua_setfield(L, LUA_REGISTRYINDEX, "benchmark");
+
+    for (auto it = self->startupCallbacks.begin(); it != self->startupCallbacks.end(); it++) {
+        lua_pushcfunction(L, it->first);
+        lua_pushlightuserdata(L, it->second);
+        lua_call(L, 1, 1);
+        if (lua_toboolean(L, -1)) {
+            it = self->startupCallbacks.erase(it);
+            if (it == self->startupCallbacks.end()) {lua_pop(L, 1); break;}
         }
+        lua_pop(L, 1);
+    }
 
-        /* Load the file containing the script we are going to run */
+    /* Load the file containing the script we are going to run */
 #ifdef STANDALONE_ROM
-        status = luaL_loadbuffer(self->coro, bios_data.c_str(), bios_data.size(), "@bios.lua");
-        path_t bios_path_expanded("standalone ROM");
+    path_t bios_path_expanded("standalone ROM");
 #else
-        path_t bios_path_expanded = getROMPath() / bios_name;
-        std::ifstream bios_file(bios_path_expanded);
-        if (bios_file.is_open()) {
-            status = lua_load(self->coro, file_reader, &bios_file, "@bios.lua", NULL);
-            bios_file.close();
-        } else {
-            status = LUA_ERRFILE;
-            lua_pushstring(self->coro, strerror(errno));
-        }
+    path_t bios_path_expanded = getROMPath() / bios_name;
 #endif
-        if (status || !lua_isfunction(self->coro, -1)) {
-            /* If something went wrong, error message is at the top of */
-            /* the stack */
-            fprintf(stderr, "Couldn't load BIOS: %s (%s). Please make sure the CraftOS ROM is installed properly. (See https://www.craftos-pc.cc/docs/error-messages for more information.)\n", bios_path_expanded.string().c_str(), lua_tostring(self->coro, -1));
-            if (::config.standardsMode) displayFailure(self->term, "Error loading bios.lua");
-            else queueTask([bios_path_expanded](void* term)->void*{
-                ((Terminal*)term)->showMessage(
-                    SDL_MESSAGEBOX_ERROR, "Couldn't load BIOS", 
-                    std::string(
-                        "Couldn't load BIOS from " + bios_path_expanded.string() + ". Please make sure the CraftOS ROM is installed properly. (See https://www.craftos-pc.cc/docs/error-messages for more information.)"
-                    ).c_str()
-                ); 
-                return NULL;
-            }, self->term);
-            return;
-        }
+    status = loadBIOS(self, bios_path_expanded, bios_data);
+    if (status || !lua_isfunction(self->coro, -1)) {
+        /* If something went wrong, error message is at the top of */
+        /* the stack */
+        fprintf(stderr, "Couldn't load BIOS: %s (%s). Please make sure the CraftOS ROM is installed properly. (See https://www.craftos-pc.cc/docs/error-messages for more information.)\n", bios_path_expanded.string().c_str(), lua_tostring(self->coro, -1));
+        if (::config.standardsMode) displayFailure(self->term, "Error loading bios.lua");
+        else queueTask([bios_path_expanded](void* term)->void*{
+            ((Terminal*)term)->showMessage(
+                SDL_MESSAGEBOX_ERROR, "Couldn't load BIOS", 
+                std::string(
+                    "Couldn't load BIOS from " + bios_path_expanded.string() + ". Please make sure the CraftOS ROM is installed properly. (See https://www.craftos-pc.cc/docs/error-messages for more information.)"
+                ).c_str()
+            ); 
+            return NULL;
+        }, self->term);
+        return false;
+    }
+
+    self->running = 1;
+    self->memoryLimitEnabled = true;
+    if (self->eventTimeout != 0) cancelTimer(self, self->eventTimeout);
+    if (config.abortTimeout > 0 || config.standardsMode) self->eventTimeout = addTimer(self, ::config.standardsMode ? 7000 : ::config.abortTimeout, eventTimeoutEvent, self);
+    return true;
+}
+
+// Closes the computer's Lua state and anything attached to it
+static void closeComputer(Computer * self) {
+    // Don't fail allocations made while cleaning up
+    self->memoryLimitEnabled = false;
+    // Shutdown threads
+    self->event_lock.notify_all();
+    // Stop all open websockets
+    while (!self->openWebsockets.empty()) stopWebsocket(*self->openWebsockets.begin());
+    for (library_t ** lib = libraries; *lib != NULL; lib++) if ((*lib)->deinit != NULL) (*lib)->deinit(self);
+    if (self->eventTimeout != 0) cancelTimer(self, self->eventTimeout);
+    self->eventTimeout = 0;
+    lua_close(self->L);   /* Cya, Lua */
+    self->L = NULL;
+    freeAllocators(self);
+    if (self->rawFileStack) {
+        std::lock_guard<std::mutex> lock(self->rawFileStackMutex);
+        lua_close(self->rawFileStack);
+        self->rawFileStack = NULL;
+    }
+}
+
+// Gives all of the allocator pages back at once; only call this after the Lua state is closed
+void freeAllocators(Computer * self) {
+    delete self->allocator_ctx;
+    self->allocator_ctx = NULL;
+}
+
+// Resumes the computer's top-level coroutine once, and stops the computer if it errored or returned
+static int resumeComputer(Computer * self, int narg) {
+    const auto start = std::chrono::steady_clock::now();
+    const int status = lua_resume(self->coro, NULL, narg);
+    self->runTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (status != LUA_YIELD && status != 0 && self->running == 1) {
+        // Catch runtime error
+        self->running = 0;
+        lua_checkstack(self->coro, 4);
+        lua_pushcfunction(self->coro, termPanic);
+        if (lua_isstring(self->coro, -2)) lua_pushvalue(self->coro, -2);
+        else lua_pushnil(self->coro);
+        lua_call(self->coro, 1, 0);
+    } else if (status != LUA_YIELD && self->running == 1) self->running = 0;
+    return status;
+}
+
+// Gets the event filter passed to coroutine.yield
+static std::string eventFilter(lua_State *coro) {
+    if (lua_gettop(coro) && lua_isstring(coro, -1)) return tostring(coro, -1);
+    return "";
+}
+
+// Main computer loop
+void runComputer(Computer * self, const path_t& bios_name, const std::string& bios_data) {
+    self->running = 1;
+    if (self->L != NULL) lua_close(self->L);
+    setjmp(self->on_panic);
+    while (self->running) {
+        if (!bootComputer(self, bios_name, bios_data)) return;
 
         /* Ask Lua to run our little script */
-        status = LUA_YIELD;
+        int status = LUA_YIELD;
         int narg = 0;
-        self->running = 1;
-#ifdef __EMSCRIPTEN__
-        queueTask([self](void*)->void*{
-            if (self->eventTimeout != 0) SDL_RemoveTimer(self->eventTimeout);
-            if (config.abortTimeout > 0 || config.standardsMode) self->eventTimeout = SDL_AddTimer(::config.standardsMode ? 7000 : ::config.abortTimeout, eventTimeoutEvent, self);
-            return NULL;
-        }, NULL);
-#else
-        if (self->eventTimeout != 0) SDL_RemoveTimer(self->eventTimeout);
-        if (config.abortTimeout > 0 || config.standardsMode) self->eventTimeout = SDL_AddTimer(::config.standardsMode ? 7000 : ::config.abortTimeout, eventTimeoutEvent, self);
-#endif
         while (status == LUA_YIELD && self->running == 1) {
-            status = lua_resume(self->coro, NULL, narg);
-            if (status == LUA_YIELD) {
-                if (lua_gettop(self->coro) && lua_isstring(self->coro, -1)) narg = getNextEvent(self->coro, tostring(self->coro, -1));
-                else narg = getNextEvent(self->coro, "");
-            } else if (status != 0 && self->running == 1) {
-                // Catch runtime error
-                self->running = 0;
-                lua_checkstack(self->coro, 4);
-                lua_pushcfunction(self->coro, termPanic);
-                if (lua_isstring(self->coro, -2)) lua_pushvalue(self->coro, -2);
-                else lua_pushnil(self->coro);
-                lua_call(self->coro, 1, 0);
-                break;
-            } else if (self->running == 1) self->running = 0;
+            status = resumeComputer(self, narg);
+            if (status == LUA_YIELD) narg = getNextEvent(self->coro, eventFilter(self->coro));
         }
 
         if (status == 0 && config.standardsMode && !self->term->errorMode) displayFailure(self->term, "Error running computer");
-        
-        // Shutdown threads
-        self->event_lock.notify_all();
-        // Stop all open websockets
-        while (!self->openWebsockets.empty()) stopWebsocket(*self->openWebsockets.begin());
-        for (library_t ** lib = libraries; *lib != NULL; lib++) if ((*lib)->deinit != NULL) (*lib)->deinit(self);
-        if (self->eventTimeout != 0) SDL_RemoveTimer(self->eventTimeout);
-        self->eventTimeout = 0;
-        lua_close(L);   /* Cya, Lua */
-        self->L = NULL;
-        if (self->rawFileStack) {
-            std::lock_guard<std::mutex> lock(self->rawFileStackMutex);
-            lua_close(self->rawFileStack);
-            self->rawFileStack = NULL;
-        }
-    }
-    if (self->term != NULL && !self->term->errorMode) {
-        // Reset terminal contents
-        std::lock_guard<std::mutex> lock(self->term->locked);
-        self->term->blinkX = 0;
-        self->term->blinkY = 0;
-        self->term->screen = vector2d<unsigned char>(self->term->width, self->term->height, ' ');
-        self->term->colors = vector2d<unsigned char>(self->term->width, self->term->height, 0xF0);
-        self->term->pixels = vector2d<unsigned char>(self->term->width * Terminal::fontWidth, self->term->height * Terminal::fontHeight, 0x0F);
-        memcpy(self->term->palette, defaultPalette, sizeof(defaultPalette));
-        self->term->mode = 0;
-        self->term->blink = false;
-        self->term->canBlink = false;
-        self->term->frozen = false;
-        if (dynamic_cast<SDLTerminal*>(self->term) != NULL) ((SDLTerminal*)self->term)->cursorColor = 0;
-        self->term->changed = true;
+        closeComputer(self);
     }
+    if (self->term != NULL && !self->term->errorMode) clearTerminal(self);
 }
 
 // Gets the next event for the given computer
@@ -787,6 +928,76 @@ bool Computer_getEvent(Computer * self, SDL_Event* e) {
     return true;
 }
 
+// Cleans up after an exception escapes a running computer
+static void computerCrashed(Computer * comp, const std::string& message) {
+    fprintf(stderr, "Uncaught exception while executing computer %d (last C function: %s): %s\n", comp->id, lastCFunction, message.c_str());
+    queueTask([message](void*t)->void* {const std::string m = "Uh oh, an uncaught exception has occurred! Please report this to https://www.craftos-pc.cc/bugreport. When writing the report, include the following exception message: \"" + message + "\". The computer will now shut down.";  if (t != NULL) ((Terminal*)t)->showMessage(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", m.c_str()); else if (selectedRenderer == 0 || selectedRenderer == 5) SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", m.c_str(), NULL); return NULL; }, comp->term);
+    if (comp->L != NULL) closeComputer(comp);
+    if (selectedRenderer == 1) returnValue = 1;
+}
+
+#if defined(__IPHONEOS__) || defined(__ANDROID__)
+static void showRestartPrompt(Computer * comp) {
+    {
+        std::lock_guard<std::mutex> lock(comp->term->locked);
+        memcpy(comp->term->screen.data(), "Tap to restart", sizeof("Tap to restart")-1);
+        memcpy(comp->term->colors.data(), "\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4", sizeof("\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4")-1);
+        comp->term->markAllDirty();
+    }
+    queueTask([](void*)->void*{SDL_StopTextInput(); return NULL;}, NULL, true);
+}
+#endif
+
+// Handles the UI events queued while a computer is shut down, returning 1 to restart, 0 to close, or -1 if undecided
+static int checkRestart(Computer * comp) {
+    SDL_Event e;
+    while (Computer_getEvent(comp, &e)) {
+#if defined(__IPHONEOS__) || defined(__ANDROID__)
+        if (e.type == SDL_MOUSEBUTTONUP) {
+            queueTask([](void*)->void*{SDL_StartTextInput(); return NULL;}, NULL, true);
+            return 1;
+#else
+        if (e.type == SDL_KEYDOWN && ((selectedRenderer == 0 || selectedRenderer == 5) ? e.key.keysym.sym == SDLK_r : e.key.keysym.sym == 19) && (e.key.keysym.mod & KMOD_CTRL)) {
+            if (comp->waitingForTerminate & 16) {
+                comp->waitingForTerminate |= 32;
+                comp->waitingForTerminate &= ~16;
+                return 1;
+            } else if ((comp->waitingForTerminate & 48) == 0) comp->waitingForTerminate |= 16;
+        } else if (e.type == SDL_KEYUP) {
+            comp->waitingForTerminate = 0;
+#endif
+        } else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE) {
+            if (e.window.windowID == comp->term->id) return 0;
+            std::string side;
+            monitor * m = findMonitorFromWindowID(comp, e.window.windowID, &side);
+            if (m != NULL) detachPeripheral(comp, side);
+        } else if (e.type == SDL_QUIT) return 0;
+    }
+    return -1;
+}
+
+// Removes a finished computer from the computer list and queues it for deletion
+void removeComputer(Computer * comp) {
+    {
+        LockGuard lock(computers);
+        freedComputers.insert(comp);
+        queueTask([](void* arg)->void* {delete (Computer*)arg; return NULL;}, comp, true);
+        for (auto it = computers->begin(); it != computers->end(); ++it) {
+            if (*it == comp) {
+                it = computers->erase(it);
+                if (it == computers->end()) break;
+            }
+        }
+    }
+    if (selectedRenderer != 0 && selectedRenderer != 2 && selectedRenderer != 5 && !exiting) {
+        {LockGuard lock(taskQueue);}
+        while (taskQueueReady && !exiting) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        taskQueueReady = true;
+        taskQueueNotify.notify_all();
+        while (taskQueueReady && !exiting) {std::this_thread::yield(); taskQueueNotify.notify_all();}
+    }
+}
+
 // Thread wrapper for running a computer
 void* computerThread(void* data) {
     Computer * comp = (Computer*)data;
@@ -806,57 +1017,15 @@ void* computerThread(void* data) {
     do {
         if (!first) {
 #if defined(__IPHONEOS__) || defined(__ANDROID__)
-            {
-                std::lock_guard<std::mutex> lock(comp->term->locked);
-                memcpy(comp->term->screen.data(), "Tap to restart", sizeof("Tap to restart")-1);
-                memcpy(comp->term->colors.data(), "\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4", sizeof("\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4\xF4")-1);
-                comp->term->changed = true;
-            }
-            queueTask([](void*)->void*{SDL_StopTextInput(); return NULL;}, NULL, true);
-#endif
-            bool ok = true;
-            while (true) {
-                SDL_Event e;
-                std::string tmpstrval;
-                {
-                    std::mutex m;
-                    std::unique_lock<std::mutex> l(m);
-                    while (comp->termEventQueue.empty()) 
-                        comp->event_lock.wait_for(l, std::chrono::seconds(5), [comp]()->bool{return !comp->termEventQueue.empty();});
-                }
-                if (Computer_getEvent(comp, &e)) {
-#if defined(__IPHONEOS__) || defined(__ANDROID__)
-                    if (e.type == SDL_MOUSEBUTTONUP) {
-                        break;
-#else
-                    if (e.type == SDL_KEYDOWN && ((selectedRenderer == 0 || selectedRenderer == 5) ? e.key.keysym.sym == SDLK_r : e.key.keysym.sym == 19) && (e.key.keysym.mod & KMOD_CTRL)) {
-                        if (comp->waitingForTerminate & 16) {
-                            comp->waitingForTerminate |= 32;
-                            comp->waitingForTerminate &= ~16;
-                            break;
-                        } else if ((comp->waitingForTerminate & 48) == 0) comp->waitingForTerminate |= 16;
-                    } else if (e.type == SDL_KEYUP) {
-                        comp->waitingForTerminate = 0;
+            showRestartPrompt(comp);
 #endif
-                    } else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE) {
-                        if (e.window.windowID == comp->term->id) {
-                            ok = false;
-                            break;
-                        } else {
-                            std::string side;
-                            monitor * m = findMonitorFromWindowID(comp, e.window.windowID, &side);
-                            if (m != NULL) detachPeripheral(comp, side);
-                        }
-                    } else if (e.type == SDL_QUIT) {
-                        ok = false;
-                        break;
-                    }
-                }
+            int restart;
+            while ((restart = checkRestart(comp)) < 0) {
+                std::mutex m;
+                std::unique_lock<std::mutex> l(m);
+                comp->event_lock.wait_for(l, std::chrono::seconds(5), [comp]()->bool{return !comp->termEventQueue.empty();});
             }
-            if (!ok) break;
-#if defined(__IPHONEOS__) || defined(__ANDROID__)
-            queueTask([](void*)->void*{SDL_StartTextInput(); return NULL;}, NULL, true);
-#endif
+            if (!restart) break;
         }
         try {
 #ifdef STANDALONE_ROM
@@ -865,65 +1034,99 @@ void* computerThread(void* data) {
             runComputer(comp, "bios.lua");
 #endif
         } catch (Poco::Exception &e) {
-            fprintf(stderr, "Uncaught exception while executing computer %d (last C function: %s): %s\n", comp->id, lastCFunction, e.displayText().c_str());
-            queueTask([e](void*t)->void* {const std::string m = "Uh oh, an uncaught exception has occurred! Please report this to https://www.craftos-pc.cc/bugreport. When writing the report, include the following exception message: \"Poco exception on computer thread: " + e.displayText() + "\". The computer will now shut down.";  if (t != NULL) ((Terminal*)t)->showMessage(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", m.c_str()); else if (selectedRenderer == 0 || selectedRenderer == 5) SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", m.c_str(), NULL); return NULL; }, comp->term);
-            if (comp->L != NULL) {
-                comp->event_lock.notify_all();
-                // Stop all open websockets
-                while (!comp->openWebsockets.empty()) stopWebsocket(*comp->openWebsockets.begin());
-                for (library_t ** lib = libraries; *lib != NULL; lib++) if ((*lib)->deinit != NULL) (*lib)->deinit(comp);
-                if (comp->eventTimeout != 0) SDL_RemoveTimer(comp->eventTimeout);
-                comp->eventTimeout = 0;
-                lua_close(comp->L);   /* Cya, Lua */
-                comp->L = NULL;
-                if (comp->rawFileStack) {
-                    std::lock_guard<std::mutex> lock(comp->rawFileStackMutex);
-                    lua_close(comp->rawFileStack);
-                    comp->rawFileStack = NULL;
-                }
-            }
-            if (selectedRenderer == 1) returnValue = 1;
+            computerCrashed(comp, "Poco exception on computer thread: " + e.displayText());
         } catch (std::exception &e) {
-            fprintf(stderr, "Uncaught exception while executing computer %d (last C function: %s): %s\n", comp->id, lastCFunction, e.what());
-            queueTask([e](void*t)->void* {const std::string m = std::string("Uh oh, an uncaught exception has occurred! Please report this to https://www.craftos-pc.cc/bugreport. When writing the report, include the following exception message: \"Exception on computer thread: ") + e.what() + "\". The computer will now shut down.";  if (t != NULL) ((Terminal*)t)->showMessage(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", m.c_str()); else if (selectedRenderer == 0 || selectedRenderer == 5) SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", m.c_str(), NULL); return NULL; }, comp->term);
-            if (comp->L != NULL) {
-                comp->event_lock.notify_all();
-                // Stop all open websockets
-                while (!comp->openWebsockets.empty()) stopWebsocket(*comp->openWebsockets.begin());
-                for (library_t ** lib = libraries; *lib != NULL; lib++) if ((*lib)->deinit != NULL) (*lib)->deinit(comp);
-                if (comp->eventTimeout != 0) SDL_RemoveTimer(comp->eventTimeout);
-                comp->eventTimeout = 0;
-                lua_close(comp->L);   /* Cya, Lua */
-                comp->L = NULL;
-                if (comp->rawFileStack) {
-                    std::lock_guard<std::mutex> lock(comp->rawFileStackMutex);
-                    lua_close(comp->rawFileStack);
-                    comp->rawFileStack = NULL;
-                }
-            }
-            if (selectedRenderer == 1) returnValue = 1;
+            computerCrashed(comp, std::string("Exception on computer thread: ") + e.what());
         }
         first = false;
     } while ((config.keepOpenOnShutdown || config.standardsMode) && !comp->requestedExit);
-    {
-        LockGuard lock(computers);
-        freedComputers.insert(comp);
-        queueTask([](void* arg)->void* {delete (Computer*)arg; return NULL;}, comp, true);
-        for (auto it = computers->begin(); it != computers->end(); ++it) {
-            if (*it == comp) {
-                it = computers->erase(it);
-                if (it == computers->end()) break;
+    removeComputer(comp);
+    return NULL;
+}
+
+// Parks a computer on the worker pool until the next event, returning false if one arrived since it last checked
+static bool parkComputer(Computer * comp) {
+    int state = TASK_RUNNING;
+    if (comp->event_queue_ctx->taskState.compare_exchange_strong(state, TASK_IDLE)) return true;
+    comp->event_queue_ctx->taskState = TASK_RUNNING;
+    return false;
+}
+
+// Runs a computer on a worker thread until it has to wait for an event, uses up its time slice, or exits
+int runComputerSlice(computer_task * task) {
+    Computer * comp = task->comp;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TASK_TIME_SLICE);
+    if (setjmp(comp->on_panic)) task->phase = TASK_PHASE_STOPPED; // termPanic already closed the Lua state
+    try {
+        while (true) {
+            switch (task->phase) {
+            case TASK_PHASE_RESTART: {
+                if (!task->restartShown) {
+#if defined(__IPHONEOS__) || defined(__ANDROID__)
+                    showRestartPrompt(comp);
+#endif
+                    task->restartShown = true;
+                }
+                const int restart = checkRestart(comp);
+                if (restart < 0) {
+                    if (parkComputer(comp)) return TASK_IDLE;
+                    break;
+                } else if (restart == 0) return -1;
+                task->restartShown = false;
+                task->phase = TASK_PHASE_BOOT;
+                break;
+            } case TASK_PHASE_BOOT:
+                if (!task->started) {
+                    if (comp->config->startFullscreen && dynamic_cast<SDLTerminal*>(comp->term) != NULL) ((SDLTerminal*)comp->term)->toggleFullscreen();
+                    task->started = true;
+                }
+                comp->running = 1;
+                if (comp->L != NULL) lua_close(comp->L);
+#ifdef STANDALONE_ROM
+                if (!bootComputer(comp, "standalone BIOS", standaloneBIOS)) {task->phase = TASK_PHASE_FAILED; break;}
+#else
+                if (!bootComputer(comp, "bios.lua", "")) {task->phase = TASK_PHASE_FAILED; break;}
+#endif
+                task->narg = 0;
+                task->phase = TASK_PHASE_RESUME;
+                break;
+            case TASK_PHASE_WAIT: {
+                const int narg = getNextEvent(comp->coro, eventFilter(comp->coro), false);
+                if (narg < 0) {
+                    if (parkComputer(comp)) return TASK_IDLE;
+                    break;
+                }
+                task->narg = narg;
+                task->phase = TASK_PHASE_RESUME;
+                break;
+            } case TASK_PHASE_RESUME: {
+                const int status = comp->running == 1 ? resumeComputer(comp, task->narg) : LUA_YIELD;
+                if (status == LUA_YIELD && comp->running == 1) task->phase = TASK_PHASE_WAIT;
+                else {
+                    if (status == 0 && config.standardsMode && !comp->term->errorMode) displayFailure(comp->term, "Error running computer");
+                    closeComputer(comp);
+                    task->phase = comp->running ? TASK_PHASE_BOOT : TASK_PHASE_STOPPED;
+                }
+                // Let other computers run once this one has used up its time slice
+                if (std::chrono::steady_clock::now() >= deadline) return TASK_QUEUED;
+                break;
+            } case TASK_PHASE_STOPPED:
+                if (comp->term != NULL && !comp->term->errorMode) clearTerminal(comp);
+                task->phase = TASK_PHASE_FAILED;
+                break;
+            case TASK_PHASE_FAILED:
+                if (!(config.keepOpenOnShutdown || config.standardsMode) || comp->requestedExit) return -1;
+                task->phase = TASK_PHASE_RESTART;
+                break;
             }
         }
+    } catch (Poco::Exception &e) {
+        computerCrashed(comp, "Poco exception on computer thread: " + e.displayText());
+    } catch (std::exception &e) {
+        computerCrashed(comp, std::string("Exception on computer thread: ") + e.what());
     }
-    if (selectedRenderer != 0 && selectedRenderer != 2 && selectedRenderer != 5 && !exiting) {
-        {LockGuard lock(taskQueue);}
-        while (taskQueueReady && !exiting) std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        taskQueueReady = true;
-        taskQueueNotify.notify_all();
-        while (taskQueueReady && !exiting) {std::this_thread::yield(); taskQueueNotify.notify_all();}
-    }
-    return NULL;
+    task->phase = TASK_PHASE_FAILED;
+    return TASK_QUEUED;
 }
 
 /* export */ std::list<std::thread*> computerThreads;
@@ -945,6 +1148,12 @@ Computer * startComputer(int id) {
         LockGuard lock(computers);
         computers->push_back(comp);
     }
+    if (config.schedulerThreads > 0) {
+        // in case the allocator decides to reuse pointers
+        freedComputers.erase(comp);
+        startComputerTask(comp);
+        return comp;
+    }
     std::thread * th = new std::thread(computerThread, comp);
     setThreadName(*th, "Computer " + std::to_string(id) + " Thread");
     computerThreads.push_back(th);
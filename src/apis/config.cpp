@@ -84,6 +84,11 @@ static int config_get(lua_State *L) {
     getConfigSetting(useWebP, boolean);
     getConfigSetting(dropFilePath, boolean);
     getConfigSetting(useDFPWM, boolean);
+    getConfigSetting(rawCompressionLevel, integer);
+    getConfigSetting(schedulerThreads, integer);
+    getConfigSetting(computerMemoryLimit, integer);
+    getConfigSetting(slabAllocator, boolean);
+    getConfigSetting(maximumFileWatches, integer);
     else if (strcmp(name, "useHDFont") == 0) {
         if (config.customFontPath.empty()) lua_pushboolean(L, false);
         else if (config.customFontPath == "hdfont") lua_pushboolean(L, true);
@@ -221,6 +226,11 @@ static int config_set(lua_State *L) {
     setConfigSetting(useWebP, boolean);
     setConfigSetting(dropFilePath, boolean);
     setConfigSetting(useDFPWM, boolean);
+    setConfigSettingI(rawCompressionLevel);
+    setConfigSettingI(schedulerThreads);
+    setConfigSettingI(computerMemoryLimit);
+    setConfigSetting(slabAllocator, boolean);
+    setConfigSettingI(maximumFileWatches);
     else if (strcmp(name, "useHDFont") == 0)
         config.customFontPath = lua_toboolean(L, 2) ? "hdfont" : "";
     else if (strcmp(name, "http_whitelist") == 0) {
@@ -15,7 +15,6 @@
 #include <filesystem>
 #include <fstream>
 #include <iterator>
-#include <regex>
 #include <sstream>
 #include <Computer.hpp>
 #include <configuration.hpp>
@@ -23,8 +22,14 @@
 #include <FileEntry.hpp>
 #include <sys/stat.h>
 #include "handles/fs_handle.hpp"
+#include "../dircache.hpp"
+#include "../diskusage.hpp"
+#include "../fswatch.hpp"
 #include "../platform.hpp"
+#include "../romcache.hpp"
+#include "../rompack.hpp"
 #include "../runtime.hpp"
+#include "../vfsindex.hpp"
 #ifdef WIN32
 #include <io.h>
 #define W_OK 0x02
@@ -38,8 +43,6 @@
 #define W_OK 2
 #endif
 
-static std::basic_regex<path_t::value_type> pathregex(const std::string& str) {return std::basic_regex<path_t::value_type>(path_t(str).native());};
-
 #define err(L, idx, err) luaL_error(L, "/%s: %s", fixpath(get_comp(L), lua_tostring(L, idx), false, false).string().c_str(), err)
 
 #ifdef STANDALONE_ROM
@@ -55,16 +58,15 @@ static path_t ignored_files[4] = {
     "desktop.ini"
 };
 
-static bool _nothrow(std::function<void()> f) { try { f(); return true; } catch (...) { return false; } }
-#define nothrow(expr) _nothrow([&](){ expr ;})
-
-inline bool isVFSPath(path_t path) {
-    if (!std::isdigit(path.native()[0])) return false;
-    for (const path_t::value_type& c : path.native()) {
-        if (c == ':') return true;
-        else if (!std::isdigit(c)) return false;
-    }
-    return false;
+// Gets the contents of the BIOS that the debugger's ":bios.lua" refers to, if it isn't a file on disk
+static bool getPackedBIOS(const char ** data, size_t * size) {
+#ifdef STANDALONE_ROM
+    *data = standaloneBIOS.data();
+    *size = standaloneBIOS.size();
+    return true;
+#else
+    return getROMPackFile("bios.lua", data, size);
+#endif
 }
 
 static std::vector<path_t> fixpath_multiple(Computer *comp, std::string path) {
@@ -82,12 +84,12 @@ static std::vector<path_t> fixpath_multiple(Computer *comp, std::string path) {
         }
     }
     while (!pathc.empty() && pathc.front().empty()) pathc.pop_front();
-    if (comp->isDebugger && pathc.size() == 1 && pathc.front() == "bios.lua")
-#ifdef STANDALONE_ROM
-        return {path_t(":bios.lua", path_t::format::generic_format)};
-#else
+    if (comp->isDebugger && pathc.size() == 1 && pathc.front() == "bios.lua") {
+        const char * data;
+        size_t size;
+        if (getPackedBIOS(&data, &size)) return {path_t(":bios.lua", path_t::format::generic_format)};
         return {getROMPath()/"bios.lua"};
-#endif
+    }
     std::pair<size_t, std::vector<_path_t> > max_path = std::make_pair(0, std::vector<_path_t>(1, comp->dataDir));
     std::list<std::string> * mount_list = NULL;
     for (auto& m : comp->mounts) {
@@ -105,9 +107,10 @@ static std::vector<path_t> fixpath_multiple(Computer *comp, std::string path) {
     for (const _path_t& p : max_path.second) {
         path_t sstmp = p;
         std::error_code e;
+        std::shared_ptr<const VFSIndex> index;
         for (const std::string& s : pathc) sstmp /= s;
         if (
-            (isVFSPath(p) && nothrow(comp->virtualMounts[(unsigned)std::stoul(p.substr(0, p.size()-1))]->path(sstmp.string()))) ||
+            (isVFSPath(p) && findVFSEntry(comp, sstmp, index) != NULL) ||
             (fs::exists(sstmp, e))) {
             if (path_t::preferred_separator != (path_t::value_type)'/' && isVFSPath(sstmp)) {
                 path_t::string_type str = sstmp.native();
@@ -125,7 +128,7 @@ static std::string normalizePath(const path_t& basePath, bool allowWildcards = f
     for (const auto& p : basePath) {
         path_t::string_type str = p.native();
         str.erase(std::remove_if(str.begin(), str.end(), [allowWildcards](path_t::string_type::value_type c)->bool {return c == '"' || (c == '*' && !allowWildcards) || c == ':' || c == '<' || c == '>' || (c == '?' && !allowWildcards) || c == '|' || c < 32;}), str.end());
-        if (std::regex_match(str, pathregex("^\\.\\.\\.+$"))) cleanPath /= ".";
+        if (str.size() >= 3 && std::all_of(str.begin(), str.end(), [](path_t::value_type c)->bool {return c == '.';})) cleanPath /= ".";
         else cleanPath /= path_t(str);
     }
     cleanPath = cleanPath.lexically_normal();
@@ -160,23 +163,22 @@ static int fs_list(lua_State *L) {
     bool gotdir = false;
     std::set<std::string> entries;
     for (const path_t& path : possible_paths) {
-        if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) {
-            try {
-                const FileEntry &d = get_comp(L)->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin()));
-                if (d.isDir) {
-                    gotdir = true;
-                    for (const auto& p : d.dir) entries.insert(p.first);
-                }
-            } catch (...) {continue;}
-        } else {
-            std::error_code e;
-            if (fs::is_directory(path, e)) {
+        if (isVFSPath(*path.begin())) {
+            std::shared_ptr<const VFSIndex> index;
+            const VFSIndex::entry * d = findVFSEntry(get_comp(L), path, index);
+            if (d != NULL && d->isDir) {
                 gotdir = true;
-                for (const auto& dir : fs::directory_iterator(path, e)) {
-                    if (dir.path().filename() == ".DS_Store" || dir.path().filename() == "desktop.ini") continue;
-                    entries.insert(dir.path().filename().u8string());
-                }
+                entries.insert(d->children.begin(), d->children.end());
             }
+        } else if (const std::shared_ptr<const rom_node> node = findROMNode(path)) {
+            if (node->isDir) {
+                gotdir = true;
+                for (const auto& p : node->children)
+                    if (p.first != ".DS_Store" && p.first != "desktop.ini") entries.insert(p.first);
+            }
+        } else if (const std::shared_ptr<const dir_listing> listing = listHostDirectory(get_comp(L), path)) {
+            gotdir = true;
+            for (const dir_entry& e : *listing) entries.insert(e.name);
         }
     }
     if (!gotdir) err(L, 1, "Not a directory");
@@ -196,14 +198,11 @@ static int fs_list(lua_State *L) {
 static int fs_exists(lua_State *L) {
     lastCFunction = __func__;
     const path_t path = fixpath(get_comp(L), checkstring(L, 1), true);
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) {
-        bool found = true;
-        try {get_comp(L)->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin()));} catch (...) {found = false;}
-        lua_pushboolean(L, found);
-#ifdef STANDALONE_ROM
+    if (isVFSPath(*path.begin())) {
+        std::shared_ptr<const VFSIndex> index;
+        lua_pushboolean(L, findVFSEntry(get_comp(L), path, index) != NULL);
     } else if (path == ":bios.lua") {
         lua_pushboolean(L, true);
-#endif
     } else {
         lua_pushboolean(L, !path.empty());
     }
@@ -217,12 +216,15 @@ static int fs_isDir(lua_State *L) {
         lua_pushboolean(L, false);
         return 1;
     }
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) {
-        try {lua_pushboolean(L, get_comp(L)->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin())).isDir);} 
-        catch (...) {lua_pushboolean(L, false);}
+    if (isVFSPath(*path.begin())) {
+        std::shared_ptr<const VFSIndex> index;
+        const VFSIndex::entry * d = findVFSEntry(get_comp(L), path, index);
+        lua_pushboolean(L, d != NULL && d->isDir);
     } else {
         std::error_code e;
-        lua_pushboolean(L, fs::is_directory(path, e));
+        bool isDir;
+        if (!cachedIsDir(get_comp(L), path, &isDir)) isDir = hostPathIsDir(path, e);
+        lua_pushboolean(L, isDir);
     }
     return 1;
 }
@@ -268,16 +270,19 @@ static int fs_getSize(lua_State *L) {
     const path_t path = fixpath(get_comp(L), str, true);
     std::error_code e;
     if (path.empty()) err(L, 1, "No such file");
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) {
-        try {
-            const FileEntry &d = get_comp(L)->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin()));
-            if (d.isDir) err(L, 1, "Is a directory");
-            lua_pushinteger(L, d.data.size());
-        } catch (...) {err(L, 1, "No such file");}
-#ifdef STANDALONE_ROM
+    if (isVFSPath(*path.begin())) {
+        std::shared_ptr<const VFSIndex> index;
+        const VFSIndex::entry * d = findVFSEntry(get_comp(L), path, index);
+        if (d == NULL) err(L, 1, "No such file");
+        if (d->isDir) err(L, 1, "Is a directory");
+        lua_pushinteger(L, d->size);
     } else if (path == ":bios.lua") {
-        lua_pushinteger(L, standaloneBIOS.size());
-#endif
+        const char * data;
+        size_t size = 0;
+        getPackedBIOS(&data, &size);
+        lua_pushinteger(L, size);
+    } else if (const std::shared_ptr<const rom_node> node = findROMNode(path)) {
+        lua_pushinteger(L, node->size);
     } else if (fs::is_directory(path, e)) {
         lua_pushinteger(L, 0);
     } else {
@@ -286,16 +291,6 @@ static int fs_getSize(lua_State *L) {
     return 1;
 }
 
-static int calculateDirectorySize(const path_t& path) {
-    int size = 0;
-    std::error_code e;
-    for (const auto& dir : fs::directory_iterator(path, e)) {
-        if (dir.is_directory()) size += calculateDirectorySize(dir.path());
-        else size += dir.file_size(e);
-    }
-    return size;
-}
-
 static int fs_getFreeSpace(lua_State *L) {
     lastCFunction = __func__;
     std::string mountPath;
@@ -304,7 +299,7 @@ static int fs_getFreeSpace(lua_State *L) {
     if (path.empty()) err(L, 1, "No such path");
     if (fixpath_ro(get_comp(L), str)) lua_pushinteger(L, 0);
     else if (!config.standardsMode || mountPath != "hdd") lua_pushinteger(L, getSpace(path).free);
-    else lua_pushinteger(L, config.computerSpaceLimit - calculateDirectorySize(fixpath(get_comp(L), "", true)));
+    else lua_pushinteger(L, (lua_Integer)config.computerSpaceLimit - (lua_Integer)getDiskUsage(get_comp(L)));
     return 1;
 }
 
@@ -314,9 +309,10 @@ static int fs_makeDir(lua_State *L) {
     if (fixpath_ro(get_comp(L), str)) err(L, 1, "Access denied");
     const path_t path = fixpath_mkdir(get_comp(L), str);
     if (path.empty()) err(L, 1, "Could not create directory");
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) err(L, 1, "Permission denied");
+    if (isVFSPath(*path.begin())) err(L, 1, "Permission denied");
     std::error_code e;
     fs::create_directories(path, e);
+    invalidateHostDirectory(get_comp(L), path);
     if (e) {
         if (e.value() == ENOTDIR) e.assign(EEXIST, std::generic_category());
         err(L, 1, e.message().c_str());
@@ -335,8 +331,8 @@ static int fs_move(lua_State *L) {
     const path_t toPath = fixpath_mkdir(get_comp(L), str2);
     if (fromPath.empty()) luaL_error(L, "No such file");
     if (toPath.empty()) err(L, 2, "Invalid path");
-    if (std::regex_search((*fromPath.begin()).native(), pathregex("^\\d+:"))) err(L, 1, "Permission denied");
-    if (std::regex_search((*toPath.begin()).native(), pathregex("^\\d+:"))) err(L, 2, "Permission denied");
+    if (isVFSPath(*fromPath.begin())) err(L, 1, "Permission denied");
+    if (isVFSPath(*toPath.begin())) err(L, 2, "Permission denied");
     if (std::mismatch(toPath.begin(), toPath.end(), fromPath.begin(), fromPath.end()).second == fromPath.end()) 
         luaL_error(L, "Can't move a directory inside itself");
     if (isRoot) luaL_error(L, "Cannot move mount");
@@ -345,8 +341,14 @@ static int fs_move(lua_State *L) {
     e.clear();
     fs::create_directories(toPath.parent_path(), e);
     if (e) err(L, 2, e.message().c_str());
+    // Moves only change the usage if they cross into or out of the data directory
+    const bool fromTracked = isDiskUsageTracked(get_comp(L), fromPath), toTracked = isDiskUsageTracked(get_comp(L), toPath);
+    const uintmax_t size = fromTracked != toTracked ? pathSize(fromPath) : 0;
     fs::rename(fromPath, toPath, e);
+    invalidateHostDirectory(get_comp(L), fromPath);
+    invalidateHostDirectory(get_comp(L), toPath);
     if (e) err(L, 1, e.message().c_str());
+    if (fromTracked != toTracked) adjustDiskUsage(get_comp(L), toTracked ? (long long)size : -(long long)size);
     return 0;
 }
 
@@ -359,16 +361,20 @@ static int fs_copy(lua_State *L) {
     const path_t toPath = fixpath_mkdir(get_comp(L), str2);
     if (fromPath.empty()) err(L, 1, "No such file");
     if (toPath.empty()) err(L, 2, "Invalid path");
-    if (std::regex_search((*toPath.begin()).native(), pathregex("^\\d+:"))) err(L, 2, "Permission denied");
-    if (std::regex_search((*fromPath.begin()).native(), pathregex("^\\d+:"))) {
-        try {
-            const FileEntry &d = get_comp(L)->virtualMounts[(unsigned)std::stoul((*fromPath.begin()).c_str())]->path(fromPath.lexically_relative(*fromPath.begin()));
-            if (d.isDir) err(L, 1, "Is a directory");
-            std::ofstream tofp(toPath);
-            if (!tofp.is_open()) return err(L, 2, "Cannot write file");
-            tofp.write(d.data.c_str(), d.data.size());
-            tofp.close();
-        } catch (...) {err(L, 1, "No such file");}
+    if (isVFSPath(*toPath.begin())) err(L, 2, "Permission denied");
+    if (isVFSPath(*fromPath.begin())) {
+        std::shared_ptr<const VFSIndex> index;
+        const VFSIndex::entry * d = findVFSEntry(get_comp(L), fromPath, index);
+        if (d == NULL) err(L, 1, "No such file");
+        if (d->isDir) err(L, 1, "Is a directory");
+        const bool tracked = isDiskUsageTracked(get_comp(L), toPath);
+        const uintmax_t before = tracked ? pathSize(toPath) : 0;
+        std::ofstream tofp(toPath);
+        if (!tofp.is_open()) return err(L, 2, "Cannot write file");
+        tofp.write(index->data(*d), d->size);
+        tofp.close();
+        invalidateHostDirectory(get_comp(L), toPath);
+        if (tracked) adjustDiskUsage(get_comp(L), (long long)d->size - (long long)before);
     } else {
         /*if (isFSCaseSensitive == -1) {
             struct_stat st;
@@ -396,7 +402,12 @@ static int fs_copy(lua_State *L) {
         std::error_code e;
         fs::create_directories(toPath.parent_path(), e);
         if (e) err(L, 2, e.message().c_str());
+        const bool tracked = isDiskUsageTracked(get_comp(L), toPath);
+        const uintmax_t before = tracked ? pathSize(toPath) : 0;
         fs::copy(fromPath, toPath, fs::copy_options::recursive, e);
+        invalidateHostDirectory(get_comp(L), toPath);
+        // Count whatever was copied, even if the copy failed part way through
+        if (tracked) adjustDiskUsage(get_comp(L), (long long)pathSize(toPath) - (long long)before);
         if (e) err(L, 1, e.message().c_str());
     }
     return 0;
@@ -410,9 +421,14 @@ static int fs_delete(lua_State *L) {
     const path_t path = fixpath(get_comp(L), str, true, true, NULL, &isRoot);
     if (isRoot) luaL_error(L, "Cannot delete mount, use mounter.unmount instead");
     if (path.empty()) return 0;
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) err(L, 1, "Permission denied");
+    if (isVFSPath(*path.begin())) err(L, 1, "Permission denied");
     std::error_code e;
-    fs::remove_all(path, e);
+    if (isDiskUsageTracked(get_comp(L), path)) {
+        const uintmax_t before = pathSize(path);
+        fs::remove_all(path, e);
+        adjustDiskUsage(get_comp(L), (long long)pathSize(path) - (long long)before);
+    } else fs::remove_all(path, e);
+    invalidateHostDirectory(get_comp(L), path);
     if (e) err(L, 1, e.message().c_str());
     return 0;
 }
@@ -455,34 +471,52 @@ static int fs_open(lua_State *L) {
         }
     }
     int fpid;
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:")) || path == ":bios.lua") {
+    if (isVFSPath(*path.begin()) || path == ":bios.lua") {
         if (computer->files_open >= config.maximumFilesOpen) err(L, 1, "Too many files already open");
-        std::stringstream ** fp = (std::stringstream**)lua_newuserdata(L, sizeof(std::stringstream**));
+        std::iostream ** fp = (std::iostream**)lua_newuserdata(L, sizeof(std::iostream*));
         fpid = lua_gettop(L);
-#ifdef STANDALONE_ROM
-        if (path == ":bios.lua") {
-            *fp = new std::stringstream(standaloneBIOS);
+        // Reads are served straight from the shared contents; anything that writes gets its own copy
+        const bool copy = mode[0] != 'r' || strchr(mode, '+') != NULL;
+        const char * bios;
+        size_t biosSize;
+        if (path == ":bios.lua" && getPackedBIOS(&bios, &biosSize)) {
+            if (copy) *fp = new std::stringstream(std::string(bios, biosSize));
+            else *fp = new MemoryFileStream(nullptr, bios, biosSize);
         } else {
-#endif
-            try {
-                const FileEntry &d = computer->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin()));
-                if (d.isDir) {
-                    lua_remove(L, fpid);
-                    lua_pushnil(L);
-                    if (strchr(mode, 'r') != NULL) lua_pushfstring(L, "/%s: Not a file", fixpath(computer, str, false, false).string().c_str());
-                    else lua_pushfstring(L, "/%s: Cannot write to directory", fixpath(computer, str, false, false).string().c_str());
-                    return 2; 
-                }
-                *fp = new std::stringstream(d.data);
-            } catch (...) {
+            std::shared_ptr<const VFSIndex> index;
+            const VFSIndex::entry * d = findVFSEntry(computer, path, index);
+            if (d == NULL) {
                 lua_remove(L, fpid);
                 lua_pushnil(L);
                 lua_pushfstring(L, "/%s: No such file", fixpath(computer, str, false, false).string().c_str());
                 return 2;
             }
-#ifdef STANDALONE_ROM
+            if (d->isDir) {
+                lua_remove(L, fpid);
+                lua_pushnil(L);
+                if (strchr(mode, 'r') != NULL) lua_pushfstring(L, "/%s: Not a file", fixpath(computer, str, false, false).string().c_str());
+                else lua_pushfstring(L, "/%s: Cannot write to directory", fixpath(computer, str, false, false).string().c_str());
+                return 2; 
+            }
+            if (copy) *fp = new std::stringstream(std::string(index->data(*d), d->size));
+            else *fp = new MemoryFileStream(index, index->data(*d), d->size);
         }
-#endif
+    } else if (const std::shared_ptr<const rom_node> node = mode[0] == 'r' && mode[1] != '+' ? findROMNode(path) : nullptr) {
+        if (node->isDir) {
+            lua_pushnil(L);
+            lua_pushfstring(L, "/%s: Not a file", fixpath(computer, str, false, false).string().c_str());
+            return 2;
+        }
+        const std::shared_ptr<const std::string> data = getROMFileData(path, *node);
+        if (data == NULL) {
+            lua_pushnil(L);
+            lua_pushfstring(L, "/%s: No such file", fixpath(computer, str, false, false).string().c_str());
+            return 2;
+        }
+        if (computer->files_open >= config.maximumFilesOpen) err(L, 1, "Too many files already open");
+        std::iostream ** fp = (std::iostream**)lua_newuserdata(L, sizeof(std::iostream*));
+        fpid = lua_gettop(L);
+        *fp = new MemoryFileStream(data, data->data(), data->size());
     } else {
         std::error_code e;
         if (fs::is_directory(path, e)) { 
@@ -518,7 +552,12 @@ static int fs_open(lua_State *L) {
             flags |= std::ios::in | std::ios::out | std::ios::ate;
             if (strchr(mode, '+')) flags |= std::ios::in;
         }
+        // Remember how big the file was, so writes can be counted against the space limit
+        const bool tracked = (flags & std::ios::out) && isDiskUsageTracked(computer, path);
+        uintmax_t oldSize = 0;
+        if (tracked) oldSize = pathSize(path);
         *fp = new std::fstream(path, flags);
+        if (flags & std::ios::out) invalidateHostDirectory(computer, path);
         if (!(*fp)->is_open()) {
             bool ok = false;
             if (strchr(mode, 'a')) {
@@ -538,6 +577,11 @@ static int fs_open(lua_State *L) {
             delete *fp;
             err(L, 1, "Too many files already open");
         }
+        if (tracked) {
+            const uintmax_t size = (flags & std::ios::trunc) ? 0 : oldSize;
+            if (size != oldSize) adjustDiskUsage(computer, (long long)size - (long long)oldSize);
+            trackWriteHandle(computer, (std::iostream*)*fp, size);
+        }
     }
     lua_createtable(L, 0, 1);
     lua_pushvalue(L, fpid);
@@ -608,49 +652,6 @@ static int fs_open(lua_State *L) {
     return 1;
 }
 
-static std::string replace_str(std::string data, const std::string& toSearch, const std::string& replaceStr) {
-    size_t pos = data.find(toSearch);
-    while (pos != std::string::npos) {
-        data.replace(pos, toSearch.size(), replaceStr);
-        pos = data.find(toSearch, pos + replaceStr.size());
-    }
-    return data;
-}
-
-static std::string regex_escape[] = {"\\", ".", "[", "]", "{", "}", "^", "$", "(", ")", "+", "?", "|"};
-
-static std::list<std::string> matchWildcard(Computer * comp, const std::list<std::string>& options, std::list<std::string>::iterator pathc, const std::list<std::string>::iterator end) {
-    if (pathc == end) return {};
-    std::string pathc_regex = *pathc;
-    for (const std::string& r : regex_escape) pathc_regex = replace_str(pathc_regex, r, "\\" + r);
-    pathc_regex = replace_str(pathc_regex, "*", ".*");
-    std::list<std::string> nextOptions;
-    for (const std::string& opt : options) {
-        std::vector<path_t> possible_paths = fixpath_multiple(comp, opt.c_str());
-        if (possible_paths.empty()) continue;
-        for (const path_t& path : possible_paths) {
-            if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) {
-                try {
-                    const FileEntry &d = comp->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin()));
-                    if (d.isDir) for (auto p : d.dir) if (std::regex_match(p.first, std::regex(pathc_regex))) nextOptions.push_back(opt + (opt == "" ? "" : "/") + p.first);
-                } catch (...) {continue;}
-            } else {
-                std::error_code e;
-                if (fs::is_directory(path, e)) {
-                    for (const auto& dir : fs::directory_iterator(path, e)) {
-                        if (dir.path().filename() == ".DS_Store" || dir.path().filename() == "desktop.ini") continue;
-                        if (std::regex_match(dir.path().filename().u8string(), std::regex(pathc_regex))) nextOptions.push_back(opt + (opt.empty() ? "" : "/") + dir.path().filename().u8string());
-                    }
-                }
-            }
-        }
-        for (const std::string& value : getMounts(comp, opt.c_str())) 
-            if (*pathc == "*" || value == *pathc) nextOptions.push_back(opt + (opt.empty() ? "" : "/") + value);
-    }
-    if (++pathc == end) return nextOptions;
-    else return matchWildcard(comp, nextOptions, pathc, end);
-}
-
 // Deprecated as of 1.105.0, but remains here for safety.
 static int fs_find(lua_State *L) {
     lastCFunction = __func__;
@@ -672,8 +673,8 @@ static int fs_find(lua_State *L) {
         lua_rawseti(L, -2, 1);
         return 1;
     }
-    std::list<std::string> matches = matchWildcard(get_comp(L), {""}, pathc.begin(), pathc.end());
-    matches.sort();
+    std::vector<std::string> matches = expandGlob(get_comp(L), pathc);
+    std::sort(matches.begin(), matches.end());
     matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
     lua_createtable(L, matches.size(), 0);
     lua_Integer i = 0;
@@ -697,75 +698,149 @@ static int fs_getDir(lua_State *L) {
     return 1;
 }
 
-#if defined(__APPLE__) // macOS has ns-precise times in st_[x]timespec.tv_nsec
-#define st_time_ms(st) ((st##timespec.tv_nsec / 1000000) + (st##timespec.tv_sec * 1000))
-#elif defined(__linux__) // Linux has ns-precise times in st_[x]tim.tv_nsec
-#define st_time_ms(st) ((st##tim.tv_nsec / 1000000) + (st##time * 1000))
-#else // Other systems have only the standard s-precise times
-#define st_time_ms(st) (st##time * 1000)
+// The fields of the table returned by fs.attributes
+struct file_attributes {
+    long long modified = 0; // ms since the epoch
+    long long created = 0;
+    uintmax_t size = 0;
+    bool isDir = false;
+    bool isReadOnly = true;
+};
+
+static void pushAttributes(lua_State *L, const file_attributes& attr) {
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, attr.modified);
+    lua_setfield(L, -2, "modification");
+    lua_pushinteger(L, attr.modified);
+    lua_setfield(L, -2, "modified");
+    lua_pushinteger(L, attr.created);
+    lua_setfield(L, -2, "created");
+    lua_pushinteger(L, attr.size);
+    lua_setfield(L, -2, "size");
+    lua_pushboolean(L, attr.isDir);
+    lua_setfield(L, -2, "isDir");
+    lua_pushboolean(L, attr.isReadOnly);
+    lua_setfield(L, -2, "isReadOnly");
+}
+
+static void nodeAttributes(const rom_node& node, file_attributes& attr) {
+    // The cache is only used while the ROM is read-only
+    attr.modified = node.modified;
+    attr.created = node.created;
+    attr.size = node.size;
+    attr.isDir = node.isDir;
+    attr.isReadOnly = true;
+}
+
+// Reads the attributes of a file on the host; returns false if it doesn't exist
+static bool hostAttributes(const path_t& path, bool mountReadOnly, file_attributes& attr) {
+#ifdef _WIN32
+    struct _stat st;
+    if (_wstat(path.c_str(), &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
 #endif
+    attr.modified = st_time_ms(st.st_m);
+    attr.created = st_time_ms(st.st_c);
+    attr.isDir = S_ISDIR(st.st_mode);
+    attr.size = attr.isDir ? 0 : st.st_size;
+    if (mountReadOnly) attr.isReadOnly = true;
+#ifdef WIN32
+    else if (attr.isDir) attr.isReadOnly = winFolderIsReadOnly(path);
+#endif
+    else attr.isReadOnly = access(path.native().c_str(), W_OK) != 0;
+    return true;
+}
+
+// Gets the attributes of a path, as resolved by fixpath; returns false if it doesn't exist
+static bool getAttributes(Computer * comp, const std::string& str, const path_t& path, file_attributes& attr) {
+    if (isVFSPath(*path.begin())) {
+        std::shared_ptr<const VFSIndex> index;
+        const VFSIndex::entry * d = findVFSEntry(comp, path, index);
+        if (d == NULL) return false;
+        attr.size = d->size;
+        attr.isDir = d->isDir;
+        attr.isReadOnly = true;
+        return true;
+    } else if (const std::shared_ptr<const rom_node> node = findROMNode(path)) {
+        nodeAttributes(*node, attr);
+        return true;
+    } else return hostAttributes(path, fixpath_ro(comp, str), attr);
+}
 
 static int fs_attributes(lua_State *L) {
     lastCFunction = __func__;
     std::string str = checkstring(L, 1);
     const path_t path = fixpath(get_comp(L), str, true);
     if (path.empty()) err(L, 1, "No such file");
-    if (std::regex_search((*path.begin()).native(), pathregex("^\\d+:"))) {
-        try {
-            const FileEntry &d = get_comp(L)->virtualMounts[(unsigned)std::stoul((*path.begin()).native())]->path(path.lexically_relative(*path.begin()));
-            lua_createtable(L, 0, 6);
-            lua_pushinteger(L, 0);
-            lua_setfield(L, -2, "modification");
-            lua_pushinteger(L, 0);
-            lua_setfield(L, -2, "modified");
-            lua_pushinteger(L, 0);
-            lua_setfield(L, -2, "created");
-            lua_pushinteger(L, d.isDir ? 0 : d.data.length());
-            lua_setfield(L, -2, "size");
-            lua_pushboolean(L, d.isDir);
-            lua_setfield(L, -2, "isDir");
-            lua_pushboolean(L, true);
-            lua_setfield(L, -2, "isReadOnly");
-        } catch (...) {
-            lua_pushnil(L);
-            return 1;
-        }
-    } else {
-#ifdef _WIN32
-        struct _stat st;
-        if (_wstat(path.c_str(), &st) != 0) {
-            lua_pushnil(L);
-            return 1;
-        }
-#else
-        struct stat st;
-        if (stat(path.c_str(), &st) != 0) {
-            lua_pushnil(L);
-            return 1;
-        }
-#endif
-        lua_createtable(L, 0, 6);
-        lua_pushinteger(L, st_time_ms(st.st_m));
-        lua_setfield(L, -2, "modification");
-        lua_pushinteger(L, st_time_ms(st.st_m));
-        lua_setfield(L, -2, "modified");
-        lua_pushinteger(L, st_time_ms(st.st_c));
-        lua_setfield(L, -2, "created");
-        lua_pushinteger(L, S_ISDIR(st.st_mode) ? 0 : st.st_size);
-        lua_setfield(L, -2, "size");
-        lua_pushboolean(L, S_ISDIR(st.st_mode));
-        lua_setfield(L, -2, "isDir");
-        if (fixpath_ro(get_comp(L), str)) lua_pushboolean(L, true);
-        else {
+    file_attributes attr;
+    if (getAttributes(get_comp(L), str, path, attr)) pushAttributes(L, attr);
+    else lua_pushnil(L);
+    return 1;
+}
+
+// Lists a directory along with the attributes of everything in it, in the same order as fs.list
+static int fs_listAttributes(lua_State *L) {
+    lastCFunction = __func__;
+    Computer * comp = get_comp(L);
+    std::string str = checkstring(L, 1);
+    const std::vector<path_t> possible_paths = fixpath_multiple(comp, str);
+    if (possible_paths.empty()) err(L, 1, "No such file");
+    bool gotdir = false;
+    // Like fixpath, the first mount that has a name is the one that counts
+    std::map<std::string, file_attributes> entries;
+    for (const path_t& path : possible_paths) {
+        if (isVFSPath(*path.begin())) {
+            std::shared_ptr<const VFSIndex> index;
+            const VFSIndex::entry * d = findVFSEntry(comp, path, index);
+            if (d == NULL || !d->isDir) continue;
+            gotdir = true;
+            for (const std::string& name : d->children) {
+                if (entries.find(name) != entries.end()) continue;
+                const VFSIndex::entry * c = index->find(path / name);
+                if (c == NULL) continue;
+                file_attributes& attr = entries[name];
+                attr.size = c->size;
+                attr.isDir = c->isDir;
+            }
+        } else if (const std::shared_ptr<const rom_node> node = findROMNode(path)) {
+            if (!node->isDir) continue;
+            gotdir = true;
+            for (const auto& c : node->children)
+                if (c.first != ".DS_Store" && c.first != "desktop.ini" && entries.find(c.first) == entries.end())
+                    nodeAttributes(c.second, entries[c.first]);
+        } else {
             std::error_code e;
-            if (!fs::exists(path, e)) lua_pushboolean(L, false);
-#ifdef WIN32
-            else if (e.clear(), fs::is_directory(path, e))
-                lua_pushboolean(L, winFolderIsReadOnly(path));
-#endif
-            else lua_pushboolean(L, access(path.c_str(), W_OK) != 0);
+            fs::directory_iterator it(path, e);
+            if (e) continue;
+            gotdir = true;
+            const bool readOnly = fixpath_ro(comp, str);
+            for (; it != fs::directory_iterator(); it.increment(e)) {
+                if (e) break;
+                if (it->path().filename() == ".DS_Store" || it->path().filename() == "desktop.ini") continue;
+                const std::string name = it->path().filename().u8string();
+                if (entries.find(name) != entries.end()) continue;
+                file_attributes attr;
+                if (hostAttributes(it->path(), readOnly, attr)) entries[name] = attr;
+            }
         }
-        lua_setfield(L, -2, "isReadOnly");
+    }
+    if (!gotdir) err(L, 1, "Not a directory");
+    // Mounts replace whatever is at their path
+    const std::string dir = str.empty() || str.back() == '/' || str.back() == '\\' ? str : str + "/";
+    for (const std::string& name : getMounts(comp, str)) {
+        const path_t path = fixpath(comp, dir + name, true);
+        file_attributes attr;
+        if (!path.empty() && getAttributes(comp, dir + name, path, attr)) entries[name] = attr;
+    }
+    lua_createtable(L, entries.size(), 0);
+    int i = 1;
+    for (const auto& e : entries) {
+        pushAttributes(L, e.second);
+        lua_pushstring(L, e.first.c_str());
+        lua_setfield(L, -2, "name");
+        lua_rawseti(L, -2, i++);
     }
     return 1;
 }
@@ -787,6 +862,26 @@ static int fs_getCapacity(lua_State *L) {
     return 1;
 }
 
+static int fs_watch(lua_State *L) {
+    lastCFunction = __func__;
+    Computer * comp = get_comp(L);
+    const std::string str = normalizePath(checkstring(L, 1));
+    const path_t path = fixpath(comp, str, true);
+    if (path.empty()) err(L, 1, "No such file");
+    // Virtual mounts and the ROM never change underneath the computer
+    bool inROM = false;
+    if (isVFSPath(*path.begin()) || findROMNode(path, &inROM) || inROM) err(L, 1, "Not a host path");
+    const size_t limit = std::max(config.maximumFileWatches, 0);
+    if (!addFileWatch(comp, str, path, limit)) err(L, 1, fileWatchCount(comp) >= limit ? "Too many paths already watched" : "Cannot watch path");
+    return 0;
+}
+
+static int fs_unwatch(lua_State *L) {
+    lastCFunction = __func__;
+    lua_pushboolean(L, removeFileWatch(get_comp(L), normalizePath(checkstring(L, 1))));
+    return 1;
+}
+
 static luaL_Reg fs_reg[] = {
     {"list", fs_list},
     {"exists", fs_exists},
@@ -805,8 +900,15 @@ static luaL_Reg fs_reg[] = {
     {"find", fs_find},
     {"getDir", fs_getDir},
     {"attributes", fs_attributes},
+    {"listAttributes", fs_listAttributes},
     {"getCapacity", fs_getCapacity},
+    {"watch", fs_watch},
+    {"unwatch", fs_unwatch},
     {NULL, NULL}
 };
 
-library_t fs_lib = {"fs", fs_reg, nullptr, nullptr};
+static void fs_deinit(Computer *comp) {
+    freeFileWatches(comp);
+}
+
+library_t fs_lib = {"fs", fs_reg, nullptr, fs_deinit};
@@ -8,6 +8,7 @@
  * Copyright (c) 2019-2024 JackMacWindows.
  */
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -16,12 +17,15 @@
 #include <sstream>
 #include <string>
 #include "fs_handle.hpp"
+#include "../../diskusage.hpp"
 #include "../../util.hpp"
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #include "../../runtime.hpp"
 #endif
 
+#define READ_CHUNK_SIZE 65536 // largest piece read from a stream at once when the total size isn't known
+
 #ifdef __EMSCRIPTEN__
 EM_JS(void, emsyncfs, (), {
     if (window.fsIsSyncing) return;
@@ -38,6 +42,7 @@ int fs_handle_close(lua_State *L) {
     std::iostream ** fp = (std::iostream**)lua_touserdata(L, lua_upvalueindex(1));
     if (*fp == NULL)
         return luaL_error(L, "attempt to use a closed file");
+    if (trackedWriteHandles) untrackWriteHandle(*fp);
     if (dynamic_cast<std::fstream*>(*fp) != NULL) delete (std::fstream*)*fp;
     else if (dynamic_cast<std::stringstream*>(*fp) != NULL) delete (std::stringstream*)*fp;
     else delete *fp;
@@ -54,6 +59,7 @@ int fs_handle_gc(lua_State *L) {
     std::iostream ** fp = (std::iostream**)lua_touserdata(L, lua_upvalueindex(1));
     if (*fp == NULL)
         return 0;
+    if (trackedWriteHandles) untrackWriteHandle(*fp);
     if (dynamic_cast<std::fstream*>(*fp) != NULL) delete (std::fstream*)*fp;
     else if (dynamic_cast<std::stringstream*>(*fp) != NULL) delete (std::stringstream*)*fp;
     else delete *fp;
@@ -65,6 +71,77 @@ int fs_handle_gc(lua_State *L) {
     return 0;
 }
 
+// Replaces CRLF with LF in place, and returns the new length
+static size_t normalizeNewlines(char * str, size_t len) {
+    char * const end = str + len;
+    char * in = (char*)memchr(str, '\r', len);
+    if (in == NULL) return len;
+    char * out = in;
+    while (in < end) {
+        // in always points at a CR here
+        if (in + 1 < end && in[1] == '\n') in++;
+        *out++ = *in++;
+        char * next = (char*)memchr(in, '\r', end - in);
+        if (next == NULL) next = end;
+        memmove(out, in, next - in);
+        out += next - in;
+        in = next;
+    }
+    return out - str;
+}
+
+// Returns how many bytes are left in a stream, or -1 if it can't seek
+static long long remainingSize(std::iostream * fp) {
+    std::streambuf * buf = fp->rdbuf();
+    const std::streampos pos = buf->pubseekoff(0, std::ios::cur, std::ios::in);
+    if (pos == std::streampos(-1)) return -1;
+    const std::streampos end = buf->pubseekoff(0, std::ios::end, std::ios::in);
+    buf->pubseekpos(pos, std::ios::in);
+    if (end == std::streampos(-1)) return -1;
+    return end > pos ? (long long)(end - pos) : 0;
+}
+
+/*
+ * Reads up to size bytes from the stream's buffer straight into a Lua buffer,
+ * without going through the per-character stream functions. reserve is how
+ * much space to set aside up front, so large reads of a known size don't get
+ * copied while the buffer grows. Sets the EOF flag if the stream ran out, and
+ * returns the number of bytes added to the buffer.
+ */
+static size_t bufferedRead(std::iostream * fp, luaL_Buffer * b, size_t size, size_t reserve, bool text) {
+    std::streambuf * buf = fp->rdbuf();
+    if (reserve > size) reserve = size;
+    if (reserve > 0) luaL_prepbuffsize(b, reserve + 1);
+    size_t total = 0, read = 0;
+    bool pendingCR = false; // a CR at the end of the last chunk, which might be the start of a CRLF
+    while (read < size) {
+        const size_t chunk = std::min(size - read, std::max(reserve > read ? reserve - read : 0, (size_t)READ_CHUNK_SIZE));
+        char * dst = luaL_prepbuffsize(b, chunk + 1);
+        size_t n = 0;
+        if (pendingCR) dst[n++] = '\r';
+        const size_t got = buf->sgetn(dst + n, chunk);
+        read += got;
+        n += got;
+        const bool eof = got < chunk;
+        if (text) {
+            n = normalizeNewlines(dst, n);
+            pendingCR = !eof && n > 0 && dst[n-1] == '\r';
+            if (pendingCR) n--;
+        }
+        luaL_addsize(b, n);
+        total += n;
+        if (eof) {
+            fp->setstate(std::ios::eofbit);
+            break;
+        }
+    }
+    if (pendingCR) {
+        luaL_addchar(b, '\r');
+        total++;
+    }
+    return total;
+}
+
 int fs_handle_readAll(lua_State *L) {
     lastCFunction = __func__;
     std::iostream * fp = *(std::iostream**)lua_touserdata(L, lua_upvalueindex(1));
@@ -75,23 +152,12 @@ int fs_handle_readAll(lua_State *L) {
         return 1;
     }
     if (fp->bad() || fp->fail()) return 0;
-    const long pos = (long)fp->tellg();
-    fp->seekg(0, std::ios::end);
-    if (fp->bad() || fp->fail()) return 0;
-    long size = (long)fp->tellg() - pos;
-    char * retval = new char[size + 1];
-    memset(retval, 0, size + 1);
-    fp->seekg(pos);
-    int i;
-    for (i = 0; !fp->eof() && i < size; i++) {
-        int c = fp->get();
-        if (c == EOF && fp->eof()) { size = i; break; }
-        if (c == '\n' && (i > 0 && retval[i-1] == '\r')) retval[--i] = '\n';
-        else retval[i] = (char)c;
-    }
-    const std::string out = makeASCIISafe(retval, i - (i == size ? 0 : 1));
-    delete[] retval;
-    lua_pushlstring(L, out.c_str(), out.length());
+    const long long size = remainingSize(fp);
+    if (size < 0) return 0;
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    bufferedRead(fp, &b, size, size, true);
+    luaL_pushresult(&b);
     return 1;
 }
 
@@ -124,12 +190,10 @@ int fs_handle_readChar(lua_State *L) {
             lua_pushstring(L, "");
             return 1;
         }
-        char* retval = new char[s];
-        fp->read(retval, s);
-        const size_t actual = fp->gcount();
-        if (actual == 0) {delete[] retval; return 0;}
-        lua_pushlstring(L, retval, actual);
-        delete[] retval;
+        luaL_Buffer b;
+        luaL_buffinit(L, &b);
+        if (bufferedRead(fp, &b, s, READ_CHUNK_SIZE, false) == 0) return 0;
+        luaL_pushresult(&b);
     } else {
         const int retval = fp->get();
         if (retval == EOF || fp->eof()) return 0;
@@ -152,12 +216,10 @@ int fs_handle_readByte(lua_State *L) {
             lua_pushstring(L, "");
             return 1;
         }
-        char* retval = new char[s];
-        fp->read(retval, s);
-        const size_t actual = fp->gcount();
-        if (actual == 0) {delete[] retval; return 0;}
-        lua_pushlstring(L, retval, actual);
-        delete[] retval;
+        luaL_Buffer b;
+        luaL_buffinit(L, &b);
+        if (bufferedRead(fp, &b, s, READ_CHUNK_SIZE, false) == 0) return 0;
+        luaL_pushresult(&b);
     } else {
         const int retval = fp->get();
         if (retval == EOF || fp->eof()) return 0;
@@ -175,17 +237,13 @@ int fs_handle_readAllByte(lua_State *L) {
         return 1;
     }
     if (fp->bad() || fp->fail()) return luaL_error(L, "Could not read file");
-    std::streampos pos = fp->tellg();
-    fp->seekg(0, std::ios_base::end);
-    size_t size = fp->tellg() - pos;
-    fp->seekg(pos, std::ios_base::beg);
-    char * str = (char*)malloc(size);
-    if (str == NULL) return luaL_error(L, "failed to allocate memory");
-    fp->read(str, size);
-    size = fp->gcount();
+    const long long size = remainingSize(fp);
+    if (size < 0) return luaL_error(L, "Could not read file");
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    bufferedRead(fp, &b, size, size, false);
     fp->setstate(std::ios::eofbit); // set EOF flag
-    lua_pushlstring(L, str, size);
-    free(str);
+    luaL_pushresult(&b);
     return 1;
 }
 
@@ -203,6 +261,7 @@ int fs_handle_writeString(lua_State *L) {
     size_t sz = 0;
     const char * str = lua_tolstring(L, 1, &sz);
     fp->write(str, sz);
+    if (trackedWriteHandles) updateWriteHandle(fp, (long long)fp->tellp());
     return 0;
 }
 
@@ -221,6 +280,7 @@ int fs_handle_writeLine(lua_State *L) {
     const char * str = lua_tolstring(L, 1, &sz);
     fp->write(str, sz);
     fp->put('\n');
+    if (trackedWriteHandles) updateWriteHandle(fp, (long long)fp->tellp());
     return 0;
 }
 
@@ -242,6 +302,7 @@ int fs_handle_writeByte(lua_State *L) {
         if (sz == 0) return 0;
         fp->write(str, sz);
     } else return luaL_error(L, "bad argument #1 (number or string expected, got %s)", lua_typename(L, lua_type(L, 1)));
+    if (trackedWriteHandles) updateWriteHandle(fp, (long long)fp->tellp());
     return 0;
 }
 
@@ -282,3 +343,25 @@ int fs_handle_seek(lua_State *L) {
     lua_pushinteger(L, fp->tellg());
     return 1;
 }
+
+MemoryFileStream::buffer::buffer(const std::shared_ptr<const void>& o, const char * data, size_t size): owner(o) {
+    // The get area is never written to, since the stream has no put area and putback fails on mismatched characters
+    char * base = const_cast<char*>(data);
+    setg(base, base, base + size);
+}
+
+std::streambuf::pos_type MemoryFileStream::buffer::seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode) {
+    const off_type size = egptr() - eback();
+    off_type pos;
+    if (dir == std::ios::beg) pos = off;
+    else if (dir == std::ios::cur) pos = (gptr() - eback()) + overshoot + off;
+    else pos = size + off;
+    if (pos < 0) return pos_type(off_type(-1));
+    overshoot = pos > size ? pos - size : 0;
+    setg(eback(), eback() + pos - overshoot, egptr());
+    return pos_type(pos);
+}
+
+std::streambuf::pos_type MemoryFileStream::buffer::seekpos(pos_type pos, std::ios::openmode which) {
+    return seekoff(off_type(pos), std::ios::beg, which);
+}
@@ -13,6 +13,9 @@
 extern "C" {
 #include <lua.h>
 }
+#include <istream>
+#include <memory>
+#include <streambuf>
 extern int fs_handle_close(lua_State *L);
 extern int fs_handle_gc(lua_State *L);
 extern int fs_handle_readAll(lua_State *L);
@@ -25,4 +28,19 @@ extern int fs_handle_writeLine(lua_State *L);
 extern int fs_handle_writeByte(lua_State *L);
 extern int fs_handle_flush(lua_State *L);
 extern int fs_handle_seek(lua_State *L);
+
+// Read-only stream over memory that's kept alive by owner, for opening files without copying them
+class MemoryFileStream : public std::iostream {
+    class buffer : public std::streambuf {
+        std::shared_ptr<const void> owner;
+        off_type overshoot = 0; // how far past the end the position was set, since files can be seeked past their end
+    public:
+        buffer(const std::shared_ptr<const void>& owner, const char * data, size_t size);
+    protected:
+        pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override;
+        pos_type seekpos(pos_type pos, std::ios::openmode which) override;
+    } buf;
+public:
+    MemoryFileStream(const std::shared_ptr<const void>& owner, const char * data, size_t size): std::iostream(NULL), buf(owner, data, size) {rdbuf(&buf);}
+};
 #endif
\ No newline at end of file
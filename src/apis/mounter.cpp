@@ -14,6 +14,7 @@
 #include <FileEntry.hpp>
 #include "../peripheral/debugger.hpp"
 #include "../platform.hpp"
+#include "../romcache.hpp"
 #include "../runtime.hpp"
 #include "../terminal/SDLTerminal.hpp"
 #ifdef WIN32
@@ -63,6 +64,7 @@ static int mounter_unmount(lua_State *L) {
             if (it == computer->mounts.end()) break;
         }
     }
+    if (found) invalidateMountCache(computer);
     if (found && computer->debugger && !computer->isDebugger) ((debugger*)computer->debugger)->resetMounts();
     lua_pushboolean(L, found);
     return 1;
@@ -82,7 +84,7 @@ static int mounter_list(lua_State *L) {
             lua_createtable(L, 1, 0); // table, entries
         }
         lua_pushinteger(L, lua_rawlen(L, -1) + 1); // table, entries, index
-        if (std::regex_match(std::get<1>(m), std::basic_regex<path_t::value_type>(path_t("\\d+:").native()))) lua_pushfstring(L, "(virtual mount:%s)", std::get<1>(m).substr(0, std::get<1>(m).size()-1).c_str());
+        if (FileEntry::isMountIndex(std::get<1>(m))) lua_pushfstring(L, "(virtual mount:%s)", std::get<1>(m).substr(0, std::get<1>(m).size()-1).c_str());
         else lua_pushstring(L, path_t(std::get<1>(m)).string().c_str()); // table, entries, index, value
         lua_settable(L, -3); // table, entries
         lua_pushstring(L, ss.str().c_str()); // table, entries, key
@@ -115,11 +117,18 @@ static int mounter_isReadOnly(lua_State *L) {
     return 0; // redundant
 }
 
+static int mounter_reloadROM(lua_State *L) {
+    lastCFunction = __func__;
+    reloadROMCache();
+    return 0;
+}
+
 static luaL_Reg mounter_reg[] = {
     {"mount", mounter_mount},
     {"unmount", mounter_unmount},
     {"list", mounter_list},
     {"isReadOnly", mounter_isReadOnly},
+    {"reloadROM", mounter_reloadROM},
     {NULL, NULL}
 };
 
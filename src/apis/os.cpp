@@ -9,8 +9,10 @@
  */
 
 #include <Computer.hpp>
+#include "../eventqueue.hpp"
 #include "../main.hpp"
 #include "../runtime.hpp"
+#include "../timerwheel.hpp"
 #include "../util.hpp"
 
 static int os_getComputerID(lua_State *L) { lastCFunction = __func__; lua_pushinteger(L, get_comp(L)->id); return 1; }
@@ -35,15 +37,8 @@ static int os_queueEvent(lua_State *L) {
     lastCFunction = __func__;
     Computer * computer = get_comp(L);
     const std::string name = checkstring(L, 1);
-    if (!lua_checkstack(computer->paramQueue, 1)) luaL_error(L, "Could not allocate space for event");
-    lua_State *param = lua_newthread(computer->paramQueue);
     lua_remove(L, 1);
-    const int count = lua_gettop(L);
-    lua_checkstack(param, count);
-    if (config.standardsMode) xcopy(L, param, count);
-    else lua_xmove(L, param, count);
-    computer->eventQueue.push(name);
-    computer->event_lock.notify_all();
+    if (!computer->event_queue_ctx->pushEvent(name, L, lua_gettop(L), config.standardsMode)) luaL_error(L, "Could not allocate space for event");
     return 0;
 }
 
@@ -54,128 +49,57 @@ static int os_clock(lua_State *L) {
     return 1;
 }
 
-struct timer_data_t {
-    Computer * comp;
-    SDL_TimerID timer;
-    std::mutex * lock;
-    bool isAlarm;
-};
-
-template<typename T>
-class PointerProtector {
-    T* ptr;
-public:
-    PointerProtector(T* p) : ptr(p) {}
-    ~PointerProtector() { delete ptr; }
-};
-
-static ProtectedObject<std::unordered_map<SDL_TimerID, struct timer_data_t*> > runningTimerData;
-
+// Timer events carry the timer ID with the low bit set for alarms
 static std::string timer_event(lua_State *L, void* param) {
-    struct timer_data_t * data = (timer_data_t*)param;
-    bool found = false;
-    LockGuard lock(runningTimerData);
-    for (const auto& i : *runningTimerData) if (i.second == param) { found = true; break; }
-    if (!found) return "";
-    data->lock->lock();
-    lua_pushinteger(L, data->timer);
-    runningTimerData->erase(data->timer);
-    data->lock->unlock();
-    const bool isAlarm = data->isAlarm;
-    delete data->lock;
-    delete data;
-    return isAlarm ? "alarm" : "timer";
-}
-
-static Uint32 notifyEvent(Uint32 interval, void* param) {
-    struct timer_data_t * data = (timer_data_t*)param;
-    bool found = false;
-    LockGuard lock2(runningTimerData);
-    for (const auto& i : *runningTimerData) if (i.second == param) { found = true; break; }
-    if (!found) return 0;
-    data->lock->lock();
-    if (exiting || data->comp == NULL) {
-        runningTimerData->erase(data->timer);
-        data->lock->unlock();
-        delete data->lock;
-        delete data;
-        return 0;
-    }
-    {
-        LockGuard lock(freedTimers);
-        if (freedTimers->find(data->timer) != freedTimers->end()) {
-            freedTimers->erase(data->timer);
-            runningTimerData->erase(data->timer);
-            data->lock->unlock();
-            delete data->lock;
-            delete data;
-            return 0;
-        }
-    }
+    Computer * comp = get_comp(L);
+    const SDL_TimerID id = (SDL_TimerID)((ptrdiff_t)param >> 1);
     {
-        std::lock_guard<std::mutex> lock(data->comp->timerIDsMutex);
-        if (data->comp->timerIDs.find(data->timer) != data->comp->timerIDs.end()) data->comp->timerIDs.erase(data->timer);
+        // Drop events for timers that were cancelled after they were queued
+        std::lock_guard<std::mutex> lock(comp->timerIDsMutex);
+        if (comp->timerIDs.find(id) == comp->timerIDs.end()) return "";
+        comp->timerIDs.erase(id);
     }
-    queueEvent(data->comp, timer_event, data);
-    data->comp->event_lock.notify_all();
-    data->lock->unlock();
+    lua_pushinteger(L, id);
+    return ((ptrdiff_t)param & 1) ? "alarm" : "timer";
+}
+
+static Uint32 notifyEvent(Uint32 interval, SDL_TimerID id, void* owner, void* param) {
+    if (!exiting) queueEvent((Computer*)owner, timer_event, (void*)(((ptrdiff_t)id << 1) | (ptrdiff_t)param));
     return 0;
 }
 
+static lua_Integer startTimer(Computer * computer, Uint32 time, bool isAlarm) {
+    std::lock_guard<std::mutex> lock(computer->timerIDsMutex);
+    const SDL_TimerID id = addTimer(computer, time, notifyEvent, (void*)(ptrdiff_t)isAlarm);
+    computer->timerIDs.insert(id);
+    return id;
+}
+
+static void stopTimer(Computer * computer, SDL_TimerID id) {
+    std::lock_guard<std::mutex> lock(computer->timerIDsMutex);
+    if (computer->timerIDs.erase(id)) cancelTimer(computer, id);
+}
+
 // imported by http.cpp:websocket_receive
 int os_startTimer(lua_State *L) {
     lastCFunction = __func__;
     Computer * computer = get_comp(L);
-    struct timer_data_t * data = new struct timer_data_t;
-    data->comp = computer;
-    data->lock = new std::mutex;
-    data->isAlarm = false;
     lua_Number _time = luaL_checknumber(L, 1);
     if (_time < 0.001) _time = 0.001;
-    queueTask([_time](void*a)->void* {
-        struct timer_data_t * data = (timer_data_t*)a;
-        Uint32 time = (Uint32)(_time * 1000);
-        if (time == 0) time = 1;
-        if (config.standardsMode) {
-            if (time < 50) time = 50;
-            else time = (Uint32)ceil(time / 50.0) * 50;
-        }
-        LockGuard lock(runningTimerData);
-        data->timer = SDL_AddTimer(time, notifyEvent, data);
-        if (data->timer) runningTimerData->insert(std::make_pair(data->timer, data));
-        return NULL;
-    }, data);
-    if (!data->timer) {
-        delete data->lock;
-        delete data;
-        return luaL_error(L, "Error occurred while creating timer: ", SDL_GetError());
+    Uint32 time = (Uint32)(_time * 1000);
+    if (time == 0) time = 1;
+    if (config.standardsMode) {
+        if (time < 50) time = 50;
+        else time = (Uint32)ceil(time / 50.0) * 50;
     }
-    lua_pushinteger(L, data->timer);
-    std::lock_guard<std::mutex> lock(computer->timerIDsMutex);
-    computer->timerIDs.insert(data->timer);
+    lua_pushinteger(L, startTimer(computer, time, false));
     return 1;
 }
 
 // imported by http.cpp:websocket_receive
 int os_cancelTimer(lua_State *L) {
     lastCFunction = __func__;
-    const SDL_TimerID id = (SDL_TimerID)luaL_checkinteger(L, 1);
-    timer_data_t * data;
-    {
-        LockGuard lock(runningTimerData);
-        if (runningTimerData->find(id) == runningTimerData->end()) return 0;
-        data = (*runningTimerData)[id];
-        runningTimerData->erase(id);
-    } {
-        std::lock_guard<std::mutex> lock(*data->lock);
-    #ifdef __EMSCRIPTEN__
-        queueTask([id](void*)->void* {SDL_RemoveTimer(id); return NULL; }, NULL);
-    #else
-        SDL_RemoveTimer(id);
-    #endif
-    }
-    delete data->lock;
-    delete data;
+    stopTimer(get_comp(L), (SDL_TimerID)luaL_checkinteger(L, 1));
     return 0;
 }
 
@@ -293,44 +217,14 @@ static int os_setAlarm(lua_State *L) {
     if (time >= current_time) delta_time = time - current_time;
     else delta_time = (time + 24.0) - current_time;
     Uint32 real_time = (Uint32)(delta_time * 50000.0);
-    struct timer_data_t * data = new struct timer_data_t;
-    data->comp = computer;
-    data->lock = new std::mutex;
-    data->isAlarm = true;
-    queueTask([real_time](void*a)->void* {
-        struct timer_data_t * data = (timer_data_t*)a;
-        Uint32 time = real_time;
-        if (config.standardsMode) time = (Uint32)ceil(time / 50.0) * 50;
-        LockGuard lock(runningTimerData);
-        data->timer = SDL_AddTimer(time + 3, notifyEvent, data);
-        runningTimerData->insert(std::make_pair(data->timer, data));
-        return NULL;
-    }, data);
-    lua_pushinteger(L, data->timer);
-    std::lock_guard<std::mutex> lock(computer->timerIDsMutex);
-    computer->timerIDs.insert(data->timer);
+    if (config.standardsMode) real_time = (Uint32)ceil(real_time / 50.0) * 50;
+    lua_pushinteger(L, startTimer(computer, real_time + 3, true));
     return 1;
 }
 
 static int os_cancelAlarm(lua_State *L) {
     lastCFunction = __func__;
-    const SDL_TimerID id = (SDL_TimerID)luaL_checkinteger(L, 1);
-    timer_data_t * data;
-    {
-        LockGuard lock(runningTimerData);
-        if (runningTimerData->find(id) == runningTimerData->end()) return 0;
-        data = (*runningTimerData)[id];
-        runningTimerData->erase(id);
-    } {
-        std::lock_guard<std::mutex> lock(*data->lock);
-    #ifdef __EMSCRIPTEN__
-        queueTask([id](void*)->void* {SDL_RemoveTimer(id); return NULL; }, NULL);
-    #else
-        SDL_RemoveTimer(id);
-    #endif
-    }
-    delete data->lock;
-    delete data;
+    stopTimer(get_comp(L), (SDL_TimerID)luaL_checkinteger(L, 1));
     return 0;
 }
 
@@ -347,6 +241,23 @@ static int os_reboot(lua_State *L) {
     return 0;
 }
 
+static int os_memoryInfo(lua_State *L) {
+    lastCFunction = __func__;
+    Computer * comp = get_comp(L);
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, comp->memoryUsage);
+    lua_setfield(L, -2, "used");
+    lua_pushinteger(L, comp->memoryPeak);
+    lua_setfield(L, -2, "peak");
+    lua_pushinteger(L, comp->allocationCount);
+    lua_setfield(L, -2, "allocations");
+    if (comp->memoryLimit) lua_pushinteger(L, comp->memoryLimit);
+    else if (config.computerMemoryLimit > 0) lua_pushinteger(L, config.computerMemoryLimit);
+    else lua_pushnil(L);
+    lua_setfield(L, -2, "limit");
+    return 1;
+}
+
 static int os_about(lua_State *L) {
     lastCFunction = __func__;
     lua_pushstring(L, "CraftOS-PC " CRAFTOSPC_VERSION "\n\nCraftOS-PC 2 is licensed under the MIT License.\nMIT License\n\
@@ -396,6 +307,7 @@ static luaL_Reg os_reg[] = {
     {"shutdown", os_shutdown},
     {"reboot", os_reboot},
     {"about", os_about},
+    {"memoryInfo", os_memoryInfo},
     {NULL, NULL}
 };
 
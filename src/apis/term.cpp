@@ -33,13 +33,15 @@ static int term_write(lua_State *L) {
 #endif
     std::lock_guard<std::mutex> locked_g(term->locked);
     if (term->blinkY < 0 || (term->blinkX >= 0 && (unsigned)term->blinkX >= term->width) || (unsigned)term->blinkY >= term->height) return 0;
+    const int startX = term->blinkX;
     for (size_t i = 0; i < str_sz && (term->blinkX < 0 || (unsigned)term->blinkX < term->width); i++, term->blinkX++) {
         if (term->blinkX >= 0) {
             term->screen[term->blinkY][term->blinkX] = str[i];
             term->colors[term->blinkY][term->blinkX] = computer->colors;
         }
     }
-    term->changed = true;
+    // One more cell than was written, so the cursor is redrawn at its new position too (the old one is startX)
+    term->markDirty(startX, term->blinkY, term->blinkX - startX + 1, 1);
     return 0;
 }
 
@@ -68,7 +70,7 @@ static int term_scroll(lua_State *L) {
         memmove(term->colors.data() - lines * (int)term->width, term->colors.data(), ((int)term->height + lines) * term->width);
         memset(term->colors.data(), computer->colors, -lines * term->width);
     }
-    term->changed = true;
+    term->markDirty(0, 0, term->width, term->height);
     return 0;
 }
 
@@ -88,9 +90,10 @@ static int term_setCursorPos(lua_State *L) {
     Computer * computer = get_comp(L);
     Terminal * term = computer->term;
     std::lock_guard<std::mutex> locked_g(term->locked);
+    term->markDirty(term->blinkX, term->blinkY);
     term->blinkX = (int)lua_tointeger(L, 1) - 1;
     term->blinkY = (int)lua_tointeger(L, 2) - 1;
-    term->changed = true;
+    term->markDirty(term->blinkX, term->blinkY);
     return 0;
 }
 
@@ -101,7 +104,7 @@ static int term_setCursorBlink(lua_State *L) {
         Terminal * term = get_comp(L)->term;
         std::lock_guard<std::mutex> lock(term->locked);
         term->canBlink = lua_toboolean(L, 1);
-        term->changed = true;
+        term->markDirty(term->blinkX, term->blinkY);
     } else can_blink_headless = lua_toboolean(L, 1);
     if (selectedRenderer == 4) printf("TB:%d;%s\n", get_comp(L)->term->id, lua_toboolean(L, 1) ? "true" : "false");
     return 0;
@@ -167,7 +170,7 @@ static int term_clear(lua_State *L) {
         memset(term->screen.data(), ' ', term->height * term->width);
         memset(term->colors.data(), computer->colors, term->height * term->width);
     }
-    term->changed = true;
+    term->markDirty(0, 0, term->width, term->height);
     return 0;
 }
 
@@ -185,7 +188,7 @@ static int term_clearLine(lua_State *L) {
     std::lock_guard<std::mutex> locked_g(term->locked);
     memset(term->screen.data() + (term->blinkY * term->width), ' ', term->width);
     memset(term->colors.data() + (term->blinkY * term->width), computer->colors, term->width);
-    term->changed = true;
+    term->markDirty(0, term->blinkY, term->width, 1);
     return 0;
 }
 
@@ -257,6 +260,7 @@ static int term_blit(lua_State *L) {
     if (str_sz != fg_sz || fg_sz != bg_sz) luaL_error(L, "Arguments must be the same length");
     std::lock_guard<std::mutex> locked_g(term->locked);
     if (term->blinkY < 0 || (term->blinkX >= 0 && (unsigned)term->blinkX >= term->width) || (unsigned)term->blinkY >= term->height) return 0;
+    const int startX = term->blinkX;
     for (unsigned i = 0; i < str_sz && (term->blinkX < 0 || (unsigned)term->blinkX < term->width); i++, term->blinkX++) {
         if (term->blinkX >= 0) {
             computer->colors = (unsigned char)(htoi(bg[i], 15) << 4) | htoi(fg[i], 0);
@@ -267,7 +271,7 @@ static int term_blit(lua_State *L) {
             term->colors[term->blinkY][term->blinkX] = computer->colors;
         }
     }
-    term->changed = true;
+    term->markDirty(startX, term->blinkY, term->blinkX - startX + 1, 1);
     return 0;
 }
 
@@ -319,7 +323,7 @@ static int term_setPaletteColor(lua_State *L) {
     }
     if (selectedRenderer == 4 && color < 16)
         printf("TM:%d;%d,%f,%f,%f\n", term->id, color, term->palette[color].r / 255.0, term->palette[color].g / 255.0, term->palette[color].b / 255.0);
-    term->changed = true;
+    term->markAllDirty();
     return 0;
 }
 
@@ -331,7 +335,7 @@ static int term_setGraphicsMode(lua_State *L) {
     if (lua_isnumber(L, 1) && (lua_tointeger(L, 1) < 0 || lua_tointeger(L, 1) > 2)) return luaL_error(L, "bad argument #1 (invalid mode %d)", lua_tointeger(L, 1));
     std::lock_guard<std::mutex> lock(computer->term->locked);
     computer->term->mode = lua_isboolean(L, 1) ? (lua_toboolean(L, 1) ? 1 : 0) : (int)lua_tointeger(L, 1);
-    computer->term->changed = true;
+    computer->term->markAllDirty();
     return 0;
 }
 
@@ -359,7 +363,7 @@ static int term_setPixel(lua_State *L) {
     if (x < 0 || y < 0 || (unsigned)x >= term->width * Terminal::fontWidth || (unsigned)y >= term->height * Terminal::fontHeight) return 0;
     if (color < 0 || color > (term->mode == 2 ? 255 : 15)) return luaL_error(L, "bad argument #3 (invalid color %d)", color);
     term->pixels[y][x] = (unsigned char)color;
-    term->changed = true;
+    term->markPixelsDirty(x, y);
     return 0;
 }
 
@@ -451,7 +455,7 @@ static int term_drawPixels(lua_State *L) {
             memset(&term->pixels[init_y + h][memset_x], index, memset_len);
         }
 
-        term->changed = true;
+        term->markPixelsDirty(memset_x, init_y, memset_len, cool_height);
         return 0;
     }
 
@@ -502,7 +506,7 @@ static int term_drawPixels(lua_State *L) {
         lua_pop(L, 1);
     }
 
-    term->changed = true;
+    term->markPixelsDirty(init_x, init_y, undefinedWidth ? pixelWidth - init_x : (int)min(width, (unsigned)pixelWidth), (int)cool_height);
     return 0;
 }
 
@@ -0,0 +1,106 @@
+/*
+ * chunkcache.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the compiled chunk caches. ROM files are loaded through
+ * `load` with a chunk name of "@/rom/...", so the first computer to load one
+ * compiles it and saves the bytecode along with the source. Later loads with
+ * the same name and identical source skip the parser and load the bytecode.
+ * Comparing the source keeps the cache correct if the ROM changes, or if a
+ * program passes its own code under a ROM name.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+extern "C" {
+#include <lauxlib.h>
+}
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "chunkcache.hpp"
+
+struct rom_chunk {
+    std::string source;
+    std::string bytecode;
+};
+
+static std::unordered_map<std::string, std::shared_ptr<const rom_chunk> > romChunks;
+static std::mutex romChunksMutex;
+static size_t romChunksSize = 0;
+
+static int chunkWriter(lua_State *L, const void* p, size_t sz, void* ud) {
+    ((std::string*)ud)->append((const char*)p, sz);
+    return 0;
+}
+
+bool dumpChunk(lua_State *L, std::string& out) {
+    out.clear();
+    return lua_dump(L, chunkWriter, &out) == 0;
+}
+
+int loadTrustedChunk(lua_State *L, const std::string& bytecode, const char * name) {
+    // Put back whatever the state had, which may not match the current config
+    const int flags = lua_getdisableflags(L);
+    lua_setdisableflags(L, 0);
+    const int status = luaL_loadbufferx(L, bytecode.data(), bytecode.size(), name, "b");
+    lua_setdisableflags(L, flags);
+    return status;
+}
+
+static int original_load_k(lua_State *L) {
+    return lua_gettop(L);
+}
+
+static int original_load(lua_State *L) {
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_callk(L, lua_gettop(L) - 1, LUA_MULTRET, 0, original_load_k);
+    return lua_gettop(L);
+}
+
+int cached_load(lua_State *L) {
+    if (lua_type(L, 1) != LUA_TSTRING || lua_type(L, 2) != LUA_TSTRING || !(lua_isnoneornil(L, 3) || lua_type(L, 3) == LUA_TSTRING)) return original_load(L);
+    size_t len;
+    const char * source = lua_tolstring(L, 1, &len);
+    const char * name = lua_tostring(L, 2);
+    const char * mode = luaL_optstring(L, 3, "bt");
+    if (strncmp(name, "@/rom/", 6) != 0 || strchr(mode, 't') == NULL || (len > 0 && source[0] == LUA_SIGNATURE[0])) return original_load(L);
+    std::shared_ptr<const rom_chunk> chunk;
+    {
+        std::lock_guard<std::mutex> lock(romChunksMutex);
+        const auto it = romChunks.find(name);
+        if (it != romChunks.end()) chunk = it->second;
+    }
+    if (chunk && (chunk->source.size() != len || memcmp(chunk->source.data(), source, len) != 0)) chunk = NULL;
+    if (chunk == NULL || loadTrustedChunk(L, chunk->bytecode, name) != 0) {
+        if (chunk != NULL) lua_pop(L, 1);
+        if (luaL_loadbufferx(L, source, len, name, "t") != 0) {
+            // Let the original function report the error in its usual way
+            lua_pop(L, 1);
+            return original_load(L);
+        }
+        rom_chunk * newchunk = new rom_chunk;
+        newchunk->source = std::string(source, len);
+        if (dumpChunk(L, newchunk->bytecode)) {
+            std::lock_guard<std::mutex> lock(romChunksMutex);
+            std::shared_ptr<const rom_chunk>& entry = romChunks[name];
+            if (entry) romChunksSize -= entry->source.size() + entry->bytecode.size();
+            if (romChunksSize + newchunk->source.size() + newchunk->bytecode.size() <= ROM_CHUNK_CACHE_LIMIT) {
+                romChunksSize += newchunk->source.size() + newchunk->bytecode.size();
+                entry = std::shared_ptr<const rom_chunk>(newchunk);
+            } else {
+                romChunks.erase(name);
+                delete newchunk;
+            }
+        } else delete newchunk;
+    }
+    if (lua_toboolean(L, lua_upvalueindex(2)) ? !lua_isnoneornil(L, 4) : !lua_isnone(L, 4)) {
+        lua_pushvalue(L, 4);  /* environment for loaded function */
+        if (!lua_setupvalue(L, -2, 1))  /* set it as 1st upvalue */
+            lua_pop(L, 1);  /* remove 'env' if not used by previous call */
+    }
+    return 1;
+}
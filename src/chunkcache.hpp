@@ -0,0 +1,31 @@
+/*
+ * chunkcache.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions for the compiled chunk caches, which let
+ * computers share the parsed form of the BIOS and ROM files.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef CHUNKCACHE_HPP
+#define CHUNKCACHE_HPP
+extern "C" {
+#include <lua.h>
+}
+#include <string>
+
+#define ROM_CHUNK_CACHE_LIMIT 33554432 // maximum bytes of source and bytecode kept in the ROM chunk cache
+
+// Dumps the function at the top of the stack into a string. Returns whether it succeeded.
+extern bool dumpChunk(lua_State *L, std::string& out);
+
+// Loads bytecode that was made by dumpChunk, even if the state disallows loading bytecode.
+extern int loadTrustedChunk(lua_State *L, const std::string& bytecode, const char * name);
+
+// Replacement for `load` that serves files in /rom from a cache shared by all computers.
+// Upvalue 1 is the original `load`, and upvalue 2 is whether a nil environment argument is ignored (like yieldable_load).
+extern int cached_load(lua_State *L);
+
+#endif
@@ -150,6 +150,11 @@ std::unordered_map<std::string, std::pair<int, int> > configSettings = {
     {"useWebP", {0, 0}},
     {"dropFilePath", {0, 0}},
     {"useDFPWM", {0, 0}},
+    {"rawCompressionLevel", {0, 1}},
+    {"schedulerThreads", {2, 1}},
+    {"computerMemoryLimit", {0, 1}},
+    {"slabAllocator", {1, 0}},
+    {"maximumFileWatches", {0, 1}},
 };
 
 const std::string hiddenOptions[] = {"customFontPath", "customFontScale", "customCharScale", "skipUpdate", "lastVersion", "pluginData", "http_proxy_server", "http_proxy_port", "cliControlKeyMode", "serverMode", "romReadOnly"};
@@ -232,7 +237,12 @@ void config_init() {
 #endif
         true,
         false,
-        false
+        false,
+        6,
+        0,
+        0,
+        true,
+        16
     };
     if (e) {
         configLoadError = true;
@@ -348,6 +358,11 @@ void config_init() {
         readConfigSetting(useWebP, Bool);
         readConfigSetting(dropFilePath, Bool);
         readConfigSetting(useDFPWM, Bool);
+        readConfigSetting(rawCompressionLevel, Int);
+        readConfigSetting(schedulerThreads, Int);
+        readConfigSetting(computerMemoryLimit, Int);
+        readConfigSetting(slabAllocator, Bool);
+        readConfigSetting(maximumFileWatches, Int);
         // for JIT: substr until the position of the first '-' in CRAFTOSPC_VERSION (todo: find a static way to determine this)
         if (onboardingMode == 0 && (!root.isMember("lastVersion") || root["lastVersion"].asString().substr(0, sizeof(CRAFTOSPC_VERSION) - 1) != CRAFTOSPC_VERSION)) { onboardingMode = 2; config_save(); }
 #ifndef __EMSCRIPTEN__
@@ -433,6 +448,11 @@ void config_save() {
     root["useWebP"] = config.useWebP;
     root["dropFilePath"] = config.dropFilePath;
     root["useDFPWM"] = config.useDFPWM;
+    root["rawCompressionLevel"] = config.rawCompressionLevel;
+    root["schedulerThreads"] = config.schedulerThreads;
+    root["computerMemoryLimit"] = config.computerMemoryLimit;
+    root["slabAllocator"] = config.slabAllocator;
+    root["maximumFileWatches"] = config.maximumFileWatches;
     root["lastVersion"] = CRAFTOSPC_VERSION;
     Value pluginRoot;
     for (const auto& e : config.pluginData) pluginRoot[e.first] = e.second;
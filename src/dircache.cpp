@@ -0,0 +1,127 @@
+/*
+ * dircache.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the per-computer cache of host directory listings.
+ * fs.find and shell completion list the same directories over and over, and
+ * fs.complete follows each fs.list with an fs.isDir for every entry. Each
+ * listing is kept along with a watch on the directory, and is thrown out as
+ * soon as the watch reports a change, or the computer changes something in
+ * it itself (the watcher thread may not have seen that yet).
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "dircache.hpp"
+#include "fswatch.hpp"
+
+struct dir_cache {
+    struct item {
+        path_t path;
+        std::shared_ptr<const dir_listing> listing;
+        std::shared_ptr<host_watch> watch;
+        unsigned generation; // value of watch->generation before the directory was read
+    };
+    std::list<item> lru; // most recently used first
+    std::unordered_map<path_t, std::list<item>::iterator> index;
+};
+
+static std::shared_ptr<dir_listing> readDirectory(const path_t& path) {
+    std::error_code e;
+    fs::directory_iterator it(path, e);
+    if (e) return NULL;
+    std::shared_ptr<dir_listing> listing = std::make_shared<dir_listing>();
+    for (; it != fs::directory_iterator(); it.increment(e)) {
+        if (e) break;
+        if (it->path().filename() == ".DS_Store" || it->path().filename() == "desktop.ini") continue;
+        std::error_code e2;
+        listing->push_back({it->path().filename().u8string(), it->is_directory(e2)});
+    }
+    std::sort(listing->begin(), listing->end(), [](const dir_entry& a, const dir_entry& b)->bool {return a.name < b.name;});
+    return listing;
+}
+
+// Returns the cached listing of a directory if it's still current, dropping it if not; needs dirCacheMutex
+static const dir_cache::item * findCurrent(dir_cache * cache, const path_t& path) {
+    const auto it = cache->index.find(path);
+    if (it == cache->index.end()) return NULL;
+    const dir_cache::item& item = *it->second;
+    if (!item.watch->valid || item.watch->generation != item.generation) {
+        cache->lru.erase(it->second);
+        cache->index.erase(it);
+        return NULL;
+    }
+    cache->lru.splice(cache->lru.begin(), cache->lru, it->second);
+    return &cache->lru.front();
+}
+
+std::shared_ptr<const dir_listing> listHostDirectory(Computer * comp, const path_t& path) {
+    {
+        std::lock_guard<std::mutex> lock(comp->dirCacheMutex);
+        if (comp->dir_cache_ctx != NULL) if (const dir_cache::item * item = findCurrent(comp->dir_cache_ctx, path)) return item->listing;
+    }
+    // Watch before reading, so a change made while reading isn't missed
+    std::shared_ptr<host_watch> watch = watchHostDirectory(path);
+    const unsigned generation = watch ? watch->generation.load() : 0;
+    std::shared_ptr<const dir_listing> listing = readDirectory(path);
+    if (listing == NULL || watch == NULL) return listing;
+    std::lock_guard<std::mutex> lock(comp->dirCacheMutex);
+    dir_cache * cache = comp->dir_cache_ctx;
+    if (cache == NULL) cache = comp->dir_cache_ctx = new dir_cache;
+    // The other thread may have read the same directory meanwhile
+    const auto it = cache->index.find(path);
+    if (it != cache->index.end()) {
+        cache->lru.erase(it->second);
+        cache->index.erase(it);
+    }
+    cache->lru.push_front({path, listing, watch, generation});
+    cache->index[path] = cache->lru.begin();
+    while (cache->lru.size() > DIR_CACHE_SIZE) {
+        cache->index.erase(cache->lru.back().path);
+        cache->lru.pop_back();
+    }
+    return listing;
+}
+
+bool cachedIsDir(Computer * comp, const path_t& path, bool * isDir) {
+    std::lock_guard<std::mutex> lock(comp->dirCacheMutex);
+    if (comp->dir_cache_ctx == NULL) return false;
+    const dir_cache::item * item = findCurrent(comp->dir_cache_ctx, path.parent_path());
+    if (item == NULL) return false;
+    // Names that aren't listed may still exist under a different case, so only answer for names that are
+    const std::string name = path.filename().u8string();
+    const auto it = std::lower_bound(item->listing->begin(), item->listing->end(), name, [](const dir_entry& a, const std::string& b)->bool {return a.name < b;});
+    if (it == item->listing->end() || it->name != name) return false;
+    *isDir = it->isDir;
+    return true;
+}
+
+// Returns whether a path is inside (or the same as) another, comparing whole components
+static bool isWithin(const path_t::string_type& inner, const path_t::string_type& outer) {
+    if (inner.size() < outer.size() || inner.compare(0, outer.size(), outer) != 0) return false;
+    return inner.size() == outer.size() || inner[outer.size()] == path_t::preferred_separator || (!outer.empty() && outer.back() == path_t::preferred_separator);
+}
+
+void invalidateHostDirectory(Computer * comp, const path_t& path) {
+    std::lock_guard<std::mutex> lock(comp->dirCacheMutex);
+    dir_cache * cache = comp->dir_cache_ctx;
+    if (cache == NULL) return;
+    const path_t::string_type& changed = path.native();
+    for (auto it = cache->lru.begin(); it != cache->lru.end();) {
+        const path_t::string_type& dir = it->path.native();
+        if (isWithin(changed, dir) || isWithin(dir, changed)) {
+            cache->index.erase(it->path);
+            it = cache->lru.erase(it);
+        } else ++it;
+    }
+}
+
+void freeDirectoryCache(Computer * comp) {
+    delete comp->dir_cache_ctx;
+    comp->dir_cache_ctx = NULL;
+}
@@ -0,0 +1,45 @@
+/*
+ * dircache.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the per-computer cache of host directory listings.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef DIRCACHE_HPP
+#define DIRCACHE_HPP
+#include <memory>
+#include <string>
+#include <vector>
+#include <Computer.hpp>
+#include "util.hpp"
+
+#define DIR_CACHE_SIZE 128 // number of listings kept per computer
+
+struct dir_entry {
+    std::string name;
+    bool isDir;
+};
+
+// The entries of a directory sorted by name, without .DS_Store and desktop.ini
+typedef std::vector<dir_entry> dir_listing;
+
+/*
+ * Returns the listing of a host directory, or NULL if it isn't a directory.
+ * Listings are kept while a watch on the directory says it hasn't changed;
+ * on platforms that can't watch directories, every call reads it again.
+ */
+extern std::shared_ptr<const dir_listing> listHostDirectory(Computer * comp, const path_t& path);
+
+// Looks up a host path in its parent's cached listing; returns false if the parent isn't cached or doesn't list it
+extern bool cachedIsDir(Computer * comp, const path_t& path, bool * isDir);
+
+// Drops the listings a change to a host path may affect (its ancestors and anything inside it)
+extern void invalidateHostDirectory(Computer * comp, const path_t& path);
+
+// Frees the cache; called when the computer is deleted
+extern void freeDirectoryCache(Computer * comp);
+
+#endif
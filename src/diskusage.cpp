@@ -0,0 +1,166 @@
+/*
+ * diskusage.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the disk usage counters. Each computer that has asked
+ * for its usage gets a running total, which the fs API adjusts as files are
+ * written, copied, moved and deleted, and a background thread re-measures
+ * every so often. A change made while the directory is being walked may or
+ * may not be in the measurement, so the measurement is only used if nothing
+ * changed meanwhile; otherwise the computer is tried again on the next pass.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "diskusage.hpp"
+#include "platform.hpp"
+
+struct disk_usage {
+    long long total;
+    unsigned long long adjustments; // bumped on every change to total, so the thread knows if one happened while it was measuring
+};
+
+struct write_handle {
+    Computer * comp;
+    uintmax_t size; // size of the file already counted in the usage
+};
+
+std::atomic<int> trackedWriteHandles(0);
+static std::mutex usageMutex;
+static std::condition_variable usageNotify;
+static std::unordered_map<Computer*, disk_usage> usages;
+static std::unordered_map<void*, write_handle> writeHandles;
+static std::thread * usageThread = NULL;
+static bool usageStopping = false;
+
+uintmax_t pathSize(const path_t& path) {
+    std::error_code e;
+    if (!fs::is_directory(path, e)) {
+        const uintmax_t size = fs::file_size(path, e);
+        return e ? 0 : size;
+    }
+    uintmax_t size = 0;
+    for (const auto& dir : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, e)) {
+        std::error_code e2;
+        if (!dir.is_directory(e2)) {
+            const uintmax_t s = dir.file_size(e2);
+            if (!e2) size += s;
+        }
+    }
+    return size;
+}
+
+static void reconcileThread() {
+    std::unique_lock<std::mutex> lock(usageMutex);
+    while (!usageStopping) {
+        usageNotify.wait_for(lock, std::chrono::seconds(DISK_USAGE_RECONCILE_INTERVAL));
+        std::vector<Computer*> comps;
+        for (const auto& u : usages) comps.push_back(u.first);
+        for (Computer * comp : comps) {
+            if (usageStopping) break;
+            auto it = usages.find(comp);
+            if (it == usages.end()) continue;
+            const unsigned long long adjustments = it->second.adjustments;
+            // The computer may be deleted while unlocked, so don't touch it after this
+            const path_t dir = comp->dataDir;
+            lock.unlock();
+            const long long measured = pathSize(dir);
+            lock.lock();
+            it = usages.find(comp);
+            if (it != usages.end() && it->second.adjustments == adjustments) it->second.total = measured;
+        }
+    }
+}
+
+uintmax_t getDiskUsage(Computer * comp) {
+    {
+        std::lock_guard<std::mutex> lock(usageMutex);
+        const auto it = usages.find(comp);
+        if (it != usages.end()) return it->second.total > 0 ? it->second.total : 0;
+    }
+    const long long measured = pathSize(comp->dataDir);
+    std::lock_guard<std::mutex> lock(usageMutex);
+    usages[comp] = disk_usage {measured, 0};
+    if (usageThread == NULL) {
+        usageStopping = false;
+        usageThread = new std::thread(reconcileThread);
+        setThreadName(*usageThread, "Disk Usage Thread");
+    }
+    return measured;
+}
+
+bool isDiskUsageTracked(Computer * comp, const path_t& path) {
+    {
+        std::lock_guard<std::mutex> lock(usageMutex);
+        if (usages.find(comp) == usages.end()) return false;
+    }
+    const path_t dataDir = comp->dataDir;
+    return std::mismatch(dataDir.begin(), dataDir.end(), path.begin(), path.end()).first == dataDir.end();
+}
+
+void adjustDiskUsage(Computer * comp, long long delta) {
+    std::lock_guard<std::mutex> lock(usageMutex);
+    const auto it = usages.find(comp);
+    if (it != usages.end()) {
+        it->second.total += delta;
+        it->second.adjustments++;
+    }
+}
+
+void trackWriteHandle(Computer * comp, void * handle, uintmax_t size) {
+    std::lock_guard<std::mutex> lock(usageMutex);
+    if (usages.find(comp) == usages.end()) return;
+    if (writeHandles.insert(std::make_pair(handle, write_handle {comp, size})).second) trackedWriteHandles++;
+}
+
+void updateWriteHandle(void * handle, long long end) {
+    if (end < 0) return; // tellp failed
+    std::lock_guard<std::mutex> lock(usageMutex);
+    const auto it = writeHandles.find(handle);
+    if (it == writeHandles.end() || (uintmax_t)end <= it->second.size) return;
+    const auto u = usages.find(it->second.comp);
+    if (u != usages.end()) {
+        u->second.total += end - it->second.size;
+        u->second.adjustments++;
+    }
+    it->second.size = end;
+}
+
+void untrackWriteHandle(void * handle) {
+    std::lock_guard<std::mutex> lock(usageMutex);
+    if (writeHandles.erase(handle)) trackedWriteHandles--;
+}
+
+void forgetDiskUsage(Computer * comp) {
+    std::lock_guard<std::mutex> lock(usageMutex);
+    usages.erase(comp);
+    for (auto it = writeHandles.begin(); it != writeHandles.end();) {
+        if (it->second.comp == comp) {
+            it = writeHandles.erase(it);
+            trackedWriteHandles--;
+        } else ++it;
+    }
+}
+
+void stopDiskUsageThread() {
+    std::thread * th;
+    {
+        std::lock_guard<std::mutex> lock(usageMutex);
+        if (usageThread == NULL) return;
+        th = usageThread;
+        usageStopping = true;
+        usageNotify.notify_all();
+    }
+    if (th->joinable()) th->join();
+    delete th;
+    std::lock_guard<std::mutex> lock(usageMutex);
+    usageThread = NULL;
+}
@@ -0,0 +1,55 @@
+/*
+ * diskusage.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions that keep track of how much space each
+ * computer's data directory uses, for enforcing computerSpaceLimit.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef DISKUSAGE_HPP
+#define DISKUSAGE_HPP
+#include <atomic>
+#include <Computer.hpp>
+#include "util.hpp"
+
+#define DISK_USAGE_RECONCILE_INTERVAL 60 // seconds between background re-measurements of each tracked computer
+
+// The number of write handles being tracked; skip calling the handle functions if this is 0
+extern std::atomic<int> trackedWriteHandles;
+
+/*
+ * Returns the number of bytes used by the files in a computer's data
+ * directory. The first call walks the directory; after that, the total is
+ * kept up to date by the fs API, and re-measured in the background every
+ * DISK_USAGE_RECONCILE_INTERVAL seconds to catch anything it missed.
+ */
+extern uintmax_t getDiskUsage(Computer * comp);
+
+// Returns the size of a file, or the total size of the files in a directory
+extern uintmax_t pathSize(const path_t& path);
+
+// Returns whether the computer's usage is being tracked, and the path is in its data directory
+extern bool isDiskUsageTracked(Computer * comp, const path_t& path);
+
+// Adds the change in size of something in the data directory to a computer's usage
+extern void adjustDiskUsage(Computer * comp, long long delta);
+
+// Starts counting writes to a handle opened on a file that was size bytes long
+extern void trackWriteHandle(Computer * comp, void * handle, uintmax_t size);
+
+// Updates the size of a tracked handle's file after it wrote up to the specified position
+extern void updateWriteHandle(void * handle, long long end);
+
+// Stops tracking a handle; call before the handle is freed
+extern void untrackWriteHandle(void * handle);
+
+// Stops tracking a computer; called when it's deleted
+extern void forgetDiskUsage(Computer * comp);
+
+// Stops the background thread. Called on exit.
+extern void stopDiskUsageThread();
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * eventqueue.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the per-computer event queue.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include "eventqueue.hpp"
+#include "scheduler.hpp"
+#include "util.hpp"
+
+#define NAME_CACHE_LIMIT 256
+#define ARENA_COMPACT_THRESHOLD 256
+
+EventQueue::EventQueue(Computer * c): comp(c), enqueuePos(0), overflowCount(0), waiting(false), dequeuePos(0), arenaHead(1), taskState(TASK_RUNNING) {
+    for (size_t i = 0; i < EVENT_RING_SIZE; i++) ring[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+void EventQueue::push(const event_provider& p, void* data) {
+    bool queued = false;
+    // Once anything spills over, keep spilling until the computer drains it, so events stay in order
+    if (overflowCount == 0) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell_t& cell = ring[pos & (EVENT_RING_SIZE - 1)];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.provider = p;
+                    cell.data = data;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    queued = true;
+                    break;
+                }
+            } else if (diff < 0) break; // ring is full
+            else pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    if (!queued) {
+        std::lock_guard<std::mutex> lock(comp->event_provider_queue_mutex);
+        comp->event_provider_queue.push(std::make_pair(p, data));
+        overflowCount++;
+    }
+    // Only wake the computer if it's actually asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (schedule()) return;
+    if (waiting) {
+        { std::lock_guard<std::mutex> lock(waitMutex); }
+        comp->event_lock.notify_all();
+    }
+}
+
+void EventQueue::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (schedule()) return;
+    { std::lock_guard<std::mutex> lock(waitMutex); }
+    comp->event_lock.notify_all();
+}
+
+// If the computer is parked on the worker pool, puts it back in the run queue;
+// if it's running, tells it not to park
+bool EventQueue::schedule() {
+    int state = taskState.load();
+    while (state == TASK_RUNNING || state == TASK_IDLE) {
+        if (taskState.compare_exchange_weak(state, state == TASK_IDLE ? TASK_QUEUED : TASK_NOTIFIED)) {
+            if (state != TASK_IDLE) return false;
+            scheduleComputer(comp);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EventQueue::hasProvider() {
+    return ring[dequeuePos & (EVENT_RING_SIZE - 1)].sequence.load(std::memory_order_acquire) == dequeuePos + 1 || overflowCount > 0;
+}
+
+bool EventQueue::popProvider(std::pair<event_provider, void*>& out) {
+    cell_t& cell = ring[dequeuePos & (EVENT_RING_SIZE - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) == dequeuePos + 1) {
+        out.first = std::move(cell.provider);
+        out.second = cell.data;
+        cell.provider = nullptr;
+        cell.sequence.store(dequeuePos + EVENT_RING_SIZE, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+    if (overflowCount == 0) return false;
+    std::lock_guard<std::mutex> lock(comp->event_provider_queue_mutex);
+    if (comp->event_provider_queue.empty()) return false;
+    out = comp->event_provider_queue.front();
+    comp->event_provider_queue.pop();
+    overflowCount--;
+    return true;
+}
+
+bool EventQueue::pushEvent(const std::string& name, lua_State *from, int nparams, bool copy) {
+    if (!lua_checkstack(comp->paramQueue, nparams + 2)) return false;
+    if (copy) xcopy(from, comp->paramQueue, nparams);
+    else lua_xmove(from, comp->paramQueue, nparams);
+    if (events.empty() && names.size() > NAME_CACHE_LIMIT) names.clear();
+    events.push_back({&*names.insert(name).first, nparams});
+    return true;
+}
+
+int EventQueue::popEvent(lua_State *to) {
+    lua_State *arena = comp->paramQueue;
+    const int nparams = events.front().nparams;
+    events.pop_front();
+    lua_checkstack(arena, 1);
+    if (to != NULL) {
+        for (int i = 0; i < nparams; i++) {
+            lua_pushvalue(arena, arenaHead + i);
+            lua_xmove(arena, to, 1);
+        }
+    }
+    if (events.empty()) {
+        lua_settop(arena, 0);
+        arenaHead = 1;
+        return nparams;
+    }
+    for (int i = 0; i < nparams; i++) {
+        lua_pushnil(arena);
+        lua_replace(arena, arenaHead + i);
+    }
+    arenaHead += nparams;
+    // Slide the remaining parameters down once the consumed space gets large
+    const int top = lua_gettop(arena);
+    if (arenaHead > ARENA_COMPACT_THRESHOLD && arenaHead > top / 2) {
+        const int remaining = top - arenaHead + 1;
+        for (int i = 0; i < remaining; i++) {
+            lua_pushvalue(arena, arenaHead + i);
+            lua_replace(arena, 1 + i);
+        }
+        lua_settop(arena, remaining);
+        arenaHead = 1;
+    }
+    return nparams;
+}
+
+void EventQueue::clear() {
+    events.clear();
+    names.clear();
+    arenaHead = 1;
+}
@@ -0,0 +1,89 @@
+/*
+ * eventqueue.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the class for the per-computer event queue.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef EVENTQUEUE_HPP
+#define EVENTQUEUE_HPP
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <Computer.hpp>
+
+#define EVENT_RING_SIZE 1024 // must be a power of 2
+
+// Scheduler states for computers running on the worker pool
+#define TASK_RUNNING  0 // running on a thread, or not using the scheduler
+#define TASK_NOTIFIED 1 // running, and an event arrived since it last checked
+#define TASK_IDLE     2 // parked until an event arrives
+#define TASK_QUEUED   3 // waiting in the run queue
+
+/*
+ * Events travel through two stages. Providers queued from any thread with
+ * queueEvent go into a bounded lock-free multi-producer/single-consumer ring;
+ * if the ring is full, they spill into Computer::event_provider_queue, and
+ * stay there until the computer catches up so that each producer's events
+ * remain in order. The computer thread then runs the providers, and stores
+ * the resulting event names (interned) and parameters (back to back in the
+ * paramQueue stack) until they're pulled by getNextEvent.
+ */
+class EventQueue {
+    struct cell_t {
+        std::atomic<size_t> sequence;
+        event_provider provider;
+        void* data;
+    };
+    struct queued_event_t {
+        const std::string * name;
+        int nparams;
+    };
+
+    Computer * comp;
+    cell_t ring[EVENT_RING_SIZE];
+    std::atomic<size_t> enqueuePos;
+    std::atomic<size_t> overflowCount;
+    std::atomic<bool> waiting;
+    size_t dequeuePos;
+    std::deque<queued_event_t> events;
+    std::unordered_set<std::string> names;
+    int arenaHead; // stack index of the first parameter of the front event
+
+    bool schedule();
+
+public:
+    std::mutex waitMutex; // locked while the computer waits for an event
+    lua_State * scratch = NULL; // empty thread that providers push their parameters to
+    std::atomic<int> taskState; // TASK_* state of the computer on the worker pool
+
+    EventQueue(Computer * comp);
+
+    // Producer side (any thread)
+    void push(const event_provider& p, void* data);
+    void wake();
+
+    // Consumer side (computer thread only)
+    bool hasProvider();
+    bool popProvider(std::pair<event_provider, void*>& out);
+    bool pushEvent(const std::string& name, lua_State *from, int nparams, bool copy = false);
+    size_t size() const { return events.size(); }
+    bool empty() const { return events.empty(); }
+    const std::string& front() const { return *events.front().name; }
+    int frontParams() const { return events.front().nparams; }
+    int popEvent(lua_State *to);
+    void clear();
+    // Must be called before the final check for providers when going to sleep
+    void setWaiting(bool w) {
+        waiting = w;
+        // Pairs with the fence in push/wake: either the producer sees `waiting`, or the check after this sees its event
+        if (w) std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+};
+
+#endif
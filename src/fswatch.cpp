@@ -0,0 +1,350 @@
+/*
+ * fswatch.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements watching host directories with inotify. There's one
+ * inotify instance and one thread for the whole process; the thread bumps the
+ * generation of each watch as events come in, so users only have to compare
+ * a counter to know whether anything changed. Since inotify hands out the
+ * same watch descriptor for every watch on a directory, watches are shared
+ * by descriptor and removed when the last reference goes away.
+ *
+ * Listeners collect the names of changed entries on the same thread, and are
+ * called once a burst has gone on for HOST_WATCH_COALESCE ms, so a program
+ * writing a file in many small pieces causes one fs_change event, not one per
+ * write. fs.watch subscriptions are listeners that queue those events.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <unordered_map>
+#include <vector>
+#include "fswatch.hpp"
+#include "runtime.hpp"
+
+#ifdef __linux__
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "platform.hpp"
+
+// Directory caches only need to know about entries, so content changes are only asked for while there's a listener.
+// Watches are added with IN_MASK_ADD, so a later watchHostDirectory on the same directory doesn't take them away again.
+#define HOST_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define HOST_WATCH_CONTENT_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE)
+#define HOST_WATCH_SELF_EVENTS (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static std::mutex watchMutex;
+static std::condition_variable listenerDone; // notified when callbacks finish running
+static int inotifyFd = -1;
+static int wakePipe[2] = {-1, -1};
+static std::thread * watchThread = NULL;
+// The raw pointer tells apart a watch that's being freed from a newer one on the same descriptor
+static std::unordered_map<int, std::pair<host_watch*, std::weak_ptr<host_watch> > > watches;
+static std::list<watch_listener*> listeners;
+
+static void notifyListener(watch_listener * listener, const std::string& name, std::chrono::steady_clock::time_point now) {
+    if (listener->pending.empty()) listener->deadline = now + std::chrono::milliseconds(HOST_WATCH_COALESCE);
+    else if (listener->pending.begin()->empty()) return; // the directory itself changing already covers everything in it
+    if (name.empty() || listener->pending.size() >= HOST_WATCH_MAX_PENDING) {
+        listener->pending.clear();
+        listener->pending.insert("");
+    } else listener->pending.insert(name);
+}
+
+// Collects the changes for listeners whose bursts are over, and returns how long poll should wait for the next one
+static int flushListeners(std::chrono::steady_clock::time_point now, std::vector<std::pair<watch_listener*, std::set<std::string> > >& due) {
+    int timeout = -1;
+    for (watch_listener * listener : listeners) {
+        if (listener->pending.empty()) continue;
+        if (listener->deadline <= now) {
+            due.emplace_back(listener, std::set<std::string>());
+            due.back().second.swap(listener->pending);
+            listener->running = true;
+        } else {
+            const int ms = std::chrono::duration_cast<std::chrono::milliseconds>(listener->deadline - now).count() + 1;
+            if (timeout < 0 || ms < timeout) timeout = ms;
+        }
+    }
+    return timeout;
+}
+
+static void watcherThread() {
+    alignas(struct inotify_event) char buf[4096];
+    struct pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+    int timeout = -1;
+    while (true) {
+        const int ready = poll(fds, 2, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        ssize_t len = 0;
+        if (fds[0].revents) {
+            len = read(inotifyFd, buf, sizeof(buf));
+            if (len < 0 && (errno == EINTR || errno == EAGAIN)) len = 0;
+            else if (len <= 0) break;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        // Watches must not be released while the lock is held, since that takes the lock
+        std::vector<std::shared_ptr<host_watch> > changed;
+        std::unique_lock<std::mutex> lock(watchMutex);
+        for (const char * p = buf; p < buf + len;) {
+            const struct inotify_event * ev = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were dropped, so every watch may have missed something
+                for (const auto& w : watches) {
+                    if (std::shared_ptr<host_watch> watch = w.second.second.lock()) {
+                        watch->generation++;
+                        changed.push_back(watch);
+                    }
+                }
+                for (watch_listener * listener : listeners) notifyListener(listener, "", now);
+                continue;
+            }
+            const auto it = watches.find(ev->wd);
+            if (it == watches.end()) continue;
+            std::shared_ptr<host_watch> watch = it->second.second.lock();
+            if (watch) {
+                if (!(ev->mask & HOST_WATCH_CONTENT_MASK)) watch->generation++;
+                if (ev->mask & HOST_WATCH_SELF_EVENTS) watch->valid = false;
+                const bool self = ev->mask & HOST_WATCH_SELF_EVENTS;
+                const std::string name = self || ev->len == 0 ? "" : ev->name;
+                for (watch_listener * listener : listeners)
+                    if (listener->watch == watch && (self || listener->filter.empty() || listener->filter == name))
+                        notifyListener(listener, name, now);
+                changed.push_back(watch);
+            }
+            if (ev->mask & IN_IGNORED) watches.erase(it);
+        }
+        std::vector<std::pair<watch_listener*, std::set<std::string> > > due;
+        timeout = flushListeners(now, due);
+        if (due.empty()) continue;
+        // Callbacks may take a while, and may want to watch or unwatch things themselves
+        lock.unlock();
+        for (const auto& d : due) d.first->callback(d.second);
+        lock.lock();
+        for (const auto& d : due) d.first->running = false;
+        listenerDone.notify_all();
+    }
+}
+
+// Returns the mask a watch needs for the listeners on it; needs watchMutex
+static uint32_t watchMask(const host_watch * watch) {
+    for (const watch_listener * listener : listeners)
+        if (listener->watch.get() == watch) return HOST_WATCH_MASK | HOST_WATCH_CONTENT_MASK;
+    return HOST_WATCH_MASK;
+}
+
+static void releaseWatch(host_watch * watch) {
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        const auto it = watches.find(watch->wd);
+        if (it != watches.end() && it->second.first == watch) {
+            watches.erase(it);
+            if (inotifyFd >= 0) inotify_rm_watch(inotifyFd, watch->wd);
+        }
+    }
+    delete watch;
+}
+
+std::shared_ptr<host_watch> watchHostDirectory(const path_t& path) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    if (watchThread == NULL) {
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0) return NULL;
+        if (pipe(wakePipe) != 0) {
+            close(inotifyFd);
+            inotifyFd = -1;
+            return NULL;
+        }
+        watchThread = new std::thread(watcherThread);
+        setThreadName(*watchThread, "Filesystem Watcher Thread");
+    }
+    const int wd = inotify_add_watch(inotifyFd, path.c_str(), HOST_WATCH_MASK | IN_MASK_ADD);
+    if (wd < 0) return NULL;
+    auto& slot = watches[wd];
+    std::shared_ptr<host_watch> watch = slot.second.lock();
+    if (watch == NULL) {
+        watch = std::shared_ptr<host_watch>(new host_watch, releaseWatch);
+        watch->path = path;
+        watch->wd = wd;
+        slot = std::make_pair(watch.get(), std::weak_ptr<host_watch>(watch));
+    }
+    return watch;
+}
+
+bool addWatchListener(const std::shared_ptr<host_watch>& watch, watch_listener * listener) {
+    std::lock_guard<std::mutex> lock(watchMutex);
+    if (inotifyFd < 0 || !watch->valid) return false;
+    const int wd = inotify_add_watch(inotifyFd, watch->path.c_str(), HOST_WATCH_MASK | HOST_WATCH_CONTENT_MASK | IN_MASK_ADD);
+    if (wd != watch->wd) {
+        // The path names a different directory now; don't leave a watch on it that nobody owns
+        if (wd >= 0 && watches.find(wd) == watches.end()) inotify_rm_watch(inotifyFd, wd);
+        return false;
+    }
+    listener->watch = watch;
+    listener->pending.clear();
+    listeners.push_back(listener);
+    return true;
+}
+
+void removeWatchListener(watch_listener * listener) {
+    std::shared_ptr<host_watch> watch;
+    {
+        std::unique_lock<std::mutex> lock(watchMutex);
+        listeners.remove(listener);
+        if (watchThread == NULL || std::this_thread::get_id() != watchThread->get_id())
+            listenerDone.wait(lock, [listener]()->bool {return !listener->running;});
+        watch.swap(listener->watch);
+        listener->pending.clear();
+        if (watch && inotifyFd >= 0 && watch->valid && watchMask(watch.get()) == HOST_WATCH_MASK) {
+            // Nobody wants the content events anymore; without IN_MASK_ADD, this replaces the mask
+            const int wd = inotify_add_watch(inotifyFd, watch->path.c_str(), HOST_WATCH_MASK);
+            if (wd >= 0 && wd != watch->wd) {
+                // The path names a different directory now, so give it back the mask it had
+                const auto it = watches.find(wd);
+                if (it == watches.end()) inotify_rm_watch(inotifyFd, wd);
+                else inotify_add_watch(inotifyFd, watch->path.c_str(), watchMask(it->second.first));
+            }
+        }
+    }
+}
+
+void stopHostWatcher() {
+    std::thread * th;
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        if (watchThread == NULL) return;
+        th = watchThread;
+        if (write(wakePipe[1], "", 1) < 0) {} // the thread only needs to see the pipe become readable
+    }
+    if (th->joinable()) th->join();
+    delete th;
+    std::lock_guard<std::mutex> lock(watchMutex);
+    watchThread = NULL;
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    close(inotifyFd);
+    wakePipe[0] = wakePipe[1] = inotifyFd = -1;
+    watches.clear();
+}
+
+#else
+
+std::shared_ptr<host_watch> watchHostDirectory(const path_t& path) {
+    return NULL;
+}
+
+bool addWatchListener(const std::shared_ptr<host_watch>& watch, watch_listener * listener) {
+    return false;
+}
+
+void removeWatchListener(watch_listener * listener) {}
+
+void stopHostWatcher() {}
+
+#endif
+
+struct file_watch {
+    Computer * comp;
+    std::string name;
+    watch_listener listener;
+};
+
+struct file_watches {
+    std::unordered_map<std::string, file_watch*> watches;
+};
+
+struct fs_change_data {
+    std::string path;
+    std::vector<std::string> changes;
+};
+
+static std::string fs_change(lua_State *L, void* userp) {
+    fs_change_data * data = (fs_change_data*)userp;
+    luaL_checkstack(L, 4, "Unable to allocate fs_change event");
+    pushstring(L, data->path);
+    lua_createtable(L, data->changes.size(), 0);
+    for (size_t i = 0; i < data->changes.size(); i++) {
+        pushstring(L, data->changes[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    delete data;
+    return "fs_change";
+}
+
+bool addFileWatch(Computer * comp, const std::string& name, const path_t& path, size_t limit) {
+    file_watches * ctx = comp->file_watches_ctx;
+    if (ctx != NULL) {
+        const auto it = ctx->watches.find(name);
+        if (it != ctx->watches.end()) {
+            // A watch whose directory went away never reports anything again, so set it up anew
+            if (it->second->listener.watch && it->second->listener.watch->valid) return true;
+            removeWatchListener(&it->second->listener);
+            delete it->second;
+            ctx->watches.erase(it);
+        }
+    }
+    if (fileWatchCount(comp) >= limit) return false;
+    std::error_code e;
+    const bool isDir = fs::is_directory(path, e);
+    // Files are watched through their directory, so replacing one by renaming over it is still seen
+    std::shared_ptr<host_watch> watch = watchHostDirectory(isDir ? path : path.parent_path());
+    if (watch == NULL) return false;
+    file_watch * fw = new file_watch;
+    fw->comp = comp;
+    fw->name = name;
+    if (!isDir) fw->listener.filter = path.filename().u8string();
+    fw->listener.callback = [fw](const std::set<std::string>& changes) {
+        fs_change_data * data = new fs_change_data;
+        data->path = fw->name;
+        for (const std::string& c : changes) {
+            if (c.empty() || !fw->listener.filter.empty()) data->changes.push_back(fw->name);
+            else data->changes.push_back(fw->name.empty() ? c : fw->name + "/" + c);
+        }
+        queueEvent(fw->comp, fs_change, data);
+    };
+    if (!addWatchListener(watch, &fw->listener)) {
+        delete fw;
+        return false;
+    }
+    if (ctx == NULL) ctx = comp->file_watches_ctx = new file_watches;
+    ctx->watches[name] = fw;
+    return true;
+}
+
+bool removeFileWatch(Computer * comp, const std::string& name) {
+    file_watches * ctx = comp->file_watches_ctx;
+    if (ctx == NULL) return false;
+    const auto it = ctx->watches.find(name);
+    if (it == ctx->watches.end()) return false;
+    removeWatchListener(&it->second->listener);
+    delete it->second;
+    ctx->watches.erase(it);
+    return true;
+}
+
+size_t fileWatchCount(Computer * comp) {
+    return comp->file_watches_ctx != NULL ? comp->file_watches_ctx->watches.size() : 0;
+}
+
+void freeFileWatches(Computer * comp) {
+    file_watches * ctx = comp->file_watches_ctx;
+    if (ctx == NULL) return;
+    for (const auto& w : ctx->watches) {
+        removeWatchListener(&w.second->listener);
+        delete w.second;
+    }
+    delete ctx;
+    comp->file_watches_ctx = NULL;
+}
@@ -0,0 +1,86 @@
+/*
+ * fswatch.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions that watch host directories for changes,
+ * and the fs.watch subscriptions built on them.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef FSWATCH_HPP
+#define FSWATCH_HPP
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <Computer.hpp>
+#include "util.hpp"
+
+#define HOST_WATCH_COALESCE 100 // milliseconds a listener collects changes for before it's called
+#define HOST_WATCH_MAX_PENDING 256 // changed names a listener collects before it just reports the directory itself
+
+// A watch on one host directory, shared by everyone watching it
+struct host_watch {
+    path_t path;
+    std::atomic<unsigned> generation {0}; // bumped whenever an entry is added to, removed from or renamed in the directory
+    std::atomic<bool> valid {true}; // cleared when the directory is deleted or moved, after which the watch never changes again
+    int wd = -1; // Private: watch descriptor
+};
+
+/*
+ * Starts watching a host directory, or joins an existing watch on it. All
+ * watches are serviced by a single background thread. Returns NULL if the
+ * directory can't be watched, or if watching isn't supported on this platform
+ * (currently only Linux is).
+ */
+extern std::shared_ptr<host_watch> watchHostDirectory(const path_t& path);
+
+// Receives the changes seen by a watch, in bursts of up to HOST_WATCH_COALESCE ms
+struct watch_listener {
+    // Called on the watcher thread (without its lock held) with the names of the entries that changed,
+    // or with just "" if the directory itself did, events were lost, or there were too many changes to list
+    std::function<void(const std::set<std::string>&)> callback;
+    std::string filter; // if not empty, only changes to the entry with this name are reported
+    // Private: the rest is only touched by the watcher, under its lock
+    std::shared_ptr<host_watch> watch;
+    std::set<std::string> pending;
+    std::chrono::steady_clock::time_point deadline;
+    bool running = false; // set while the callback is being called
+};
+
+/*
+ * Attaches a listener to a watch, which then also reports changes to the
+ * contents and attributes of its entries. Returns false if the directory
+ * has gone away. The listener must stay alive until it's removed.
+ */
+extern bool addWatchListener(const std::shared_ptr<host_watch>& watch, watch_listener * listener);
+
+// Detaches a listener; once this returns, its callback won't be running or called again
+// (unless this is called from the callback itself, which can't wait for itself to return)
+extern void removeWatchListener(watch_listener * listener);
+
+// Stops the background thread. Called on exit.
+extern void stopHostWatcher();
+
+/*
+ * Starts sending fs_change events to a computer for a path on a host mount.
+ * `name` is the normalized computer path, and `path` the host file or directory
+ * it resolves to. Watching a path that's already watched does nothing. Returns
+ * false if the path can't be watched, or the computer already has `limit`.
+ */
+extern bool addFileWatch(Computer * comp, const std::string& name, const path_t& path, size_t limit);
+
+// Stops watching a path; returns false if it wasn't being watched
+extern bool removeFileWatch(Computer * comp, const std::string& name);
+
+// Returns the number of paths a computer is watching
+extern size_t fileWatchCount(Computer * comp);
+
+// Removes all of a computer's watches; called when it shuts down and when it's deleted
+extern void freeFileWatches(Computer * comp);
+
+#endif
@@ -18,19 +18,25 @@ static void* releaseNotesThread(void* data);
 #include <fstream>
 #include <iomanip>
 #include <thread>
+#include <unordered_map>
 #include <Computer.hpp>
 #include <configuration.hpp>
 #include <sys/stat.h>
+#include "diskusage.hpp"
+#include "fswatch.hpp"
 #include "peripheral/drive.hpp"
 #include "peripheral/speaker.hpp"
 #include "platform.hpp"
+#include "rompack.hpp"
 #include "runtime.hpp"
+#include "scheduler.hpp"
 #include "terminal/CLITerminal.hpp"
 #include "terminal/RawTerminal.hpp"
 #include "terminal/SDLTerminal.hpp"
 #include "terminal/TRoRTerminal.hpp"
 #include "terminal/HardwareSDLTerminal.hpp"
 #include "termsupport.hpp"
+#include "timerwheel.hpp"
 #include <Poco/Version.h>
 #include <Poco/URI.h>
 #include <Poco/Checksum.h>
@@ -110,10 +116,11 @@ static void* releaseNotesThread(void* data) {
         if (comp->L != NULL) {
             comp->event_lock.notify_all();
             for (library_t ** lib = libraries; *lib != NULL; lib++) if ((*lib)->deinit != NULL) (*lib)->deinit(comp);
-            if (comp->eventTimeout != 0) SDL_RemoveTimer(comp->eventTimeout);
+            if (comp->eventTimeout != 0) cancelTimer(comp, comp->eventTimeout);
             comp->eventTimeout = 0;
             lua_close(comp->L);   /* Cya, Lua */
             comp->L = NULL;
+            freeAllocators(comp);
             if (comp->rawFileStack) {
                 std::lock_guard<std::mutex> lock(comp->rawFileStackMutex);
                 lua_close(comp->rawFileStack);
@@ -279,24 +286,54 @@ static int runRenderer(const std::function<std::string()>& read, const std::func
     }
     rawWriter = write;
     std::thread inputThread([read](){
+        std::unordered_map<uint8_t, int> frameSequences; // last frame sequence applied for each window, or -1 if waiting for a keyframe
+        std::unordered_map<uint8_t, RawInflater> inflaters; // compressed packet streams for each window
+        std::set<uint8_t> brokenStreams; // windows whose compressed stream failed, waiting for the server to restart it
         while (!exiting) {
             std::string data = read();
             if (data.empty()) {
                 exiting = true;
                 break;
             }
-            long sizen;
-            size_t off = 8;
-            if (data[3] == 'C') sizen = std::stol(data.substr(4, 4), nullptr, 16);
-            else if (data[3] == 'D') {sizen = std::stol(data.substr(4, 12), nullptr, 16); off = 16;}
-            else continue;
-            std::string ddata = b64decode(data.substr(off, sizen));
-            Poco::Checksum chk;
-            if (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM) chk.update(ddata);
-            else chk.update(data.substr(off, sizen));
-            if (chk.checksum() != std::stoul(data.substr(sizen + off, 8), NULL, 16)) {
-                fprintf(stderr, "Invalid checksum: expected %08X, got %08lX\n", chk.checksum(), std::stoul(data.substr(sizen + off, 8), NULL, 16));
-                continue;
+            std::string ddata;
+            if (data.size() >= 12 && data[3] == 'B') {
+                // binary frame: the payload is sent as-is, with a binary checksum
+                uint32_t sizen = 0, sum = 0;
+                memcpy(&sizen, data.c_str() + 4, 4);
+                if (data.size() < (size_t)sizen + 12) continue;
+                memcpy(&sum, data.c_str() + 8 + sizen, 4);
+                Poco::Checksum chk;
+                chk.update(data.c_str() + 8, sizen);
+                if (chk.checksum() != sum) {
+                    fprintf(stderr, "Invalid checksum: expected %08X, got %08X\n", chk.checksum(), sum);
+                    continue;
+                }
+                ddata.assign(data, 8, sizen);
+            } else {
+                long sizen;
+                size_t off = 8;
+                if (data[3] == 'C') sizen = std::stol(data.substr(4, 4), nullptr, 16);
+                else if (data[3] == 'D') {sizen = std::stol(data.substr(4, 12), nullptr, 16); off = 16;}
+                else continue;
+                ddata = b64decode(data.substr(off, sizen));
+                Poco::Checksum chk;
+                if (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM) chk.update(ddata);
+                else chk.update(data.substr(off, sizen));
+                if (chk.checksum() != std::stoul(data.substr(sizen + off, 8), NULL, 16)) {
+                    fprintf(stderr, "Invalid checksum: expected %08X, got %08lX\n", chk.checksum(), std::stoul(data.substr(sizen + off, 8), NULL, 16));
+                    continue;
+                }
+            }
+            if (ddata.size() >= 3 && (ddata[0] & CCPC_RAW_COMPRESSED_TYPE)) {
+                const uint8_t wid = (uint8_t)ddata[1];
+                if (ddata[2] & CCPC_RAW_COMPRESSED_RESET) brokenStreams.erase(wid);
+                else if (brokenStreams.find(wid) != brokenStreams.end()) continue;
+                if (!inflaters[wid].decompress(ddata)) {
+                    fprintf(stderr, "Could not decompress packet for window %d\n", wid);
+                    brokenStreams.insert(wid);
+                    RawTerminal::requestKeyframe(wid, 0xFFFF);
+                    continue;
+                }
             }
             std::stringstream in(ddata);
             uint8_t type = (uint8_t)in.get();
@@ -312,7 +349,10 @@ static int runRenderer(const std::function<std::string()>& read, const std::func
                     in.read((char*)&height, 2);
                     in.read((char*)&term->blinkX, 2);
                     in.read((char*)&term->blinkY, 2);
-                    in.seekg(in.tellg()+(std::streamoff)4); // reserved
+                    in.seekg(in.tellg()+(std::streamoff)2); // grayscale, reserved
+                    uint16_t seq = 0;
+                    in.read((char*)&seq, 2);
+                    frameSequences[id] = seq;
                     if (term->mode == 0) {
                         unsigned char c = (unsigned char)in.get();
                         unsigned char n = (unsigned char)in.get();
@@ -367,12 +407,73 @@ static int runRenderer(const std::function<std::string()>& read, const std::func
                             term->palette[i].b = (uint8_t)in.get();
                         }
                     }
-                    term->changed = true;
+                    term->markAllDirty();
                 }
                 break;
+            } case CCPC_RAW_TERMINAL_DELTA: {
+                if (rawClientTerminals.find(id) == rawClientTerminals.end()) break;
+                Terminal * term = rawClientTerminals[id];
+                const int mode = in.get();
+                const bool blink = in.get();
+                uint16_t width = 0, height = 0, cursorX = 0, cursorY = 0, seq = 0, base = 0, nspans = 0, npalette = 0;
+                in.read((char*)&width, 2);
+                in.read((char*)&height, 2);
+                in.read((char*)&cursorX, 2);
+                in.read((char*)&cursorY, 2);
+                in.seekg(in.tellg()+(std::streamoff)2); // grayscale, reserved
+                in.read((char*)&seq, 2);
+                in.read((char*)&base, 2);
+                in.read((char*)&nspans, 2);
+                std::lock_guard<std::mutex> lock(term->locked);
+                auto last = frameSequences.find(id);
+                bool valid = last != frameSequences.end() && last->second == base && mode == term->mode && width == term->width && height == term->height;
+                for (uint16_t i = 0; valid && i < nspans; i++) {
+                    uint16_t row = 0, start = 0, length = 0;
+                    in.read((char*)&row, 2);
+                    in.read((char*)&start, 2);
+                    in.read((char*)&length, 2);
+                    if (mode == 0) {
+                        if (row >= height || start + length > width) {valid = false; break;}
+                        in.read((char*)term->screen.data() + (size_t)row * width + start, length);
+                        in.read((char*)term->colors.data() + (size_t)row * width + start, length);
+                        term->markDirty(start, row, length, 1);
+                    } else {
+                        if (row >= height * Terminal::fontHeight || start + length > width * Terminal::fontWidth) {valid = false; break;}
+                        in.read((char*)term->pixels.data() + (size_t)row * width * Terminal::fontWidth + start, length);
+                        term->markPixelsDirty(start, row, length, 1);
+                    }
+                }
+                if (!valid || !in.good()) {
+                    // we missed a frame, so wait for a keyframe to get back in sync
+                    if (last == frameSequences.end() || last->second != -1) {
+                        RawTerminal::requestKeyframe(id, last != frameSequences.end() && last->second >= 0 ? (uint16_t)last->second : 0xFFFF);
+                        frameSequences[id] = -1;
+                    }
+                    term->markAllDirty();
+                    break;
+                }
+                in.read((char*)&npalette, 2);
+                for (uint16_t i = 0; i < npalette; i++) {
+                    const uint8_t idx = (uint8_t)in.get();
+                    term->palette[idx].r = (uint8_t)in.get();
+                    term->palette[idx].g = (uint8_t)in.get();
+                    term->palette[idx].b = (uint8_t)in.get();
+                }
+                if (npalette) term->markAllDirty();
+                if ((int16_t)cursorX != term->blinkX || (int16_t)cursorY != term->blinkY || blink != term->canBlink) {
+                    term->markDirty(term->blinkX, term->blinkY);
+                    term->blinkX = (int16_t)cursorX;
+                    term->blinkY = (int16_t)cursorY;
+                    term->canBlink = blink;
+                    term->markDirty(term->blinkX, term->blinkY);
+                }
+                frameSequences[id] = seq;
+                break;
             } case CCPC_RAW_TERMINAL_CHANGE: {
                 uint8_t quit = (uint8_t)in.get();
                 if (quit == 1) {
+                    inflaters.erase(id);
+                    brokenStreams.erase(id);
                     queueTask([id](void*)->void*{
                         rawClientTerminalIDs.erase(rawClientTerminals[id]->id);
                         rawClientTerminals[id]->factory->deleteTerminal(rawClientTerminals[id]);
@@ -417,14 +518,15 @@ static int runRenderer(const std::function<std::string()>& read, const std::func
                 uint32_t ef = 0;
                 in.read((char*)&f, 2);
                 if (f & CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES) in.read((char*)&ef, 4);
-                RawTerminal::supportedFeatures = f & (CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM | CCPC_RAW_FEATURE_FLAG_FILESYSTEM_SUPPORT | CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS);
-                RawTerminal::supportedExtendedFeatures = ef & (0x00000000);
+                RawTerminal::supportedFeatures = f & (CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM | CCPC_RAW_FEATURE_FLAG_FILESYSTEM_SUPPORT | CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS | CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES);
+                RawTerminal::supportedExtendedFeatures = ef & (CCPC_RAW_EXTENDED_FEATURE_FLAG_DELTA_FRAMES | CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES | CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION);
+                if (RawTerminal::supportedExtendedFeatures & CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES) setRawBinaryMode();
             }}
             std::this_thread::yield();
         }
     });
     setThreadName(inputThread, "Input Thread");
-    RawTerminal::initClient(CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM | CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS);
+    RawTerminal::initClient(CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM | CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS | CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES, CCPC_RAW_EXTENDED_FEATURE_FLAG_DELTA_FRAMES | CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES | CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION);
     mainLoop();
     inputThread.join();
     for (auto t : rawClientTerminals) t.second->factory->deleteTerminal(t.second);
@@ -571,6 +673,11 @@ static void setConfigOption(const char * name, const char * value) {
     setConfigSettingB(useWebP);
     setConfigSettingB(dropFilePath);
     setConfigSettingB(useDFPWM);
+    setConfigSettingI(rawCompressionLevel);
+    setConfigSettingI(schedulerThreads);
+    setConfigSettingI(computerMemoryLimit);
+    setConfigSettingB(slabAllocator);
+    setConfigSettingI(maximumFileWatches);
     else if (strcmp(name, "useHDFont") == 0)
         config.customFontPath = strcasecmp(value, "true") == 0 ? "hdfont" : "";
     else if (strcmp(name, "http_whitelist") == 0) {
@@ -612,7 +719,16 @@ int parseArguments(const std::vector<std::string>& argv) {
         else if (arg.substr(0, 3) == "-C=") computerDir = arg.substr(3);
         else if (arg == "--start-dir") customDataDir = argv[++i];
         else if (arg.substr(0, 3) == "-c=") customDataDir = arg.substr(3);
-        else if (arg == "--rom") setROMPath(argv[++i].c_str());
+        else if (arg == "--rom") {
+            const path_t rom_path(argv[++i]);
+            std::error_code e;
+            if (fs::is_regular_file(rom_path, e)) {
+                if (!loadROMPack(rom_path)) {
+                    std::cerr << "Could not load ROM pack " << argv[i] << "\n";
+                    return 1;
+                }
+            } else setROMPath(rom_path);
+        }
         else if (arg == "--assets-dir" || arg == "-a") setROMPath(path_t(argv[++i])/"assets"/"computercraft"/"lua");
         else if (arg.substr(0, 3) == "-a=") setROMPath(path_t(arg.substr(3))/"assets"/"computercraft"/"lua");
         else if (arg == "--mc-save") computerDir = getMCSavePath() / argv[++i] / "computer";
@@ -711,7 +827,7 @@ int parseArguments(const std::vector<std::string>& argv) {
                       << "General options:\n"
                       << "  -d|--directory <dir>             Sets the directory that stores user data\n"
                       << "  --mc-save <name>                 Uses the selected Minecraft save name for computer data\n"
-                      << "  --rom <dir>                      Sets the directory that holds the ROM & BIOS\n"
+                      << "  --rom <dir|pack>                 Sets the directory or packed file that holds the ROM & BIOS\n"
                       << "  -i|--id <id>                     Sets the ID of the computer that will launch\n"
                       << "  --script <file>                  Sets a script to be run before starting the shell\n"
                       << "  --exec <code>                    Sets Lua code to be run before starting the shell\n"
@@ -842,7 +958,7 @@ int main(int argc, char*argv[]) {
                 }
                 return "";
             }, [ws](const std::string& data) {
-                ws->sendFrame(data.c_str(), data.size());
+                ws->sendFrame(data.c_str(), data.size(), data.compare(0, 4, "!CPB") == 0 ? WebSocket::FRAME_BINARY : WebSocket::FRAME_TEXT);
             });
             open = false;
             try {ws->shutdown();} catch (...) {}
@@ -852,16 +968,33 @@ int main(int argc, char*argv[]) {
         } else return runRenderer([]()->std::string {
             while (true) {
                 unsigned char c1 = (unsigned char)std::cin.get();
-                if (c1 == '!' && std::cin.get() == 'C' && std::cin.get() == 'P' && std::cin.get() == 'C') {
-                    char size[5];
-                    std::cin.read(size, 4);
-                    const long sizen = strtol(size, NULL, 16);
-                    char * tmp = new char[(size_t)sizen+10];
-                    std::cin.read(tmp, sizen + 9);
-                    std::string retval = "!CPC" + std::string(size, 4) + std::string(tmp, sizen + 9);
-                    if (tmp[sizen + 8] == '\r') retval += '\n';
-                    delete[] tmp;
-                    return retval;
+                if (c1 == '!' && std::cin.get() == 'C' && std::cin.get() == 'P') {
+                    const char protocol_type = (char)std::cin.get();
+                    if (protocol_type == 'C') {
+                        char size[5];
+                        size[4] = 0;
+                        std::cin.read(size, 4);
+                        const long sizen = strtol(size, NULL, 16);
+                        char * tmp = new char[(size_t)sizen+10];
+                        std::cin.read(tmp, sizen + 9);
+                        std::string retval = "!CPC" + std::string(size, 4) + std::string(tmp, sizen + 9);
+                        if (tmp[sizen + 8] == '\r') retval += '\n';
+                        delete[] tmp;
+                        return retval;
+                    } else if (protocol_type == 'B') {
+                        // read the whole frame into one buffer
+                        uint32_t sizen = 0;
+                        std::cin.read((char*)&sizen, 4);
+                        if (sizen > CCPC_RAW_MAX_BINARY_FRAME_SIZE) {
+                            fprintf(stderr, "Binary frame too large: %u bytes\n", sizen);
+                            continue;
+                        }
+                        std::string retval((size_t)sizen + 12, 0);
+                        memcpy(&retval[0], "!CPB", 4);
+                        memcpy(&retval[4], &sizen, 4);
+                        std::cin.read(&retval[8], (size_t)sizen + 4);
+                        return retval;
+                    }
                 }
             }
         }, [](const std::string& str) {
@@ -921,7 +1054,7 @@ int main(int argc, char*argv[]) {
         if (selectedRenderer == 0 || selectedRenderer == 5) SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", ("Uh oh, CraftOS-PC has crashed! Please report this to https://www.craftos-pc.cc/bugreport. When writing the report, include the following exception message: \"Poco exception on main thread: " + e.displayText() + "\". CraftOS-PC will now close.").c_str(), NULL);
         for (Computer * c : *computers) {
             c->running = 0;
-            c->event_lock.notify_all();
+            wakeComputer(c);
         }
         exiting = true;
         awaitTasks([]()->bool {return computers.locked() || !computers->empty() || !taskQueue->empty();});
@@ -930,7 +1063,7 @@ int main(int argc, char*argv[]) {
         if (selectedRenderer == 0 || selectedRenderer == 5) SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Uncaught Exception", (std::string("Uh oh, CraftOS-PC has crashed! Please report this to https://www.craftos-pc.cc/bugreport. When writing the report, include the following exception message: \"Exception on main thread: ") + e.what() + "\". CraftOS-PC will now close.").c_str(), NULL);
         for (Computer * c : *computers) {
             c->running = 0;
-            c->event_lock.notify_all();
+            wakeComputer(c);
         }
         exiting = true;
         awaitTasks([]()->bool {return computers.locked() || !computers->empty() || !taskQueue->empty();});
@@ -940,6 +1073,10 @@ int main(int argc, char*argv[]) {
     awaitTasks([]()->bool {return computers.locked() || !computers->empty() || !taskQueue->empty();});
     for (std::thread *t : computerThreads) { if (t->joinable()) {t->join(); delete t;} }
     computerThreads.clear();
+    stopScheduler();
+    stopTimerThread();
+    stopDiskUsageThread();
+    stopHostWatcher();
     deinitializePlugins();
 #ifndef NO_MIXER
     speakerQuit();
@@ -9,18 +9,27 @@
  */
 
 #include "cluster.hpp"
-#include <climits>
 #include <cstring>
 #include <cstdlib>
-#include <cassert>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define BITMAP_UNIT_SIZE (sizeof(bitmap_unit) * 8)
 
-ClusterAllocator::ClusterAllocator(const size_t elem_size): elem_size(elem_size + sizeof(void*)) {
-    head = newcluster(0);
-    freecluster = head;
+// Returns the index of the lowest set bit; v must not be 0
+static inline int lowestBit(unsigned long v) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return (int)idx;
+#else
+    return __builtin_ctzl(v);
+#endif
 }
 
+ClusterAllocator::ClusterAllocator(const size_t elem_size): elem_size(elem_size + sizeof(void*)), head(NULL), freecluster(NULL), emptyClusters(0) {}
+
 ClusterAllocator::~ClusterAllocator() {
     cluster_t * cluster = head, * next;
     while (cluster != NULL) {
@@ -30,77 +39,76 @@ ClusterAllocator::~ClusterAllocator() {
     }
 }
 
-ClusterAllocator::cluster_t * ClusterAllocator::newcluster(long id) {
+ClusterAllocator::cluster_t * ClusterAllocator::newcluster() {
+    // Only the header is initialized here; slots are set up as they're first used
     cluster_t * cluster = (cluster_t*)malloc(sizeof(cluster_t) + CLUSTER_SIZE * elem_size);
-    memset(cluster, 0, sizeof(cluster_t) + CLUSTER_SIZE * elem_size);
-    cluster->next = NULL;  /* ensure next pointer is NULL */
-    cluster->id = id; /* set cluster number */
-    for (int i = 0; i < CLUSTER_SIZE; i++)
-        *(cluster_t**)(cluster->ptr + i * elem_size) = cluster;
+    if (cluster == NULL) return NULL;
+    memset(cluster, 0, sizeof(cluster_t));
+    cluster->next = head;
+    if (head != NULL) head->prev = cluster;
+    head = cluster;
+    pushFree(cluster);
+    emptyClusters++;
+    stats_.clusters++;
+    stats_.clustersAllocated++;
     return cluster;
 }
 
+void ClusterAllocator::unlinkFree(cluster_t * cluster) {
+    if (cluster->freePrev != NULL) cluster->freePrev->freeNext = cluster->freeNext;
+    else freecluster = cluster->freeNext;
+    if (cluster->freeNext != NULL) cluster->freeNext->freePrev = cluster->freePrev;
+    cluster->freePrev = cluster->freeNext = NULL;
+}
+
+void ClusterAllocator::pushFree(cluster_t * cluster) {
+    cluster->freePrev = NULL;
+    cluster->freeNext = freecluster;
+    if (freecluster != NULL) freecluster->freePrev = cluster;
+    freecluster = cluster;
+}
+
 void * ClusterAllocator::alloc() {
-    void *ptr = NULL;
-    cluster_t *cluster, *next;
-    int i, j;
-    for (cluster = freecluster; ptr == NULL; cluster = cluster->next) {
-        /* search for unused entry in cluster */
-        for (i = 0; i < CLUSTER_BITMAP_SIZE; i++) {
-            if (cluster->bitmap[i] != (bitmap_unit)~(bitmap_unit)0) {  /* empty space found? */
-                // magic (https://graphics.stanford.edu/%7Eseander/bithacks.html#CountBitsSetParallel)
-                // please don't use this on a 256-bit CPU
-                bitmap_unit v = (cluster->bitmap[i] ^ (cluster->bitmap[i] + 1)) >> 1;
-                v = v - ((v >> 1) & (bitmap_unit)~(bitmap_unit)0/3); // temp
-                v = (v & (bitmap_unit)~(bitmap_unit)0/15*3) + ((v >> 2) & (bitmap_unit)~(bitmap_unit)0/15*3); // temp
-                v = (v + (v >> 4)) & (bitmap_unit)~(bitmap_unit)0/255*15; // temp
-                j = (bitmap_unit)(v * ((bitmap_unit)~(bitmap_unit)0/255)) >> (sizeof(bitmap_unit) - 1) * 8; // count
-                ptr = (void*)(cluster->ptr + (i * BITMAP_UNIT_SIZE + j) * elem_size);
-                cluster->bitmap[i] |= (1 << j);
-                break;
-            }
-        }
-        if (ptr != NULL) break;
-        if (cluster->next == NULL) {  /* need new cluster? */
-            next = newcluster(cluster->id + 1);
-            cluster->next = next;  /* chain next cluster in list */
-        }
+    cluster_t * cluster = freecluster;
+    if (cluster == NULL && (cluster = newcluster()) == NULL) return NULL;
+    size_t i = cluster->firstFree;
+    while (cluster->bitmap[i] == (bitmap_unit)~(bitmap_unit)0) i++;
+    cluster->firstFree = i;
+    const size_t idx = i * BITMAP_UNIT_SIZE + lowestBit(~cluster->bitmap[i]);
+    cluster->bitmap[i] |= (bitmap_unit)1 << (idx % BITMAP_UNIT_SIZE);
+    unsigned char * slot = cluster->ptr + idx * elem_size;
+    // Free slots are always taken lowest first, so an untouched slot is always the next one
+    if (idx == cluster->touched) {
+        *(cluster_t**)slot = cluster;
+        memset(slot + sizeof(void*), 0, elem_size - sizeof(void*));
+        cluster->touched++;
     }
-    freecluster = cluster;
-    return (void*)((char*)ptr + sizeof(void*));
+    if (cluster->used++ == 0) emptyClusters--;
+    if (cluster->used == CLUSTER_SIZE) unlinkFree(cluster);
+    stats_.allocs++;
+    stats_.inUse++;
+    return slot + sizeof(void*);
 }
 
 void ClusterAllocator::free(void * ptr) {
-    cluster_t * cluster = *(cluster_t**)((char*)ptr - sizeof(cluster_t**));
-    int idx = ((ptrdiff_t)ptr - (ptrdiff_t)cluster->ptr) / elem_size;
-    cluster->bitmap[idx/BITMAP_UNIT_SIZE] &= ~(1 << (idx % BITMAP_UNIT_SIZE));  /* mark entry as freed */
-    if (cluster->id < freecluster->id)
-        freecluster = cluster;
-
-    int i, empty, full;
-    empty = cluster->bitmap[0] == 0;
-    full = cluster->bitmap[0] == ULONG_MAX;
-    for (i = 1; i < CLUSTER_BITMAP_SIZE && (empty || full); i++) {
-        if (cluster->bitmap[i]) {  /* any entry in use? */
-            empty = 0;
+    cluster_t * cluster = *(cluster_t**)((char*)ptr - sizeof(cluster_t*));
+    const size_t idx = ((unsigned char*)ptr - sizeof(void*) - cluster->ptr) / elem_size;
+    cluster->bitmap[idx / BITMAP_UNIT_SIZE] &= ~((bitmap_unit)1 << (idx % BITMAP_UNIT_SIZE));  /* mark entry as freed */
+    if (idx / BITMAP_UNIT_SIZE < cluster->firstFree) cluster->firstFree = idx / BITMAP_UNIT_SIZE;
+    if (cluster->used-- == CLUSTER_SIZE) pushFree(cluster);
+    stats_.frees++;
+    stats_.inUse--;
+    if (cluster->used == 0) {
+        if (emptyClusters < CLUSTER_RETAIN_EMPTY) emptyClusters++;
+        else {
+            /* unlink and free cluster */
+            unlinkFree(cluster);
+            if (cluster->prev != NULL) cluster->prev->next = cluster->next;
+            else head = cluster->next;
+            if (cluster->next != NULL) cluster->next->prev = cluster->prev;
+            ::free(cluster);
+            stats_.clusters--;
+            stats_.clustersFreed++;
         }
-        if (cluster->bitmap[i] != ULONG_MAX) {  /* any entry *not* in use? */
-            full = 0;
-        }
-    }
-    if (empty && cluster->next != NULL) {  /* entire cluster unused? */
-        /* unlink and free cluster */
-        if (head != cluster) {
-            cluster_t * last = head;
-            while (last->next != cluster && last->next != NULL) last = last->next;
-            assert(last != NULL);
-            // TODO: sweep previous empty clusters
-            if (last != cluster) last->next = cluster->next;
-        } else head = cluster->next;
-        if (freecluster == cluster)
-            freecluster = cluster->next;
-        ::free(cluster);
-    } else if (!full && cluster->id < freecluster->id) {
-        freecluster = cluster;
     }
 }
@@ -11,27 +11,55 @@
 #include <cstddef>
 
 #define CLUSTER_SIZE 4096
-#define CLUSTER_BITMAP_SIZE CLUSTER_SIZE / (sizeof(bitmap_unit) * 8)
+#define CLUSTER_BITMAP_SIZE (CLUSTER_SIZE / (sizeof(bitmap_unit) * 8))
+#define CLUSTER_RETAIN_EMPTY 1 // number of empty clusters to keep around instead of freeing
 
+// Counters for a cluster allocator
+struct cluster_stats {
+    size_t allocs = 0; // total number of elements allocated
+    size_t frees = 0; // total number of elements freed
+    size_t inUse = 0; // number of elements currently allocated
+    size_t clusters = 0; // number of clusters currently held
+    size_t clustersAllocated = 0; // total number of clusters allocated
+    size_t clustersFreed = 0; // total number of clusters given back to the system
+};
+
+/*
+ * Every cluster holds CLUSTER_SIZE elements, with a bitmap of the ones in use.
+ * Clusters with at least one free slot are kept on a separate list, so
+ * allocating only looks at the first cluster on that list. Each element is
+ * prefixed with a pointer to its cluster, so freeing is O(1) as well.
+ * Elements are only zeroed the first time they're handed out.
+ */
 class ClusterAllocator {
     typedef unsigned long bitmap_unit;
 
     struct cluster_t {
+        cluster_t * prev; // all clusters
         cluster_t * next;
-        unsigned long id;
+        cluster_t * freePrev; // clusters with free slots
+        cluster_t * freeNext;
+        size_t used; // number of slots in use
+        size_t touched; // number of slots that have been handed out at least once
+        size_t firstFree; // index of the first bitmap unit that may have a free slot
         bitmap_unit bitmap[CLUSTER_BITMAP_SIZE];
         unsigned char ptr[];
     };
 
     const size_t elem_size; // size of each element in the cluster
     cluster_t * head; // pointer to first node of cluster list
-    cluster_t * freecluster; // pointer to first potentially free cluster
+    cluster_t * freecluster; // pointer to first node of the list of clusters with free slots
+    size_t emptyClusters; // number of clusters with no slots in use
+    cluster_stats stats_;
 
-    cluster_t * newcluster(long id);
+    cluster_t * newcluster();
+    void unlinkFree(cluster_t * cluster);
+    void pushFree(cluster_t * cluster);
 
 public:
     ClusterAllocator(const size_t elem_size);
     ~ClusterAllocator();
     void * alloc();
     void free(void * ptr);
+    const cluster_stats& stats() const {return stats_;}
 };
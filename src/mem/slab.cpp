@@ -0,0 +1,94 @@
+/*
+ * mem/slab.cpp
+ * CraftOS-PC 2
+ * 
+ * This file implements the class for the size-class slab allocator.
+ * 
+ * This code is licensed under the MIT License.
+ * Copyright (c) 2019-2024 JackMacWindows. 
+ */
+
+#include "slab.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#define SLAB_PAGE_HEADER ((sizeof(page_t) + SLAB_GRANULARITY - 1) & ~(size_t)(SLAB_GRANULARITY - 1))
+
+static inline size_t sizeClass(size_t size) {
+    return (size - 1) / SLAB_GRANULARITY;
+}
+
+SlabAllocator::SlabAllocator(): pages(NULL), bump(NULL), bumpEnd(NULL) {
+    for (int i = 0; i < SLAB_CLASSES; i++) freelist[i] = NULL;
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (void * ptr : adopted) ::free(ptr);
+    page_t * page = pages, * next;
+    while (page != NULL) {
+        next = page->next;
+        ::free(page);
+        page = next;
+    }
+}
+
+void * SlabAllocator::alloc(size_t size) {
+    if (size > SLAB_MAX_SIZE) return malloc(size);
+    const size_t cls = sizeClass(size);
+    block_t * block = freelist[cls];
+    if (block != NULL) {
+        freelist[cls] = block->next;
+        return block;
+    }
+    const size_t blockSize = (cls + 1) * SLAB_GRANULARITY;
+    if (bump == NULL || (size_t)(bumpEnd - bump) < blockSize) {
+        // The rest of the old page is too small to be worth keeping
+        page_t * page = (page_t*)malloc(SLAB_PAGE_SIZE);
+        if (page == NULL) return NULL;
+        page->next = pages;
+        pages = page;
+        bump = (unsigned char*)page + SLAB_PAGE_HEADER;
+        bumpEnd = (unsigned char*)page + SLAB_PAGE_SIZE;
+    }
+    void * retval = bump;
+    bump += blockSize;
+    return retval;
+}
+
+void SlabAllocator::free(void * ptr, size_t size) {
+    if (ptr == NULL) return;
+    if (size > SLAB_MAX_SIZE) {
+        ::free(ptr);
+        return;
+    }
+    if (!adopted.empty() && adopted.erase(ptr)) {
+        ::free(ptr);
+        return;
+    }
+    block_t * block = (block_t*)ptr;
+    const size_t cls = sizeClass(size);
+    block->next = freelist[cls];
+    freelist[cls] = block;
+}
+
+void * SlabAllocator::realloc(void * ptr, size_t osize, size_t nsize) {
+    if (ptr == NULL) return alloc(nsize);
+    if (osize > SLAB_MAX_SIZE && nsize > SLAB_MAX_SIZE) return ::realloc(ptr, nsize);
+    if (osize <= SLAB_MAX_SIZE && nsize <= SLAB_MAX_SIZE && sizeClass(osize) == sizeClass(nsize)) return ptr;
+    void * retval = alloc(nsize);
+    if (retval == NULL) {
+        // Lua doesn't allow shrinking to fail, and the old block is big enough
+        if (nsize >= osize) return NULL;
+        if (osize > SLAB_MAX_SIZE) {
+            // Frees will now come in with a slab size, so remember that this one came from malloc.
+            // If even that fails, it'll end up on a free list, which is safe (it's bigger than any slab block), but leaks.
+            try {adopted.insert(ptr);} catch (std::bad_alloc&) {}
+        }
+        // A slab block is filed under the smaller size when it's freed
+        return ptr;
+    }
+    memcpy(retval, ptr, osize < nsize ? osize : nsize);
+    free(ptr, osize);
+    return retval;
+}
@@ -0,0 +1,48 @@
+/*
+ * mem/slab.hpp
+ * CraftOS-PC 2
+ * 
+ * This file defines the class for the size-class slab allocator.
+ * 
+ * This code is licensed under the MIT License.
+ * Copyright (c) 2019-2024 JackMacWindows. 
+ */
+
+#include <cstddef>
+#include <unordered_set>
+
+#define SLAB_GRANULARITY 8 // must be a power of 2, and at least the alignment Lua needs
+#define SLAB_MAX_SIZE 256
+#define SLAB_CLASSES (SLAB_MAX_SIZE / SLAB_GRANULARITY)
+#define SLAB_PAGE_SIZE 65536
+
+/*
+ * Small blocks are rounded up to a multiple of SLAB_GRANULARITY and served
+ * from a free list per size class; when a list is empty, a new block is cut
+ * from the current page. Larger blocks go straight to the system allocator.
+ * Block sizes aren't stored, so callers must pass the size to free/realloc
+ * (Lua always does). Freed blocks stay on their list, and pages are only
+ * given back to the system when the allocator is destroyed. This isn't
+ * thread-safe; each Lua state gets its own.
+ */
+class SlabAllocator {
+    struct page_t {
+        page_t * next;
+    };
+    struct block_t {
+        block_t * next;
+    };
+
+    block_t * freelist[SLAB_CLASSES]; // free blocks for each size class
+    page_t * pages; // list of all pages
+    unsigned char * bump; // next unused byte in the current page
+    unsigned char * bumpEnd; // end of the current page
+    std::unordered_set<void*> adopted; // large blocks that were shrunk to a slab size when no slab block could be allocated
+
+public:
+    SlabAllocator();
+    ~SlabAllocator();
+    void * alloc(size_t size);
+    void free(void * ptr, size_t size);
+    void * realloc(void * ptr, size_t osize, size_t nsize);
+};
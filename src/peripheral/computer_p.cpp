@@ -32,6 +32,7 @@ int computer::shutdown(lua_State *L) {
     lastCFunction = __func__;
     if (freedComputers.find(comp) != freedComputers.end()) return 0;
     comp->running = 0;
+    wakeComputer(comp);
     return 0;
 }
 
@@ -39,6 +40,7 @@ int computer::reboot(lua_State *L) {
     lastCFunction = __func__;
     if (freedComputers.find(comp) != freedComputers.end()) return 0;
     comp->running = 2;
+    wakeComputer(comp);
     return 0;
 }
 
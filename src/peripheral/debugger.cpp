@@ -904,6 +904,7 @@ int debugger::_deinit(lua_State *L) {
 void debugger::resetMounts() {
     monitor->mounts.clear();
     for (const auto mount : computer->mounts) monitor->mounts.push_back(mount);
+    invalidateMountCache(monitor);
 }
 
 static luaL_Reg debugger_reg[] = {
@@ -109,6 +109,7 @@ int drive::ejectDisk(lua_State *L) {
         for (auto it = computer->mounts.begin(); it != computer->mounts.end(); ++it) {
             if (1 == std::get<0>(*it).size() && std::get<0>(*it).front() == mount_path) {
                 computer->mounts.erase(it);
+                invalidateMountCache(computer);
                 if (mount_path == "disk") computer->usedDriveMounts.erase(0);
                 else {
                     const int n = std::stoi(mount_path.substr(4)) - 1;
@@ -39,13 +39,15 @@ int monitor::write(lua_State *L) {
     const char * str = luaL_checklstring(L, 1, &str_sz);
     std::lock_guard<std::mutex> lock(term->locked);
     if (term->blinkY < 0 || (term->blinkX >= 0 && (unsigned)term->blinkX >= term->width) || (unsigned)term->blinkY >= term->height) return 0;
+    const int startX = term->blinkX;
     for (unsigned i = 0; i < str_sz && (term->blinkX < 0 || (unsigned)term->blinkX < term->width); i++, term->blinkX++) {
         if (term->blinkX >= 0) {
             term->screen[term->blinkY][term->blinkX] = str[i];
             term->colors[term->blinkY][term->blinkX] = colors;
         }
     }
-    term->changed = true;
+    // includes the cell the cursor moved to
+    term->markDirty(startX, term->blinkY, term->blinkX - startX + 1, 1);
     return 0;
 }
 
@@ -69,7 +71,7 @@ int monitor::scroll(lua_State *L) {
         memmove(term->colors.data() - lines * (int)term->width, term->colors.data(), ((int)term->height + lines) * term->width);
         memset(term->colors.data(), colors, -lines * term->width);
     }
-    term->changed = true;
+    term->markDirty(0, 0, term->width, term->height);
     return 0;
 }
 
@@ -79,8 +81,10 @@ int monitor::setCursorPos(lua_State *L) {
     const int x = (int)luaL_checkinteger(L, 1);
     const int y = (int)luaL_checkinteger(L, 2);
     std::lock_guard<std::mutex> lock(term->locked);
+    term->markDirty(term->blinkX, term->blinkY);
     term->blinkX = x - 1;
     term->blinkY = y - 1;
+    term->markDirty(term->blinkX, term->blinkY);
     return 0;
 }
 
@@ -89,6 +93,7 @@ int monitor::setCursorBlink(lua_State *L) {
     luaL_checktype(L, 1, LUA_TBOOLEAN);
     std::lock_guard<std::mutex> lock(term->locked);
     term->canBlink = lua_toboolean(L, 1);
+    term->markDirty(term->blinkX, term->blinkY);
     if (selectedRenderer == 4) printf("TB:%d;%s\n", term->id, lua_toboolean(L, 1) ? "true" : "false");
     return 0;
 }
@@ -128,7 +133,7 @@ int monitor::clear(lua_State *L) {
         memset(term->screen.data(), ' ', term->height * term->width);
         memset(term->colors.data(), colors, term->height * term->width);
     }
-    term->changed = true;
+    term->markDirty(0, 0, term->width, term->height);
     return 0;
 }
 
@@ -139,7 +144,7 @@ int monitor::clearLine(lua_State *L) {
     std::lock_guard<std::mutex> lock(term->locked);
     memset(term->screen.data() + (term->blinkY * term->width), ' ', term->width);
     memset(term->colors.data() + (term->blinkY * term->width), colors, term->width);
-    term->changed = true;
+    term->markDirty(0, term->blinkY, term->width, 1);
     return 0;
 }
 
@@ -191,6 +196,7 @@ int monitor::blit(lua_State *L) {
     if (str_sz != fg_sz || fg_sz != bg_sz) luaL_error(L, "Arguments must be the same length");
     std::lock_guard<std::mutex> lock(term->locked);
     if (term->blinkY < 0 || (term->blinkX >= 0 && (unsigned)term->blinkX >= term->width) || (unsigned)term->blinkY >= term->height) return 0;
+    const int startX = term->blinkX;
     for (unsigned i = 0; i < str_sz && (term->blinkX < 0 || (unsigned)term->blinkX < term->width); i++, term->blinkX++) {
         if (term->blinkX >= 0) {
             colors = htoi(bg[i], 15) << 4 | htoi(fg[i], 0);
@@ -201,7 +207,7 @@ int monitor::blit(lua_State *L) {
             term->colors[term->blinkY][term->blinkX] = colors;
         }
     }
-    term->changed = true;
+    term->markDirty(startX, term->blinkY, term->blinkX - startX + 1, 1);
     return 0;
 }
 
@@ -241,7 +247,7 @@ int monitor::setPaletteColor(lua_State *L) {
     }
     if (selectedRenderer == 4 && color < 16) 
         printf("TM:%d;%d,%f,%f,%f\n", term->id, color, term->palette[color].r / 255.0, term->palette[color].g / 255.0, term->palette[color].b / 255.0);
-    term->changed = true;
+    term->markAllDirty();
     return 0;
 }
 
@@ -252,7 +258,7 @@ int monitor::setGraphicsMode(lua_State *L) {
     if (lua_isnumber(L, 1) && (lua_tointeger(L, 1) < 0 || lua_tointeger(L, 1) > 2)) return luaL_error(L, "bad argument #1 (invalid mode %d)", lua_tointeger(L, 1));
     std::lock_guard<std::mutex> lock(term->locked);
     term->mode = lua_isboolean(L, 1) ? (lua_toboolean(L, 1) ? 1 : 0) : (int)lua_tointeger(L, 1);
-    term->changed = true;
+    term->markAllDirty();
     return 0;
 }
 
@@ -278,7 +284,7 @@ int monitor::setPixel(lua_State *L) {
     if (x < 0 || y < 0 || (unsigned)x >= term->width * 6 || (unsigned)y >= term->height * 9) return 0;
     if (color < 0 || color > (term->mode == 2 ? 255 : 15)) return luaL_error(L, "bad argument #3 (invalid color %d)", color);
     term->pixels[y][x] = color;
-    term->changed = true;
+    term->markPixelsDirty(x, y);
     return 0;
 }
 
@@ -378,7 +384,7 @@ int monitor::drawPixels(lua_State *L) {
             memset(&term->pixels[init_y + h][memset_x], index, memset_len);
         }
 
-        term->changed = true;
+        term->markPixelsDirty(memset_x, init_y, memset_len, cool_height);
         return 0;
     }
 
@@ -429,7 +435,7 @@ int monitor::drawPixels(lua_State *L) {
         lua_pop(L, 1);
     }
 
-    term->changed = true;
+    term->markPixelsDirty(init_x, init_y, undefinedWidth ? pixelWidth - init_x : (int)min(width, (unsigned)pixelWidth), (int)cool_height);
     return 0;
 }
 
@@ -44,6 +44,7 @@ extern "C" {
 #include "../peripheral/speaker.hpp"
 #include "../platform.hpp"
 #include "../runtime.hpp"
+#include "../scheduler.hpp"
 #include "../termsupport.hpp"
 #include "../terminal/SDLTerminal.hpp"
 
@@ -720,10 +721,12 @@ shouldRecognizeSimultaneouslyWithGestureRecognizer:(UIGestureRecognizer *)otherG
         for (Computer * comp : *computers) {
             std::lock_guard<std::mutex> l2(comp->termEventQueueMutex);
             comp->termEventQueue.push(e);
+            wakeComputer(comp);
         }
     }
     for (std::thread *t : computerThreads) { if (t->joinable()) {t->join(); delete t;} }
     computerThreads.clear();
+    stopScheduler();
     deinitializePlugins();
 #ifndef NO_MIXER
     speakerQuit();
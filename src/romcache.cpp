@@ -0,0 +1,133 @@
+/*
+ * romcache.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the process-wide ROM cache. The first lookup walks the
+ * ROM directory once and keeps its listings, sizes and times in a tree that's
+ * shared by every computer, so fs calls on /rom don't have to hit the disk.
+ * File contents are read on first open, and handles read straight from the
+ * shared buffer. Since the tree is held by shared_ptr, reloading swaps in a
+ * new one while computers still holding nodes of the old one keep them valid.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sys/stat.h>
+#include <configuration.hpp>
+#include "platform.hpp"
+#include "romcache.hpp"
+
+#if defined(_WIN32) || defined(__APPLE__)
+// Paths may not match the case on disk, so names that aren't in the tree have to be checked on disk
+#define ROM_CACHE_CASE_INSENSITIVE
+#endif
+
+struct rom_tree {
+    path_t root;
+    rom_node node;
+};
+
+static std::shared_ptr<const rom_tree> romTree;
+static std::mutex romCacheMutex; // guards building the tree and loading file contents
+static size_t romContentSize = 0;
+
+static void scanROM(const path_t& dir, rom_node& node) {
+    std::error_code e;
+    for (const auto& entry : fs::directory_iterator(dir, e)) {
+#ifdef _WIN32
+        struct _stat st;
+        if (_wstat(entry.path().c_str(), &st) != 0) continue;
+#else
+        struct stat st;
+        if (stat(entry.path().c_str(), &st) != 0) continue;
+#endif
+        rom_node& child = node.children[entry.path().filename().u8string()];
+        child.isDir = S_ISDIR(st.st_mode);
+        child.size = child.isDir ? 0 : st.st_size;
+        child.modified = st_time_ms(st.st_m);
+        child.created = st_time_ms(st.st_c);
+        if (child.isDir) scanROM(entry.path(), child);
+    }
+}
+
+static std::shared_ptr<const rom_tree> getROMTree() {
+    std::shared_ptr<const rom_tree> tree = std::atomic_load(&romTree);
+    if (tree) return tree;
+    std::lock_guard<std::mutex> lock(romCacheMutex);
+    tree = std::atomic_load(&romTree);
+    if (tree) return tree;
+    rom_tree * newtree = new rom_tree;
+    newtree->root = getROMPath() / "rom";
+    newtree->node.isDir = true;
+    scanROM(newtree->root, newtree->node);
+    tree = std::shared_ptr<const rom_tree>(newtree);
+    std::atomic_store(&romTree, tree);
+    return tree;
+}
+
+std::shared_ptr<const rom_node> findROMNode(const path_t& path, bool * inROM) {
+    if (inROM) *inROM = false;
+    if (!config.romReadOnly || path.empty() || isVFSPath(*path.begin())) return NULL;
+    std::shared_ptr<const rom_tree> tree = getROMTree();
+    auto it = std::mismatch(tree->root.begin(), tree->root.end(), path.begin(), path.end());
+    if (it.first != tree->root.end()) return NULL;
+    const rom_node * node = &tree->node;
+    for (auto p = it.second; p != path.end(); ++p) {
+        if (p->empty()) continue;
+        const auto child = node->children.find(p->u8string());
+        if (child == node->children.end()) {
+#ifndef ROM_CACHE_CASE_INSENSITIVE
+            if (inROM) *inROM = true;
+#endif
+            return NULL;
+        }
+        node = &child->second;
+    }
+    if (inROM) *inROM = true;
+    // Share ownership of the tree, so the node stays valid if it's reloaded
+    return std::shared_ptr<const rom_node>(tree, node);
+}
+
+bool hostPathExists(const path_t& path, std::error_code& e) {
+    bool inROM;
+    const std::shared_ptr<const rom_node> node = findROMNode(path, &inROM);
+    if (inROM) return node != NULL;
+    return fs::exists(path, e);
+}
+
+bool hostPathIsDir(const path_t& path, std::error_code& e) {
+    bool inROM;
+    const std::shared_ptr<const rom_node> node = findROMNode(path, &inROM);
+    if (inROM) return node != NULL && node->isDir;
+    return fs::is_directory(path, e);
+}
+
+std::shared_ptr<const std::string> getROMFileData(const path_t& path, const rom_node& node) {
+    {
+        std::lock_guard<std::mutex> lock(romCacheMutex);
+        if (node.data) return node.data;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return NULL;
+    std::string * str = new std::string(node.size, '\0');
+    in.read(&(*str)[0], str->size());
+    str->resize(in.gcount());
+    std::shared_ptr<const std::string> data(str);
+    std::lock_guard<std::mutex> lock(romCacheMutex);
+    if (node.data) return node.data;
+    if (romContentSize + data->size() <= ROM_CONTENT_CACHE_LIMIT) {
+        romContentSize += data->size();
+        node.data = data;
+    }
+    return data;
+}
+
+void reloadROMCache() {
+    std::lock_guard<std::mutex> lock(romCacheMutex);
+    std::atomic_store(&romTree, std::shared_ptr<const rom_tree>());
+    romContentSize = 0;
+}
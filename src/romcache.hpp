@@ -0,0 +1,50 @@
+/*
+ * romcache.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions for the process-wide ROM cache.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef ROMCACHE_HPP
+#define ROMCACHE_HPP
+#include <map>
+#include <memory>
+#include <string>
+#include "util.hpp"
+
+#define ROM_CONTENT_CACHE_LIMIT 33554432 // maximum bytes of ROM file contents kept in memory
+
+// A file or directory in the cached ROM tree. Nodes never change once built; reloading builds a new tree.
+struct rom_node {
+    bool isDir = false;
+    uintmax_t size = 0;
+    long long modified = 0; // ms since the epoch
+    long long created = 0;
+    std::map<std::string, rom_node> children;
+    mutable std::shared_ptr<const std::string> data; // loaded on first open
+};
+
+/*
+ * Looks up a host path in the cached ROM tree. Returns NULL if the path is
+ * outside the ROM, or in the ROM but missing; inROM tells the two apart. If
+ * inROM is false, the caller should go to the filesystem as usual. The cache
+ * is only used while the ROM is read-only, since it's never written to then.
+ */
+extern std::shared_ptr<const rom_node> findROMNode(const path_t& path, bool * inROM = NULL);
+
+// Returns whether a host path exists, using the ROM cache for paths in the ROM
+extern bool hostPathExists(const path_t& path, std::error_code& e);
+
+// Returns whether a host path is a directory, using the ROM cache for paths in the ROM
+extern bool hostPathIsDir(const path_t& path, std::error_code& e);
+
+// Returns the contents of a file in the ROM, reading and caching them on first use, or NULL if it can't be read
+extern std::shared_ptr<const std::string> getROMFileData(const path_t& path, const rom_node& node);
+
+// Drops the cached tree and contents so they're read from disk again on next use, for editing the ROM while running
+extern void reloadROMCache();
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * rompack.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements loading the ROM from a single packed file. The pack is
+ * mapped into memory once, and the ROM and debugger mounts are served as
+ * virtual mounts whose indexes point straight into the mapping, so starting a
+ * computer doesn't touch the filesystem for any ROM file.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_set>
+#include "rompack.hpp"
+#include "vfsindex.hpp"
+
+#define ROM_PACK_HEADER_SIZE 32
+#define ROM_PACK_ENTRY_SIZE 32
+
+// The FileEntries are only tokens to mount; everything is looked up through the indexes below
+static const FileEntry packROMMount = FileEntry(std::map<std::string, FileEntry>());
+static const FileEntry packDebugMount = FileEntry(std::map<std::string, FileEntry>());
+static const FileEntry packRootToken = FileEntry(std::map<std::string, FileEntry>());
+static std::shared_ptr<const VFSIndex> packRoot, packROM, packDebug;
+
+static uint32_t read32(const unsigned char * p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read64(const unsigned char * p) {
+    return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+
+// Maps a whole file read-only; the returned pointer unmaps it when the last reference goes away
+static std::shared_ptr<const void> mapFile(const path_t& path, size_t * size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER len;
+    if (!GetFileSizeEx(file, &len) || len.QuadPart == 0 || (unsigned long long)len.QuadPart > SIZE_MAX) {CloseHandle(file); return NULL;}
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+    void * ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (ptr == NULL) return NULL;
+    *size = (size_t)len.QuadPart;
+    return std::shared_ptr<const void>(ptr, [](const void * p) {UnmapViewOfFile(p);});
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || (unsigned long long)st.st_size > SIZE_MAX) {close(fd); return NULL;}
+    const size_t len = (size_t)st.st_size;
+    void * ptr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return NULL;
+    *size = len;
+    return std::shared_ptr<const void>(ptr, [len](const void * p) {munmap((void*)p, len);});
+#endif
+}
+
+// Adds an entry to an index, creating any parent directories the pack didn't list; returns NULL if a parent is a file
+static VFSIndex::entry * addEntry(VFSIndex * index, const std::string& key) {
+    const auto it = index->entries.find(key);
+    if (it != index->entries.end()) return &it->second;
+    const size_t slash = key.find_last_of('/');
+    VFSIndex::entry * parent = addEntry(index, slash == std::string::npos ? std::string() : key.substr(0, slash));
+    if (parent == NULL || !parent->isDir) return NULL;
+    parent->children.push_back(slash == std::string::npos ? key : key.substr(slash + 1));
+    VFSIndex::entry& ent = index->entries[key];
+    ent.isDir = true;
+    ent.offset = ent.size = 0;
+    return &ent;
+}
+
+// Returns false if the entry is a file that's already there as a directory, or is inside a file
+static bool setEntry(VFSIndex * index, const std::string& key, bool isDir, size_t offset, size_t size) {
+    VFSIndex::entry * ent = addEntry(index, key);
+    if (ent == NULL || (!isDir && !ent->children.empty())) return false;
+    ent->isDir = isDir;
+    ent->offset = offset;
+    ent->size = size;
+    return true;
+}
+
+static std::shared_ptr<VFSIndex> newIndex(const FileEntry * token, const std::shared_ptr<const void>& storage) {
+    std::shared_ptr<VFSIndex> index = std::make_shared<VFSIndex>(token, storage, (const char*)storage.get());
+    VFSIndex::entry& root = index->entries[""];
+    root.isDir = true;
+    root.offset = root.size = 0;
+    return index;
+}
+
+bool loadROMPack(const path_t& path) {
+    size_t size = 0;
+    std::shared_ptr<const void> storage = mapFile(path, &size);
+    if (storage == NULL) return false;
+    const unsigned char * base = (const unsigned char*)storage.get();
+    if (size < ROM_PACK_HEADER_SIZE || memcmp(base, ROM_PACK_MAGIC, 8) != 0 || read32(base + 8) != ROM_PACK_VERSION) return false;
+    const uint64_t count = read32(base + 12), stringsOffset = read64(base + 16), stringsSize = read64(base + 24);
+    if (count > (size - ROM_PACK_HEADER_SIZE) / ROM_PACK_ENTRY_SIZE || stringsOffset > size || stringsSize > size - stringsOffset) return false;
+    std::shared_ptr<VFSIndex> root = newIndex(&packRootToken, storage), rom, debug;
+    std::unordered_set<std::string> names;
+    for (uint64_t i = 0; i < count; i++) {
+        const unsigned char * e = base + ROM_PACK_HEADER_SIZE + i * ROM_PACK_ENTRY_SIZE;
+        const uint64_t offset = read64(e), length = read64(e + 8), nameOffset = read32(e + 16), nameLength = read32(e + 20);
+        const bool isDir = read32(e + 24) & ROM_PACK_FLAG_DIR;
+        if (nameLength == 0 || nameOffset > stringsSize || nameLength > stringsSize - nameOffset) return false;
+        if (!isDir && (offset > size || length > size - offset)) return false;
+        const std::string name((const char*)base + stringsOffset + nameOffset, nameLength);
+        if (name.front() == '/' || name.back() == '/' || name.find("//") != std::string::npos) return false;
+        // A name listed twice, or a file with other entries inside it, would quietly turn the file into a directory
+        if (!names.insert(name).second || !setEntry(root.get(), name, isDir, offset, length)) return false;
+        std::shared_ptr<VFSIndex> * sub = NULL;
+        size_t prefix = 0;
+        if (name.compare(0, 3, "rom") == 0 && (name.size() == 3 || name[3] == '/')) {sub = &rom; prefix = 3;}
+        else if (name.compare(0, 5, "debug") == 0 && (name.size() == 5 || name[5] == '/')) {sub = &debug; prefix = 5;}
+        if (sub == NULL) continue;
+        if (*sub == NULL) *sub = newIndex(sub == &rom ? &packROMMount : &packDebugMount, storage);
+        if (name.size() > prefix && !setEntry(sub->get(), name.substr(prefix + 1), isDir, offset, length)) return false;
+    }
+    // Entries are sorted by full path, which isn't quite the order of names within a directory
+    for (VFSIndex * index : {root.get(), rom.get(), debug.get()})
+        if (index != NULL) for (auto& e : index->entries) std::sort(e.second.children.begin(), e.second.children.end());
+    packRoot = root;
+    packROM = rom;
+    packDebug = debug;
+    if (packROM) shareVFSIndex(packROM);
+    if (packDebug) shareVFSIndex(packDebug);
+    return true;
+}
+
+const FileEntry * getROMPackMount(const std::string& name) {
+    if (name == "rom") return packROM ? &packROMMount : NULL;
+    else if (name == "debug") return packDebug ? &packDebugMount : NULL;
+    else return NULL;
+}
+
+bool getROMPackFile(const std::string& name, const char ** data, size_t * size) {
+    if (packRoot == NULL) return false;
+    const auto it = packRoot->entries.find(name);
+    if (it == packRoot->entries.end() || it->second.isDir) return false;
+    *data = packRoot->data(it->second);
+    *size = it->second.size;
+    return true;
+}
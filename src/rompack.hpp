@@ -0,0 +1,41 @@
+/*
+ * rompack.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions that load the ROM from a single packed,
+ * memory-mapped file.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef ROMPACK_HPP
+#define ROMPACK_HPP
+#include <string>
+#include <FileEntry.hpp>
+#include "util.hpp"
+
+/*
+ * ROM pack layout (all integers little-endian):
+ *   header:  char magic[8] = "CCPCROM1", uint32 version, uint32 entryCount,
+ *            uint64 stringTableOffset, uint64 stringTableSize
+ *   entries: entryCount * { uint64 dataOffset, uint64 dataSize, uint32 nameOffset,
+ *            uint32 nameLength, uint32 flags, uint32 reserved }
+ *   string table, then file contents, each aligned to ROM_PACK_ALIGNMENT
+ * Names are paths relative to the ROM directory, separated by '/'
+ * ("bios.lua", "rom/apis/colors.lua", ...). Directories have flag 1 set and
+ * no contents. Packs are built with resources/packROM.js (`make rompack`).
+ */
+#define ROM_PACK_MAGIC "CCPCROM1"
+#define ROM_PACK_VERSION 1
+#define ROM_PACK_ALIGNMENT 64
+#define ROM_PACK_FLAG_DIR 1
+
+// Maps a ROM pack and uses it for the ROM from then on; returns false if it couldn't be loaded
+extern bool loadROMPack(const path_t& path);
+// Returns the virtual mount for a top-level directory in the loaded pack ("rom" or "debug"), or NULL if there's none
+extern const FileEntry * getROMPackMount(const std::string& name);
+// Looks up a file in the loaded pack by its path relative to the ROM directory; returns false if there's no such file
+extern bool getROMPackFile(const std::string& name, const char ** data, size_t * size);
+
+#endif
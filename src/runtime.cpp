@@ -20,6 +20,7 @@
 #include <configuration.hpp>
 #include <dirent.h>
 #include <sys/stat.h>
+#include "eventqueue.hpp"
 #include "main.hpp"
 #include "runtime.hpp"
 #include "peripheral/debugger.hpp"
@@ -29,6 +30,7 @@
 #include "terminal/RawTerminal.hpp"
 #include "terminal/HardwareSDLTerminal.hpp"
 #include "termsupport.hpp"
+#include "timerwheel.hpp"
 #ifdef WIN32
 #define R_OK 0x04
 #define W_OK 0x02
@@ -42,7 +44,7 @@
 #include <unistd.h>
 #endif
 
-#define termHasEvent(computer) ((computer)->running == 1 && (!(computer)->event_provider_queue.empty() || (computer)->lastResizeEvent || !(computer)->termEventQueue.empty()))
+#define termHasEvent(computer) ((computer)->running == 1 && ((computer)->event_queue_ctx->hasProvider() || (computer)->lastResizeEvent || !(computer)->termEventQueue.empty()))
 #define QUEUE_LIMIT 256
 
 ProtectedObject<std::queue<TaskQueueItem*> > taskQueue;
@@ -181,7 +183,7 @@ void mainLoop() {
 }
 
 extern library_t * libraries[8];
-Uint32 eventTimeoutEvent(Uint32 interval, void* param) {
+Uint32 eventTimeoutEvent(Uint32 interval, SDL_TimerID id, void* owner, void* param) {
     Computer * computer = (Computer*)param;
     LockGuard lock(computers);
     if (freedComputers.find(computer) != freedComputers.end()) return 0;
@@ -223,28 +225,30 @@ Uint32 eventTimeoutEvent(Uint32 interval, void* param) {
     return 1000;
 }
 
+void wakeComputer(Computer *comp) {
+    if (freedComputers.find(comp) != freedComputers.end()) return;
+    comp->event_queue_ctx->wake();
+}
+
 void queueEvent(Computer *comp, const event_provider& p, void* data) {
     if (freedComputers.find(comp) != freedComputers.end()) return;
-    {
-        std::lock_guard<std::mutex> lock(comp->event_provider_queue_mutex);
-        comp->event_provider_queue.push(std::make_pair(p, data));
-    }
-    comp->event_lock.notify_all();
+    comp->event_queue_ctx->push(p, data);
 }
 
-int getNextEvent(lua_State *L, const std::string& filter) {
+int getNextEvent(lua_State *L, const std::string& filter, bool wait) {
     Computer * computer = get_comp(L);
     if (computer->running != 1) return 0;
+    EventQueue * queue = computer->event_queue_ctx;
     computer->timeoutCheckCount = 0;
-    std::string ev;
+    const std::string * ev;
     computer->getting_event = true;
-    lua_State *param;
-    if (computer->eventQueue.size() > QUEUE_LIMIT) fprintf(stderr, "Warning: Queue overflow on computer %d!\n", computer->id);
+    if (queue->size() > QUEUE_LIMIT) fprintf(stderr, "Warning: Queue overflow on computer %d!\n", computer->id);
     do {
-        if (!lua_checkstack(computer->paramQueue, 1)) luaL_error(L, "Could not allocate space for event");
-        param = lua_newthread(computer->paramQueue);
         do {
-            while (termHasEvent(computer) && computer->eventQueue.size() < QUEUE_LIMIT) {
+            while (termHasEvent(computer) && queue->size() < QUEUE_LIMIT) {
+                // Providers push their parameters onto an empty scratch thread, which are then moved into the arena
+                lua_State *param = queue->scratch;
+                lua_settop(param, 0);
                 if (!lua_checkstack(param, 4)) fprintf(stderr, "Could not allocate event\n");
                 std::string name = termGetEvent(param);
                 if (!name.empty() && computer->eventHooks.find(name) != computer->eventHooks.end()) {
@@ -259,54 +263,34 @@ int getNextEvent(lua_State *L, const std::string& filter) {
                         if (name.empty()) break;
                     }
                 }
-                if (!name.empty()) {
-                    computer->eventQueue.push(name);
-                    if (!lua_checkstack(computer->paramQueue, 1)) luaL_error(L, "Could not allocate space for event");
-                    param = lua_newthread(computer->paramQueue);
-                }
+                if (!name.empty() && !queue->pushEvent(name, param, lua_gettop(param))) luaL_error(L, "Could not allocate space for event");
             }
-            if (computer->eventQueue.empty()) {
-                std::mutex m;
-                std::unique_lock<std::mutex> l(m);
-                while (computer->running == 1 && !termHasEvent(computer)) 
-                    computer->event_lock.wait_for(l, std::chrono::seconds(5), [computer]()->bool{return termHasEvent(computer) || computer->running != 1;});
+            if (queue->empty()) {
+                if (!wait) return computer->running == 1 ? -1 : 0;
+                std::unique_lock<std::mutex> lock(queue->waitMutex);
+                queue->setWaiting(true);
+                while (computer->running == 1 && !termHasEvent(computer))
+                    computer->event_lock.wait_for(lock, std::chrono::seconds(5));
+                queue->setWaiting(false);
                 if (computer->running != 1) return 0;
             }
-        } while (computer->eventQueue.empty());
-        ev = computer->eventQueue.front();
-        computer->eventQueue.pop();
-        if (!filter.empty() && ev != filter && ev != "terminate") lua_remove(computer->paramQueue, 1);
-        lua_pop(computer->paramQueue, 1);
+        } while (queue->empty());
+        ev = &queue->front();
+        if (filter.empty() || *ev == filter || *ev == "terminate") break;
+        queue->popEvent(NULL);
         std::this_thread::yield();
-    } while (!filter.empty() && ev != filter && ev != "terminate");
-    //printf("%zd\n", computer->eventQueue.size());
-    if ((size_t)lua_gettop(computer->paramQueue) != computer->eventQueue.size() + 1) {
-        fprintf(stderr, "Warning: Queue sizes are incorrect! Expect misaligned event parameters.\n");
-    }
-    param = lua_tothread(computer->paramQueue, 1);
-    if (param == NULL) {
-        fprintf(stderr, "Queue item is not a thread for event \"%s\"!\n", ev.c_str()); 
-        if (lua_gettop(computer->paramQueue) > 0) lua_remove(computer->paramQueue, 1);
-        return 0;
-    }
-    const int count = lua_gettop(param);
+    } while (true);
+    const int count = queue->frontParams();
     if (!lua_checkstack(L, count + 1)) {
-        fprintf(stderr, "Could not allocate enough space in the stack for %d elements, skipping event \"%s\"\n", count, ev.c_str());
-        if (lua_gettop(computer->paramQueue) > 0) lua_remove(computer->paramQueue, 1);
+        fprintf(stderr, "Could not allocate enough space in the stack for %d elements, skipping event \"%s\"\n", count, ev->c_str());
+        queue->popEvent(NULL);
         return 0;
     }
-    lua_pushstring(L, ev.c_str());
-    lua_xmove(param, L, count);
-    lua_remove(computer->paramQueue, 1);
+    lua_pushstring(L, ev->c_str());
+    queue->popEvent(L);
     if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - computer->last_event).count() > 200) {
-#ifdef __EMSCRIPTEN__
-        queueTask([computer](void*)->void*{
-#endif
-        if (computer->eventTimeout != 0) SDL_RemoveTimer(computer->eventTimeout);
-        if (config.abortTimeout > 0 || config.standardsMode) computer->eventTimeout = SDL_AddTimer(config.standardsMode ? 7000 : config.abortTimeout, eventTimeoutEvent, computer);
-#ifdef __EMSCRIPTEN__
-        return NULL;}, NULL);
-#endif
+        if (computer->eventTimeout != 0) cancelTimer(computer, computer->eventTimeout);
+        if (config.abortTimeout > 0 || config.standardsMode) computer->eventTimeout = addTimer(computer, config.standardsMode ? 7000 : config.abortTimeout, eventTimeoutEvent, computer);
         computer->last_event = std::chrono::high_resolution_clock::now();
     }
     computer->getting_event = false;
@@ -321,7 +305,7 @@ bool addMount(Computer *comp, const path_t& real_path, const std::string& comp_p
     }
 #endif
     std::error_code e;
-    if (std::regex_search((*real_path.begin()).native(), std::basic_regex<path_t::value_type>(path_t("^\\d+:").native()))) return false;
+    if (isVFSPath(*real_path.begin())) return false;
     if (!fs::is_directory(real_path, e) || access(real_path.c_str(), R_OK | (read_only ? 0 : W_OK)) != 0) return false;
     std::vector<std::string> elems = split(comp_path, "/\\");
     std::list<std::string> pathc;
@@ -394,6 +378,7 @@ bool addMount(Computer *comp, const path_t& real_path, const std::string& comp_p
         if (!selected) return false;
     }
     comp->mounts.push_back(std::make_tuple(std::list<std::string>(pathc), real_path, read_only));
+    invalidateMountCache(comp);
     if (comp->debugger && !comp->isDebugger) ((debugger*)comp->debugger)->resetMounts();
     return true;
 }
@@ -425,10 +410,11 @@ bool addVirtualMount(Computer * comp, const FileEntry& vfs, const std::string& c
             else if (!std::isdigit(c)) {end = -1; break;}
             end++;
         }
-        if (end > 0 && std::get<0>(v) == pathc && comp->virtualMounts[std::stoi(path.native().substr(0, end))] != NULL && *comp->virtualMounts[std::stoi(path.native().substr(0, end))] == vfs) return false;
+        if (end > 0 && std::get<0>(v) == pathc && comp->virtualMounts[std::stoi(path.native().substr(0, end))] != NULL && (comp->virtualMounts[std::stoi(path.native().substr(0, end))] == &vfs || *comp->virtualMounts[std::stoi(path.native().substr(0, end))] == vfs)) return false;
     }
     comp->virtualMounts[idx] = &vfs;
     comp->mounts.push_back(std::make_tuple(std::list<std::string>(pathc), path_t(std::to_string(idx) + ":", path_t::format::generic_format), true));
+    invalidateMountCache(comp);
     return true;
 }
 
@@ -27,7 +27,6 @@ struct TaskQueueItem {
 };
 
 extern ProtectedObject<std::vector<Computer*> > computers;
-extern ProtectedObject<std::unordered_set<SDL_TimerID> > freedTimers;
 extern ProtectedObject<std::queue<TaskQueueItem*> > taskQueue;
 extern bool exiting;
 extern int selectedRenderer;
@@ -42,14 +41,16 @@ extern bool listenerMode;
 extern std::mutex listenerModeMutex;
 extern std::condition_variable listenerModeNotify;
 
-extern int getNextEvent(lua_State* L, const std::string& filter);
+extern int getNextEvent(lua_State* L, const std::string& filter, bool wait = true);
 extern void* queueTask(const std::function<void*(void*)>& func, void* arg, bool async = false);
 extern void runComputer(Computer * self, const path_t& bios_name, const std::string& bios_data = "");
+extern void freeAllocators(Computer * self);
 extern bool Computer_getEvent(Computer * self, SDL_Event* e);
-extern Uint32 eventTimeoutEvent(Uint32 interval, void* param);
+extern Uint32 eventTimeoutEvent(Uint32 interval, SDL_TimerID id, void* owner, void* param);
 extern void* computerThread(void* data);
 extern Computer* startComputer(int id);
 extern void queueEvent(Computer *comp, const event_provider& p, void* data);
+extern void wakeComputer(Computer *comp);
 extern bool addMount(Computer *comp, const path_t& real_path, const std::string& comp_path, bool read_only);
 extern bool addVirtualMount(Computer * comp, const FileEntry& vfs, const std::string& comp_path);
 extern void registerPeripheral(const std::string& name, const peripheral_init_fn& initializer);
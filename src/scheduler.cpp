@@ -0,0 +1,116 @@
+/*
+ * scheduler.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the computer scheduler. Instead of giving every
+ * computer its own thread, computers are split into slices that run until the
+ * computer waits for an event, and a fixed number of worker threads take
+ * runnable computers from a FIFO run queue. A computer that's waiting parks
+ * itself without holding a thread, and is put back in the queue by its event
+ * queue when the next event arrives. Computers can only be switched out when
+ * they yield, so a computer that runs for longer than its time slice goes to
+ * the back of the queue at its next yield, and one that never yields is
+ * stopped by the usual abort timeout.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <configuration.hpp>
+#include "eventqueue.hpp"
+#include "platform.hpp"
+#include "scheduler.hpp"
+
+#ifdef __ANDROID__
+extern "C" {extern int Android_JNI_SetupThread(void);}
+#endif
+
+static std::mutex schedulerMutex;
+static std::condition_variable schedulerNotify;
+static std::deque<computer_task*> runQueue;
+static std::unordered_map<Computer*, computer_task*> tasks;
+static std::vector<std::thread*> workers;
+static bool schedulerStopping = false;
+
+static void workerThread() {
+#ifdef __ANDROID__
+    Android_JNI_SetupThread();
+#endif
+    // seed the Lua RNG
+    srand(std::chrono::high_resolution_clock::now().time_since_epoch().count() & UINT_MAX);
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    while (true) {
+        schedulerNotify.wait(lock, []()->bool {return !runQueue.empty() || (schedulerStopping && tasks.empty());});
+        if (runQueue.empty()) break;
+        computer_task * task = runQueue.front();
+        runQueue.pop_front();
+        lock.unlock();
+        Computer * comp = task->comp;
+        comp->event_queue_ctx->taskState = TASK_RUNNING;
+        // Once the computer's parked, another worker may pick it up at any time, so don't touch it after that
+        const int state = runComputerSlice(task);
+        if (state == TASK_IDLE) {
+            lock.lock();
+            continue;
+        } else if (state == TASK_QUEUED) {
+            comp->event_queue_ctx->taskState = TASK_QUEUED;
+            lock.lock();
+            runQueue.push_back(task);
+            continue;
+        }
+        lock.lock();
+        tasks.erase(comp);
+        delete task;
+        if (tasks.empty()) schedulerNotify.notify_all();
+        lock.unlock();
+        removeComputer(comp);
+        lock.lock();
+    }
+}
+
+void startComputerTask(Computer * comp) {
+    computer_task * task = new computer_task;
+    task->comp = comp;
+    comp->event_queue_ctx->taskState = TASK_QUEUED;
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    if (workers.empty()) {
+        schedulerStopping = false;
+        for (int i = 0; i < config.schedulerThreads; i++) {
+            std::thread * th = new std::thread(workerThread);
+            setThreadName(*th, "Computer Worker " + std::to_string(i));
+            workers.push_back(th);
+        }
+    }
+    tasks[comp] = task;
+    runQueue.push_back(task);
+    schedulerNotify.notify_one();
+}
+
+void scheduleComputer(Computer * comp) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    const auto it = tasks.find(comp);
+    if (it == tasks.end()) return;
+    runQueue.push_back(it->second);
+    schedulerNotify.notify_one();
+}
+
+void stopScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        schedulerStopping = true;
+        schedulerNotify.notify_all();
+    }
+    for (std::thread * th : workers) {
+        if (th->joinable()) th->join();
+        delete th;
+    }
+    workers.clear();
+}
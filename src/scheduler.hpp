@@ -0,0 +1,51 @@
+/*
+ * scheduler.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions for the computer scheduler, which runs
+ * computers as tasks on a fixed pool of worker threads when the
+ * schedulerThreads option is set.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+#include <Computer.hpp>
+
+#define TASK_TIME_SLICE 20 // milliseconds a computer may keep a worker before going to the back of the queue
+
+enum {
+    TASK_PHASE_BOOT,    // needs a new Lua state
+    TASK_PHASE_RESUME,  // ready to be resumed with narg values
+    TASK_PHASE_WAIT,    // waiting for the next event
+    TASK_PHASE_STOPPED, // shut down, terminal needs to be cleared
+    TASK_PHASE_FAILED,  // shut down, deciding whether to wait for a restart
+    TASK_PHASE_RESTART  // waiting for the user to restart the computer
+};
+
+// The state of a computer that's running on the worker pool.
+struct computer_task {
+    Computer * comp;
+    int phase = TASK_PHASE_BOOT;
+    int narg = 0;
+    bool started = false;
+    bool restartShown = false;
+};
+
+// Starts running a new computer on the worker pool, starting the pool if necessary.
+extern void startComputerTask(Computer * comp);
+
+// Puts a parked computer back in the run queue. Called from EventQueue once an event arrives.
+extern void scheduleComputer(Computer * comp);
+
+// Waits for all computers on the pool to exit, then stops the worker threads.
+extern void stopScheduler();
+
+// Implemented in Computer.cpp.
+// Runs a computer until it parks (returns TASK_IDLE), uses up its time slice (TASK_QUEUED), or exits (-1).
+extern int runComputerSlice(computer_task * task);
+extern void removeComputer(Computer * comp);
+
+#endif
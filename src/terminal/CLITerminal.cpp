@@ -96,7 +96,7 @@ bool CLITerminal::drawChar(char c, int x, int y, Color fg, Color bg, bool transp
 }
 
 void CLITerminal::render() {
-    if (forceRender) changed = true;
+    if (forceRender) markAllDirty();
     if (gotResizeEvent) {
         gotResizeEvent = false;
         this->screen.resize(newWidth, newHeight, ' ');
@@ -104,15 +104,15 @@ void CLITerminal::render() {
         this->pixels.resize(newWidth * fontWidth, newHeight * fontHeight, 0x0F);
         this->width = newWidth;
         this->height = newHeight;
-        changed = true;
+        markAllDirty();
     }
-    if (changed) {
-        changed = false;
+    if (needsRedraw()) {
         std::lock_guard<std::mutex> locked_g(locked);
+        takeDamage(frameDamage);
         move(0, 0);
-        if (stopRender) {stopRender = false; return;}
-        clear();
-        if (stopRender) {stopRender = false; return;}
+        if (stopRender) {stopRender = false; markAllDirty(); return;}
+        if (frameDamage.full) clear();
+        if (stopRender) {stopRender = false; markAllDirty(); return;}
         if (can_change_color()) {
             unsigned short checksum = grayscale;
             for (int i = 0; i < 48; i++) 
@@ -129,7 +129,9 @@ void CLITerminal::render() {
             lastPaletteChecksum = checksum;
         }
         for (unsigned y = 0; y < height; y++) {
+            if (!frameDamage.row(y)) continue;
             for (unsigned x = 0; x < width; x++) {
+                if (!frameDamage.cell(x, y)) continue;
                 move(y, x);
                 wchar_t ch[2] = {charsetConversion[screen[y][x]], 0};
                 if (ch[0] < 0x20) ch[0] = 0x20;
@@ -140,15 +142,15 @@ void CLITerminal::render() {
 #else
                 addch((ch[0] < 0x100 ? ch[0] : '?') | COLOR_PAIR(colors[y][x]));
 #endif
-                if (stopRender) {stopRender = false; return;}
+                if (stopRender) {stopRender = false; markAllDirty(); return;}
             }
         }
         renderNavbar(title);
-        if (stopRender) {stopRender = false; return;}
+        if (stopRender) {stopRender = false; markAllDirty(); return;}
         move(blinkY, blinkX);
-        if (stopRender) {stopRender = false; return;}
+        if (stopRender) {stopRender = false; markAllDirty(); return;}
         curs_set(canBlink);
-        if (stopRender) {stopRender = false; return;}
+        if (stopRender) {stopRender = false; markAllDirty(); return;}
         refresh();
     }
 }
@@ -207,7 +209,7 @@ static void pressControl(int sig) {
             e.type = SDL_KEYUP;
             e.key.keysym.sym = (SDL_Keycode)29;
             c->termEventQueue.push(e);
-            c->event_lock.notify_all();
+            wakeComputer(c);
         }
     }
 }
@@ -225,7 +227,7 @@ static void pressAlt(int sig) {
             e.type = SDL_KEYUP;
             e.key.keysym.sym = (SDL_Keycode)56;
             c->termEventQueue.push(e);
-            c->event_lock.notify_all();
+            wakeComputer(c);
         }
     }
 }
@@ -313,7 +315,7 @@ void CLITerminal::quit() {
             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);\
             e.TYPE.windowID = c->term->id;\
             c->termEventQueue.push(e);\
-            c->event_lock.notify_all();\
+            wakeComputer(c);\
         }\
     }}
 
@@ -352,9 +354,9 @@ bool CLITerminal::pollEvents() {
             e.window.data1 = COLS;
             e.window.data2 = LINES - 1;
             e.window.windowID = c->term->id;
-            c->term->changed = true;
+            c->term->markAllDirty();
             c->termEventQueue.push(e);
-            c->event_lock.notify_all();
+            wakeComputer(c);
         }
     }
     pumpTaskQueue();
@@ -375,7 +377,7 @@ bool CLITerminal::pollEvents() {
                                 std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                                 e.button.windowID = (*renderTarget)->id;
                                 c->termEventQueue.push(e);
-                                c->event_lock.notify_all();
+                                wakeComputer(c);
                             }
                         }
                         for (Terminal * t : orphanedTerminals) {
@@ -21,6 +21,7 @@ class CLITerminal: public Terminal {
     friend void pressControl(int sig);
     friend void pressAlt(int sig);
     unsigned last_pair;
+    TerminalDamage frameDamage;
     static unsigned short lastPaletteChecksum;
 public:
     static void init();
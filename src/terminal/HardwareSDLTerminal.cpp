@@ -14,6 +14,7 @@
 #include "RawTerminal.hpp"
 #include "../gif.hpp"
 #include "../main.hpp"
+#include "../rompack.hpp"
 #include "../runtime.hpp"
 #include "../termsupport.hpp"
 #ifndef NO_WEBP
@@ -119,6 +120,7 @@ HardwareSDLTerminal::HardwareSDLTerminal(std::string title): SDLTerminal(title)
 }
 
 HardwareSDLTerminal::~HardwareSDLTerminal() {
+    if (screentex != NULL) SDL_DestroyTexture(screentex);
     if (!singleWindowMode || renderTargets.size() == 1) {
         if (pixtex != NULL) SDL_DestroyTexture(pixtex);
         if (font != NULL) SDL_DestroyTexture(font);
@@ -139,15 +141,7 @@ bool HardwareSDLTerminal::drawChar(unsigned char c, int x, int y, Color fg, Colo
         (int)(fontWidth * charScale * dpiScale), 
         (int)(fontHeight * charScale * dpiScale)
     };
-    SDL_Rect bgdestrect = destrect;
-    if (config.standardsMode || config.extendMargins) {
-        if (x == 0) bgdestrect.x -= (int)(2 * charScale * dpiScale);
-        if (y == 0) bgdestrect.y -= (int)(2 * charScale * dpiScale);
-        if (x == 0 || (unsigned)x == width - 1) bgdestrect.w += (int)(2 * charScale * dpiScale);
-        if (y == 0 || (unsigned)y == height - 1) bgdestrect.h += (int)(2 * charScale * dpiScale);
-        if ((unsigned)x == width - 1) bgdestrect.w += realWidth - (int)(width*charWidth*dpiScale+(4 * charScale * dpiScale));
-        if ((unsigned)y == height - 1) bgdestrect.h += realHeight - (int)(height*charHeight*dpiScale+(4 * charScale * dpiScale));
-    }
+    SDL_Rect bgdestrect = cellBackgroundRect(x, y);
     if (!transparent && bg != palette[15]) {
         if (gotResizeEvent) return false;
         bg = grayscalify(bg);
@@ -181,11 +175,8 @@ static unsigned char circlePix[] = {
 };
 
 void HardwareSDLTerminal::render() {
-    // copy the screen data so we can let Lua keep going without waiting for the mutex
-    std::unique_ptr<vector2d<unsigned char> > newscreen;
-    std::unique_ptr<vector2d<unsigned char> > newcolors;
-    std::unique_ptr<vector2d<unsigned char> > newpixels;
-    Color newpalette[256];
+    // copy the modified parts of the screen into the snapshot so we can let Lua keep going without waiting for the mutex
+    const Color * newpalette = snapshot.palette;
     unsigned newwidth, newheight, newcharWidth, newcharHeight, newfontScale, newcharScale;
     int newblinkX, newblinkY, newmode;
     bool newblink, newuseOrigFont;
@@ -199,52 +190,86 @@ void HardwareSDLTerminal::render() {
                 this->screen.resize(newWidth, newHeight, ' ');
                 this->colors.resize(newWidth, newHeight, 0xF0);
                 this->pixels.resize(newWidth * fontWidth, newHeight * fontHeight, 0x0F);
-                changed = true;
-            } else changed = false;
+                markAllDirty();
+            } else changed = damaged = false;
             this->width = newWidth;
             this->height = newHeight;
             gotResizeEvent = false;
         }
-        if ((!changed && !shouldScreenshot && !shouldRecord) || width == 0 || height == 0) return;
-        newscreen = std::make_unique<vector2d<unsigned char> >(screen);
-        newcolors = std::make_unique<vector2d<unsigned char> >(colors);
-        newpixels = std::make_unique<vector2d<unsigned char> >(pixels);
-        memcpy(newpalette, palette, sizeof(newpalette));
+        if ((!needsRedraw() && !shouldScreenshot && !shouldRecord) || width == 0 || height == 0) return;
+        takeFrame(snapshot, frameDamage);
         newblinkX = blinkX; newblinkY = blinkY; newmode = mode;
         newblink = blink; newuseOrigFont = useOrigFont;
         newwidth = width; newheight = height; newcharWidth = charWidth; newcharHeight = charHeight; newfontScale = fontScale; newcharScale = charScale;
         newcursorColor = cursorColor;
-        changed = false;
     }
     std::lock_guard<std::mutex> rlock(renderlock);
+    // the textures are shared between all terminals in single window mode, so they can't keep the previous frame
+    // if the last frame was interrupted, parts of the textures may still be stale
+    if (singleWindowMode || incompleteFrame) frameDamage.full = true;
+    incompleteFrame = true;
     Color bgcolor = newmode == 0 ? newpalette[15] : defaultPalette[15];
-    if (SDL_SetRenderDrawColor(ren, bgcolor.r, bgcolor.g, bgcolor.b, 0xFF) != 0) return;
-    if (SDL_RenderClear(ren) != 0) return;
     SDL_Rect rect;
     if (newmode != 0) {
-        void * pixels = NULL;
-        int pitch = 0;
-        SDL_LockTexture(pixtex, setRect(&rect, 0, 0, (int)(newwidth * newcharWidth * dpiScale), (int)(newheight * newcharHeight * dpiScale)), &pixels, &pitch);
-        SDL_Surface * surf = SDL_CreateRGBSurfaceWithFormatFrom(pixels, (int)(newwidth * newcharWidth * dpiScale), (int)(newheight * newcharHeight * dpiScale), 24, pitch, SDL_PIXELFORMAT_RGB888);
-        for (unsigned y = 0; y < newheight * newcharHeight * dpiScale; y+=newcharScale*dpiScale) {
-            for (unsigned x = 0; x < newwidth * newcharWidth * dpiScale; x+=newcharScale*dpiScale) {
-                unsigned char c = (*newpixels)[y / newcharScale / dpiScale][x / newcharScale / dpiScale];
-                if (gotResizeEvent) return;
-                if (SDL_FillRect(surf, setRect(&rect, (int)x, (int)y, (int)(newcharScale * dpiScale), (int)(newcharScale * dpiScale)), rgb(newpalette[(int)c])) != 0) return;
-            }
+        if (SDL_SetRenderDrawColor(ren, bgcolor.r, bgcolor.g, bgcolor.b, 0xFF) != 0) return;
+        if (SDL_RenderClear(ren) != 0) return;
+        // streaming textures are write-only, so the whole damaged rectangle has to be rewritten
+        unsigned left = 0, top = 0, right = newwidth, bottom = newheight;
+        if (!frameDamage.full) {
+            left = frameDamage.left; top = frameDamage.top;
+            right = frameDamage.right; bottom = frameDamage.bottom;
+        }
+        if (right > left && bottom > top) {
+            const unsigned pixelScale = newcharScale * dpiScale;
+            void * pixels = NULL;
+            int pitch = 0;
+            if (SDL_LockTexture(pixtex, setRect(&rect, (int)(left * newcharWidth * dpiScale), (int)(top * newcharHeight * dpiScale), (int)((right - left) * newcharWidth * dpiScale), (int)((bottom - top) * newcharHeight * dpiScale)), &pixels, &pitch) != 0) return;
+            uint32_t lut[256];
+            makePixelLUT(newpalette, lut);
+            const unsigned pixelWidth = newwidth * fontWidth;
+            blitPixels(snapshot.pixels.data() + (size_t)top * fontHeight * pixelWidth + left * fontWidth, pixelWidth, (right - left) * fontWidth, (bottom - top) * fontHeight, lut, pixelScale, (uint8_t*)pixels, pitch);
+            SDL_UnlockTexture(pixtex);
         }
-        SDL_UnlockTexture(pixtex);
         SDL_RenderCopy(ren, pixtex, NULL, setRect(&rect, (int)(2 * newcharScale * dpiScale), (int)(2 * newcharScale * dpiScale), (int)(newwidth * newcharWidth * dpiScale), (int)(newheight * newcharHeight * dpiScale)));
     } else {
+        // draw into a persistent target texture so only the damaged cells need to be redrawn
+        int ow = 0, oh = 0;
+        if (!singleWindowMode && SDL_RenderTargetSupported(ren) && SDL_GetRendererOutputSize(ren, &ow, &oh) == 0) {
+            int tw = 0, th = 0;
+            if (screentex != NULL) SDL_QueryTexture(screentex, NULL, NULL, &tw, &th);
+            if (screentex == NULL || tw != ow || th != oh) {
+                if (screentex != NULL) SDL_DestroyTexture(screentex);
+                screentex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_TARGET, ow, oh);
+                frameDamage.full = true;
+            }
+        }
+        if (screentex == NULL) frameDamage.full = true;
+        else if (SDL_SetRenderTarget(ren, screentex) != 0) return;
+        if (SDL_SetRenderDrawColor(ren, bgcolor.r, bgcolor.g, bgcolor.b, 0xFF) != 0) return;
+        if (frameDamage.full && SDL_RenderClear(ren) != 0) return;
         for (unsigned y = 0; y < newheight; y++) {
+            if (!frameDamage.row(y)) continue;
             for (unsigned x = 0; x < newwidth; x++) {
+                if (!frameDamage.cell(x, y)) continue;
                 if (gotResizeEvent) return;
-                if (!drawChar((*newscreen)[y][x], (int)x, (int)y, newpalette[(*newcolors)[y][x] & 0x0F], newpalette[(*newcolors)[y][x] >> 4])) return;
+                if (!frameDamage.full) {
+                    // partial updates draw over the previous frame, so the cell needs to be cleared first
+                    rect = cellBackgroundRect(x, y);
+                    if (SDL_SetRenderDrawColor(ren, bgcolor.r, bgcolor.g, bgcolor.b, 0xFF) != 0) return;
+                    if (SDL_RenderFillRect(ren, &rect) != 0) return;
+                }
+                if (!drawChar(snapshot.screen[y][x], (int)x, (int)y, newpalette[snapshot.colors[y][x] & 0x0F], newpalette[snapshot.colors[y][x] >> 4])) return;
             }
         }
         if (gotResizeEvent) return;
-        if (newblink && newblinkX >= 0 && newblinkY >= 0 && (unsigned)newblinkX < newwidth && (unsigned)newblinkY < newheight) if (!drawChar('_', newblinkX, newblinkY, newpalette[newcursorColor], newpalette[(*newcolors)[newblinkY][newblinkX] >> 4], true)) return;
+        if (newblink && newblinkX >= 0 && newblinkY >= 0 && (unsigned)newblinkX < newwidth && (unsigned)newblinkY < newheight && frameDamage.cell(newblinkX, newblinkY))
+            if (!drawChar('_', newblinkX, newblinkY, newpalette[newcursorColor], newpalette[snapshot.colors[newblinkY][newblinkX] >> 4], true)) return;
+        if (screentex != NULL) {
+            if (SDL_SetRenderTarget(ren, NULL) != 0) return;
+            if (SDL_RenderCopy(ren, screentex, NULL, NULL) != 0) return;
+        }
     }
+    incompleteFrame = false;
     currentFPS++;
     if (lastSecond != time(0)) {
         lastSecond = (int)time(0);
@@ -398,6 +423,7 @@ bool HardwareSDLTerminal::resize(unsigned w, unsigned h) {
         ren = (SDL_Renderer*)queueTask([](void*win)->void*{return SDL_CreateRenderer((SDL_Window*)win, -1, SDL_RENDERER_ACCELERATED | (config.useVsync ? SDL_RENDERER_PRESENTVSYNC : 0));}, win);
 #endif
         font = SDL_CreateTextureFromSurface(ren, useOrigFont ? origfont : bmp);
+        screentex = NULL; // destroyed along with the old renderer
         pixtex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, (int)(w * charWidth * dpiScale), (int)(h * charHeight * dpiScale));
 #ifdef __APPLE__
         queueTask([this](void*)->void*{SDL_SetWindowSize(win, realWidth, realHeight); return NULL;}, NULL);
@@ -428,9 +454,11 @@ void HardwareSDLTerminal::init() {
     setThreadName(*renderThread, "Render Thread");
     SDL_Surface* old_bmp;
     std::string bmp_path = "built-in file";
+    const char * packed_font = NULL;
+    size_t packed_font_size = 0;
 #ifndef STANDALONE_ROM
     if (config.customFontPath == "hdfont") {
-        bmp_path = (getROMPath() / "hdfont.bmp").string();
+        if (!getROMPackFile("hdfont.bmp", &packed_font, &packed_font_size)) bmp_path = (getROMPath() / "hdfont.bmp").string();
         fontScale = 1;
     } else 
 #endif
@@ -440,6 +468,7 @@ void HardwareSDLTerminal::init() {
     }
     if (config.customFontPath.empty()) 
         old_bmp = SDL_CreateRGBSurfaceWithFormatFrom((void*)font_image.pixel_data, (int)font_image.width, (int)font_image.height, (int)font_image.bytes_per_pixel * 8, (int)font_image.bytes_per_pixel * (int)font_image.width, SDL_PIXELFORMAT_RGB565);
+    else if (packed_font != NULL) old_bmp = SDL_LoadBMP_RW(SDL_RWFromConstMem(packed_font, (int)packed_font_size), 1);
     else old_bmp = SDL_LoadBMP(bmp_path.c_str());
     if (old_bmp == (SDL_Surface*)0) {
         throw std::runtime_error("Failed to load font: " + std::string(SDL_GetError()));
@@ -494,6 +523,10 @@ bool HardwareSDLTerminal::pollEvents() {
                 break;
             }
         }
+        if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) {
+            // the contents of the target textures were lost, so everything needs to be redrawn
+            for (Terminal* term : renderTargets) term->markAllDirty();
+        }
         if (e.type == task_event_type) pumpTaskQueue();
         else if (e.type == render_event_type) {
             if (singleWindowMode) {
@@ -522,14 +555,14 @@ bool HardwareSDLTerminal::pollEvents() {
                 e.window.windowID = c->term->id;
                 std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                 c->termEventQueue.push(e);
-                c->event_lock.notify_all();
+                wakeComputer(c);
                 std::lock_guard<std::mutex> lock2(c->peripherals_mutex);
                 for (const std::pair<std::string, peripheral*> p : c->peripherals) {
                     monitor * m = dynamic_cast<monitor*>(p.second);
                     if (m != NULL) {
                         e.window.windowID = m->term->id;
                         c->termEventQueue.push(e);
-                        c->event_lock.notify_all();
+                        wakeComputer(c);
                     }
                 }
             }
@@ -574,7 +607,7 @@ bool HardwareSDLTerminal::pollEvents() {
                             (e.type == SDL_WINDOWEVENT && checkWindowID(c, e.window.windowID)) ||
                             e.type == SDL_QUIT) {
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                             if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE && e.window.windowID == c->term->id) {
                                 if (c->requestedExit && c->L) {
                                     SDL_MessageBoxData msg;
@@ -27,6 +27,7 @@ private:
     SDL_Renderer *ren = NULL;
     SDL_Texture *font = NULL;
     SDL_Texture *pixtex = NULL;
+    SDL_Texture *screentex = NULL; // Holds the last text mode frame so only damaged cells need to be redrawn
     static SDL_Renderer *singleRen;
     static SDL_Texture *singleFont;
     static SDL_Texture *singlePixtex;
@@ -13,6 +13,10 @@
 #include <iostream>
 #include <sstream>
 #include <Poco/Checksum.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 #include "RawTerminal.hpp"
 #include "SDLTerminal.hpp"
 #include "../apis.hpp"
@@ -40,6 +44,27 @@ Note: As of version 1.1, headers for payloads >65535 bytes in size will have the
   0x00       4          Header ("!CPD")
   0x04       12         Size (hex string)
 
+Once binary framing has been negotiated (extended flag 1 of Type 6), both sides send every packet except Type 6 in this
+format instead, with no Base64 encoding, checksum footer or newline:
+
+  Offset     Bytes      Purpose
+  0x00       4          Header ("!CPB")
+  0x04       4          Payload size (little endian)
+  0x08       *x*        Payload
+  0x08+x     4          CRC32 of payload (little endian)
+
+Frames with payloads over 64 MiB are rejected, and the receiver skips ahead to the next header.
+
+If compression has been negotiated (extended flag 2 of Type 6), the server may compress Type 0 and Type 10 packets.
+Compressed packets have bit 7 of the frame type ID set, and the payload continues as follows:
+
+  Offset     Bytes      Purpose
+  0x02       1          Compression flags: bit 0 = the window's deflate stream was restarted at this packet
+  0x03       *x*        Raw deflate data, ending with a sync flush, that inflates to the rest of the payload
+
+Each window has its own deflate stream, which is kept across packets. If a client fails to inflate a packet, it SHOULD
+send a Type 10 resynchronization request; the server will restart the stream with its next keyframe.
+
 * Type 0: Terminal contents (server -> client)
 
   Offset     Bytes      Purpose
@@ -50,7 +75,8 @@ Note: As of version 1.1, headers for payloads >65535 bytes in size will have the
   0x08       2          Cursor X
   0x0A       2          Cursor Y
   0x0C       1          Grayscale? (1 = grayscale, 0 = color) -- if grayscale, render colors with (r + g + b) / 3
-  0x0D       3          Reserved
+  0x0D       1          Reserved
+  0x0E       2          Frame sequence number if delta frames are in use (see Type 10), otherwise reserved
   ===================== Screen data
   --------------------- Text mode (mode 0)
   0x10       *x*        RLE-encoded text (length of expanded RLE = width * height)
@@ -124,7 +150,10 @@ Note: As of version 1.1, headers for payloads >65535 bytes in size will have the
                         2-14: Currently reserved, set to 0
                         15: Set if the extended flags are present
   [0x04]    [4]         Extended flags as a bitfield - only available if bit 15 of standard flags is set
-                        0-31: Currently reserved, set to 0
+                        0: Delta frame support (Type 10)
+                        1: Binary framing support (see Common Header)
+                        2: Compressed payload support (see Common Header)
+                        3-31: Currently reserved, set to 0
 
 When a client supporting Type 6 packets connects to a server, it SHOULD send a Type 6 packet with its capabilities.
 If a server receives a Type 6 packet and knows about its existence, it MUST send back a packet specifying its capabilities.
@@ -191,6 +220,51 @@ Once the server sends back a response, both the server and client MUST communica
 
 == End filesystem support extension ==
 
+== Delta frame extension ==
+
+* Type 10: Terminal contents delta (server -> client)
+
+  Offset     Bytes      Purpose
+  0x02       1          Graphics mode
+  0x03       1          Cursor blinking?
+  0x04       2          Width
+  0x06       2          Height
+  0x08       2          Cursor X
+  0x0A       2          Cursor Y
+  0x0C       1          Grayscale?
+  0x0D       1          Reserved
+  0x0E       2          Frame sequence number
+  0x10       2          Sequence number of the frame this delta applies to
+  0x12       2          Number of row spans
+  ===================== Row spans
+  0x00       2          Row (character row in mode 0, pixel row in modes 1/2)
+  0x02       2          Start column (character in mode 0, pixel in modes 1/2)
+  0x04       2          Length of span (n)
+  --------------------- Text mode (mode 0)
+  0x06       n          Text
+  0x06+n     n          Colors (high nybble = BG, low nybble = FG)
+  --------------------- Graphics modes (modes 1/2)
+  0x06       n          Pixel data
+  ===================== End row spans
+  0x00       2          Number of changed palette entries
+  ===================== Palette entries
+  0x00       1          Palette index
+  0x01       3          RGB color
+  ===================== End palette entries
+
+* Type 10: Delta resynchronization request (client -> server)
+
+  Offset     Bytes      Purpose
+  0x02       2          Sequence number of the last frame the client applied
+
+When delta frames are negotiated, every Type 0 packet is a keyframe carrying its sequence number, and the server may then
+send Type 10 packets containing only the spans that changed since the previous frame. The graphics mode, size and
+grayscale flag of a delta always match its base frame; the server sends a keyframe when any of those change, and
+periodically to recover from lost frames. If a client receives a delta whose base is not the last frame it applied, it
+MUST ignore it and SHOULD send a resynchronization request, after which the server will send a keyframe.
+
+== End delta frame extension ==
+
 * Common Footer
 
   ===================== End Base64 payload
@@ -209,15 +283,121 @@ static std::thread * inputThread;
 static bool isVersion1_1 = false;
 static std::string fileWriteRequests[256];
 
-static void sendRawData(const uint8_t type, const uint8_t id, const std::function<void(std::ostream&)>& callback) {
-    std::stringstream output;
+// Stream buffer that appends everything written to a string, so binary frames can be built in place.
+class RawPacketBuffer: public std::streambuf {
+public:
+    std::string data;
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) data.push_back(traits_type::to_char_type(c));
+        return c;
+    }
+    std::streamsize xsputn(const char * s, std::streamsize n) override {
+        data.append(s, (size_t)n);
+        return n;
+    }
+};
+
+void setRawBinaryMode() {
+#ifdef _WIN32
+    // binary frames must not have LF -> CRLF conversion applied
+    _setmode(0, _O_BINARY);
+    _setmode(1, _O_BINARY);
+#endif
+}
+
+RawDeflater::RawDeflater(int level): level(level) {
+    memset(&strm, 0, sizeof(strm));
+    deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+}
+
+RawDeflater::~RawDeflater() {
+    deflateEnd(&strm);
+}
+
+void RawDeflater::compress(std::string& packet, size_t offset) {
+    if (reset) deflateReset(&strm);
+    if (config.rawCompressionLevel != level && config.rawCompressionLevel > 0 && config.rawCompressionLevel <= 9) {
+        level = config.rawCompressionLevel;
+        deflateParams(&strm, level, Z_DEFAULT_STRATEGY);
+    }
+    // each packet ends with a sync flush, so it can be decoded as soon as it arrives
+    strm.next_in = (Bytef*)&packet[offset + 2];
+    strm.avail_in = (uInt)(packet.size() - offset - 2);
+    out.resize(deflateBound(&strm, strm.avail_in) + 16);
+    size_t used = 0;
+    for (;;) {
+        strm.next_out = (Bytef*)&out[used];
+        strm.avail_out = (uInt)(out.size() - used);
+        deflate(&strm, Z_SYNC_FLUSH);
+        used = out.size() - strm.avail_out;
+        if (strm.avail_out > 0) break;
+        out.resize(out.size() * 2);
+    }
+    packet.resize(offset + 3);
+    packet[offset] |= CCPC_RAW_COMPRESSED_TYPE;
+    packet[offset + 2] = reset ? CCPC_RAW_COMPRESSED_RESET : 0;
+    packet.append(out, 0, used);
+    reset = false;
+}
+
+RawInflater::RawInflater() {
+    memset(&strm, 0, sizeof(strm));
+    inflateInit2(&strm, -15);
+}
+
+RawInflater::~RawInflater() {
+    inflateEnd(&strm);
+}
+
+bool RawInflater::decompress(std::string& packet) {
+    if (packet.size() < 3) return false;
+    if (packet[2] & CCPC_RAW_COMPRESSED_RESET) inflateReset(&strm);
+    std::string out(packet, 0, 2);
+    out[0] &= ~CCPC_RAW_COMPRESSED_TYPE;
+    strm.next_in = (Bytef*)&packet[3];
+    strm.avail_in = (uInt)(packet.size() - 3);
+    size_t used = 2;
+    do {
+        out.resize(used + packet.size() * 4 + 4096);
+        strm.next_out = (Bytef*)&out[used];
+        strm.avail_out = (uInt)(out.size() - used);
+        const int rc = inflate(&strm, Z_SYNC_FLUSH);
+        used = out.size() - strm.avail_out;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) return false;
+    } while (strm.avail_out == 0);
+    out.resize(used);
+    packet = std::move(out);
+    return true;
+}
+
+static void sendRawData(const uint8_t type, const uint8_t id, const std::function<void(std::ostream&)>& callback, RawDeflater * deflater = NULL) {
+    const bool binary = type != CCPC_RAW_FEATURE_FLAGS && (RawTerminal::supportedExtendedFeatures & CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES);
+    // the buffer keeps its capacity between packets; binary frames are built in place after the header
+    static thread_local RawPacketBuffer buf;
+    const size_t offset = binary ? 8 : 0;
+    buf.data.assign("!CPB\0\0\0\0", offset);
+    std::ostream output(&buf);
     output.put(type);
     output.put(id);
     callback(output);
-    std::string str = b64encode(output.str());
+    if (deflater != NULL && config.rawCompressionLevel > 0 && (RawTerminal::supportedExtendedFeatures & CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION))
+        deflater->compress(buf.data, offset);
+    if (binary) {
+        // the whole frame is written at once
+        const uint32_t size = (uint32_t)(buf.data.size() - 8);
+        memcpy(&buf.data[4], &size, 4);
+        Poco::Checksum chk;
+        chk.update(buf.data.c_str() + 8, size);
+        const uint32_t sum = chk.checksum();
+        buf.data.append((const char*)&sum, 4);
+        rawWriter(buf.data);
+        return;
+    }
+    std::string str = b64encode(buf.data);
     str.erase(std::remove_if(str.begin(), str.end(), [](char c)->bool {return c == '\n' || c == '\r'; }), str.end());
     Poco::Checksum chk;
-    if (type != CCPC_RAW_FEATURE_FLAGS && (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM)) chk.update(output.str());
+    if (type != CCPC_RAW_FEATURE_FLAGS && (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM)) chk.update(buf.data);
     else chk.update(str);
     const uint32_t sum = chk.checksum();
     char tmpdata[21];
@@ -444,43 +624,62 @@ static lua_CFunction findLibraryFunction(luaL_Reg * lib, const char * name) {
 }
 
 static void rawInputLoop() {
+    std::string ddata;
     while (!exiting) {
         unsigned char cc = std::cin.get();
         if (cc == '!' && std::cin.get() == 'C' && std::cin.get() == 'P') {
             char protocol_type = std::cin.get();
-            size_t sizen;
-            if (protocol_type == 'C') {
-                char size[5];
-                size[4] = 0;
-                std::cin.read(size, 4);
-                sizen = strtoul(size, NULL, 16);
-            } else if (isVersion1_1 && protocol_type == 'D') {
-                char size[13];
-                size[12] = 0;
-                std::cin.read(size, 12);
-                sizen = strtoul(size, NULL, 16);
-            } else continue;
-            char * tmp = new char[sizen+1];
-            tmp[sizen] = 0;
-            std::cin.read(tmp, sizen);
-            std::string ddata;
-            try {
-                ddata = b64decode(std::string(tmp, sizen));
-            } catch (std::exception &e) {
-                fprintf(stderr, "Could not decode Base64: %s\n", e.what());
+            if (protocol_type == 'B') {
+                // binary frame: the payload is sent as-is, with a binary checksum
+                uint32_t sizen = 0, sum = 0;
+                std::cin.read((char*)&sizen, 4);
+                if (sizen > CCPC_RAW_MAX_BINARY_FRAME_SIZE) {
+                    fprintf(stderr, "Binary frame too large: %u bytes\n", sizen);
+                    continue;
+                }
+                ddata.resize(sizen);
+                std::cin.read(&ddata[0], sizen);
+                std::cin.read((char*)&sum, 4);
+                Poco::Checksum chk;
+                chk.update(ddata);
+                if (chk.checksum() != sum) {
+                    fprintf(stderr, "Invalid checksum: expected %08X, got %08X\n", chk.checksum(), sum);
+                    continue;
+                }
+            } else {
+                size_t sizen;
+                if (protocol_type == 'C') {
+                    char size[5];
+                    size[4] = 0;
+                    std::cin.read(size, 4);
+                    sizen = strtoul(size, NULL, 16);
+                } else if (isVersion1_1 && protocol_type == 'D') {
+                    char size[13];
+                    size[12] = 0;
+                    std::cin.read(size, 12);
+                    sizen = strtoul(size, NULL, 16);
+                } else continue;
+                char * tmp = new char[sizen+1];
+                tmp[sizen] = 0;
+                std::cin.read(tmp, sizen);
+                try {
+                    ddata = b64decode(std::string(tmp, sizen));
+                } catch (std::exception &e) {
+                    fprintf(stderr, "Could not decode Base64: %s\n", e.what());
+                    delete[] tmp;
+                    continue;
+                } 
+                Poco::Checksum chk;
+                if (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM) chk.update(ddata);
+                else chk.update(tmp, sizen);
                 delete[] tmp;
-                continue;
-            } 
-            Poco::Checksum chk;
-            if (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM) chk.update(ddata);
-            else chk.update(tmp, sizen);
-            delete[] tmp;
-            char hexstr[9];
-            std::cin.read(hexstr, 8);
-            hexstr[8] = 0;
-            if (chk.checksum() != strtoul(hexstr, NULL, 16)) {
-                fprintf(stderr, "Invalid checksum: expected %08X, got %08lX\n", chk.checksum(), strtoul(hexstr, NULL, 16));
-                continue;
+                char hexstr[9];
+                std::cin.read(hexstr, 8);
+                hexstr[8] = 0;
+                if (chk.checksum() != strtoul(hexstr, NULL, 16)) {
+                    fprintf(stderr, "Invalid checksum: expected %08X, got %08lX\n", chk.checksum(), strtoul(hexstr, NULL, 16));
+                    continue;
+                }
             }
             std::stringstream in(ddata);
 
@@ -504,7 +703,7 @@ static void rawInputLoop() {
                             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                             e.text.windowID = c->term->id;
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                         }
                     }
                 } else if ((flags & 9) == 1) {
@@ -518,7 +717,7 @@ static void rawInputLoop() {
                             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                             e.key.windowID = c->term->id;
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                         }
                     }
                 } else {
@@ -532,7 +731,7 @@ static void rawInputLoop() {
                             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                             e.key.windowID = c->term->id;
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                         }
                     }
                 }
@@ -576,7 +775,7 @@ static void rawInputLoop() {
                             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                             e.window.windowID = id;
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                         }
                     }
                     for (Terminal * t : orphanedTerminals) {
@@ -592,7 +791,7 @@ static void rawInputLoop() {
                     for (Computer * c : *computers) {
                         std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                         c->termEventQueue.push(e);
-                        c->event_lock.notify_all();
+                        wakeComputer(c);
                     }
                 } else {
                     in.get(); // reserved
@@ -609,7 +808,7 @@ static void rawInputLoop() {
                         if (checkWindowID(c, e.window.windowID)) {
                             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                         }
                     }
                 }
@@ -617,10 +816,11 @@ static void rawInputLoop() {
             } case CCPC_RAW_FEATURE_FLAGS: {
                 isVersion1_1 = true;
                 in.read((char*)&RawTerminal::supportedFeatures, 2);
-                RawTerminal::supportedFeatures &= CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM | CCPC_RAW_FEATURE_FLAG_FILESYSTEM_SUPPORT | CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS;
+                RawTerminal::supportedFeatures &= CCPC_RAW_FEATURE_FLAG_BINARY_CHECKSUM | CCPC_RAW_FEATURE_FLAG_FILESYSTEM_SUPPORT | CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS | CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES;
                 if (RawTerminal::supportedFeatures & CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES) {
                     in.read((char*)&RawTerminal::supportedExtendedFeatures, 4);
-                    RawTerminal::supportedExtendedFeatures &= 0x00000000;
+                    RawTerminal::supportedExtendedFeatures &= CCPC_RAW_EXTENDED_FEATURE_FLAG_DELTA_FRAMES | CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES | CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION;
+                    if (RawTerminal::supportedExtendedFeatures & CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES) setRawBinaryMode();
                 }
                 sendRawData(CCPC_RAW_FEATURE_FLAGS, id, [](std::ostream& out) {
                     out.write((char*)&RawTerminal::supportedFeatures, 2);
@@ -966,6 +1166,18 @@ static void rawInputLoop() {
                     }
                 });
                 break;
+            } case CCPC_RAW_TERMINAL_DELTA: {
+                // the client missed a delta frame; the next frame for this window will be a keyframe
+                std::lock_guard<std::mutex> rlock(renderTargetsLock);
+                for (Terminal * t : renderTargets) {
+                    RawTerminal * term = dynamic_cast<RawTerminal*>(t);
+                    if (term != NULL && term->id == id) {
+                        std::lock_guard<std::mutex> lock(term->locked);
+                        term->needsKeyframe = true;
+                        term->changed = true;
+                    }
+                }
+                break;
             }}
         }
     }
@@ -997,6 +1209,12 @@ void RawTerminal::initClient(uint16_t flags, uint32_t extflags) {
     });
 }
 
+void RawTerminal::requestKeyframe(uint8_t id, uint16_t sequence) {
+    sendRawData(CCPC_RAW_TERMINAL_DELTA, id, [sequence](std::ostream& out) {
+        out.write((char*)&sequence, 2);
+    });
+}
+
 void RawTerminal::showGlobalMessage(uint32_t flags, const char * title, const char * message) {
     sendRawData(CCPC_RAW_MESSAGE_DATA, 0, [flags, title, message](std::ostream& output) {
         output.write((const char*)&flags, 4);
@@ -1043,39 +1261,71 @@ RawTerminal::~RawTerminal() {
             it = renderTargets.erase(it);
         if (it == renderTargets.end()) break;
     }
+    delete deflater;
 }
 
+// Number of delta frames sent before a full keyframe is forced, so clients can recover from dropped packets.
+static constexpr unsigned rawKeyframeInterval = 120;
+
 void RawTerminal::render() {
-    std::lock_guard<std::mutex> lock(locked);
-    if (gotResizeEvent) {
-        gotResizeEvent = false;
-        this->screen.resize(newWidth, newHeight, ' ');
-        this->colors.resize(newWidth, newHeight, 0xF0);
-        this->pixels.resize(newWidth * fontWidth, newHeight * fontHeight, 0x0F);
-        this->width = newWidth;
-        this->height = newHeight;
-        changed = true;
+    uint8_t frameMode;
+    bool frameBlink, frameGrayscale, resync;
+    uint16_t cursorX, cursorY;
+    {
+        std::lock_guard<std::mutex> lock(locked);
+        if (gotResizeEvent) {
+            gotResizeEvent = false;
+            this->screen.resize(newWidth, newHeight, ' ');
+            this->colors.resize(newWidth, newHeight, 0xF0);
+            this->pixels.resize(newWidth * fontWidth, newHeight * fontHeight, 0x0F);
+            this->width = newWidth;
+            this->height = newHeight;
+            markAllDirty();
+        }
+        if (!needsRedraw()) return;
+        // the packet is encoded from the snapshot, so output doesn't block the computer
+        takeFrame(frame, frameDamage);
+        frameMode = (uint8_t)mode;
+        frameBlink = canBlink;
+        frameGrayscale = grayscale;
+        cursorX = (uint16_t)blinkX;
+        cursorY = (uint16_t)blinkY;
+        resync = needsKeyframe;
+        needsKeyframe = false;
     }
-    if (!changed) return;
-    changed = false;
-    sendRawData(CCPC_RAW_TERMINAL_DATA, (uint8_t)id, [this](std::ostream& output) {
-        output.put((char)mode);
-        output.put((char)canBlink);
+    if (supportedExtendedFeatures & CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION) {
+        if (deflater == NULL) deflater = new RawDeflater(config.rawCompressionLevel);
+        else if (resync) deflater->restart();
+    }
+    if (!(supportedExtendedFeatures & CCPC_RAW_EXTENDED_FEATURE_FLAG_DELTA_FRAMES)) sendKeyframe(frameMode, frameBlink, cursorX, cursorY, frameGrayscale, false);
+    else if (resync || framesSinceKeyframe >= rawKeyframeInterval || frameMode != lastMode || frameGrayscale != lastGrayscale || frame.width != lastFrame.width || frame.height != lastFrame.height)
+        sendKeyframe(frameMode, frameBlink, cursorX, cursorY, frameGrayscale, true);
+    else sendDelta(frameMode, frameBlink, cursorX, cursorY, frameGrayscale);
+}
+
+void RawTerminal::sendKeyframe(uint8_t frameMode, bool frameBlink, uint16_t cursorX, uint16_t cursorY, bool frameGrayscale, bool delta) {
+    frameSequence++;
+    sendRawData(CCPC_RAW_TERMINAL_DATA, (uint8_t)id, [this, frameMode, frameBlink, cursorX, cursorY, frameGrayscale, delta](std::ostream& output) {
+        const unsigned width = frame.width, height = frame.height;
+        output.put((char)frameMode);
+        output.put((char)frameBlink);
         output.write((char*)&width, 2);
         output.write((char*)&height, 2);
-        output.write((char*)&blinkX, 2);
-        output.write((char*)&blinkY, 2);
-        output.put(grayscale ? 1 : 0);
-        for (int i = 0; i < 3; i++) output.put(0);
-        if (mode == 0) {
-            unsigned char c = screen[0][0];
+        output.write((char*)&cursorX, 2);
+        output.write((char*)&cursorY, 2);
+        output.put(frameGrayscale ? 1 : 0);
+        output.put(0);
+        if (delta) output.write((char*)&frameSequence, 2);
+        else {output.put(0); output.put(0);}
+        if (frameMode == 0) {
+            unsigned char c = frame.screen[0][0];
             unsigned char n = 0;
             for (unsigned y = 0; y < height; y++) {
                 for (unsigned x = 0; x < width; x++) {
-                    if (screen[y][x] != c || n == 255) {
+                    if (frame.screen[y][x] != c || n == 255) {
                         output.put(c);
                         output.put(n);
-                        c = screen[y][x];
+                        c = frame.screen[y][x];
                         n = 0;
                     }
                     n++;
@@ -1085,14 +1335,14 @@ void RawTerminal::render() {
                 output.put(c);
                 output.put(n);
             }
-            c = colors[0][0];
+            c = frame.colors[0][0];
             n = 0;
             for (unsigned y = 0; y < height; y++) {
                 for (unsigned x = 0; x < width; x++) {
-                    if (colors[y][x] != c || n == 255) {
+                    if (frame.colors[y][x] != c || n == 255) {
                         output.put(c);
                         output.put(n);
-                        c = colors[y][x];
+                        c = frame.colors[y][x];
                         n = 0;
                     }
                     n++;
@@ -1103,14 +1353,14 @@ void RawTerminal::render() {
                 output.put(n);
             }
         } else {
-            unsigned char c = pixels[0][0];
+            unsigned char c = frame.pixels[0][0];
             unsigned char n = 0;
             for (unsigned y = 0; y < height * 9; y++) {
                 for (unsigned x = 0; x < width * 6; x++) {
-                    if (pixels[y][x] != c || n == 255) {
+                    if (frame.pixels[y][x] != c || n == 255) {
                         output.put(c);
                         output.put(n);
-                        c = pixels[y][x];
+                        c = frame.pixels[y][x];
                         n = 0;
                     }
                     n++;
@@ -1121,12 +1371,99 @@ void RawTerminal::render() {
                 output.put(n);
             }
         }
-        for (int i = 0; i < (mode == 2 ? 256 : 16); i++) {
-            output.put(palette[i].r);
-            output.put(palette[i].g);
-            output.put(palette[i].b);
+        for (int i = 0; i < (frameMode == 2 ? 256 : 16); i++) {
+            output.put(frame.palette[i].r);
+            output.put(frame.palette[i].g);
+            output.put(frame.palette[i].b);
         }
-    });
+    }, deflater);
+    if (delta) {
+        // copy assignment reuses the existing storage
+        lastFrame.screen = frame.screen;
+        lastFrame.colors = frame.colors;
+        lastFrame.pixels = frame.pixels;
+        memcpy(lastFrame.palette, frame.palette, sizeof(lastFrame.palette));
+        lastFrame.width = frame.width;
+        lastFrame.height = frame.height;
+        lastMode = frameMode;
+        lastGrayscale = frameGrayscale;
+        framesSinceKeyframe = 0;
+    }
+}
+
+void RawTerminal::sendDelta(uint8_t frameMode, bool frameBlink, uint16_t cursorX, uint16_t cursorY, bool frameGrayscale) {
+    const unsigned width = frame.width, height = frame.height;
+    const unsigned left = frameDamage.full ? 0 : frameDamage.left, right = frameDamage.full ? width : frameDamage.right;
+    const unsigned top = frameDamage.full ? 0 : frameDamage.top, bottom = frameDamage.full ? height : frameDamage.bottom;
+    // find the changed span of each damaged row, and bring the base frame up to date
+    deltaSpans.clear();
+    for (unsigned y = top; y < bottom; y++) {
+        if (!frameDamage.row(y)) continue;
+        if (frameMode == 0) {
+            const size_t off = (size_t)y * width;
+            const unsigned char *text = frame.screen.data() + off, *col = frame.colors.data() + off;
+            unsigned char *oldText = lastFrame.screen.data() + off, *oldCol = lastFrame.colors.data() + off;
+            unsigned start = left, end = right;
+            while (start < end && text[start] == oldText[start] && col[start] == oldCol[start]) start++;
+            while (end > start && text[end-1] == oldText[end-1] && col[end-1] == oldCol[end-1]) end--;
+            if (start == end) continue;
+            memcpy(oldText + start, text + start, end - start);
+            memcpy(oldCol + start, col + start, end - start);
+            deltaSpans.push_back({(uint16_t)y, (uint16_t)start, (uint16_t)(end - start)});
+        } else {
+            for (unsigned py = y * fontHeight; py < (y + 1) * fontHeight; py++) {
+                const size_t off = (size_t)py * width * fontWidth;
+                const unsigned char *pix = frame.pixels.data() + off;
+                unsigned char *oldPix = lastFrame.pixels.data() + off;
+                unsigned start = left * fontWidth, end = right * fontWidth;
+                while (start < end && pix[start] == oldPix[start]) start++;
+                while (end > start && pix[end-1] == oldPix[end-1]) end--;
+                if (start == end) continue;
+                memcpy(oldPix + start, pix + start, end - start);
+                deltaSpans.push_back({(uint16_t)py, (uint16_t)start, (uint16_t)(end - start)});
+            }
+        }
+    }
+    deltaPalette.clear();
+    for (int i = 0; i < (frameMode == 2 ? 256 : 16); i++) {
+        if (frame.palette[i].r != lastFrame.palette[i].r || frame.palette[i].g != lastFrame.palette[i].g || frame.palette[i].b != lastFrame.palette[i].b) {
+            deltaPalette.push_back((uint8_t)i);
+            lastFrame.palette[i] = frame.palette[i];
+        }
+    }
+    const uint16_t base = frameSequence++;
+    sendRawData(CCPC_RAW_TERMINAL_DELTA, (uint8_t)id, [this, frameMode, frameBlink, cursorX, cursorY, frameGrayscale, width, height, base](std::ostream& output) {
+        output.put((char)frameMode);
+        output.put((char)frameBlink);
+        output.write((char*)&width, 2);
+        output.write((char*)&height, 2);
+        output.write((char*)&cursorX, 2);
+        output.write((char*)&cursorY, 2);
+        output.put(frameGrayscale ? 1 : 0);
+        output.put(0);
+        output.write((char*)&frameSequence, 2);
+        output.write((char*)&base, 2);
+        const uint16_t nspans = (uint16_t)deltaSpans.size();
+        output.write((char*)&nspans, 2);
+        for (const DeltaSpan& span : deltaSpans) {
+            output.write((char*)&span.row, 2);
+            output.write((char*)&span.start, 2);
+            output.write((char*)&span.length, 2);
+            if (frameMode == 0) {
+                output.write((char*)frame.screen.data() + (size_t)span.row * width + span.start, span.length);
+                output.write((char*)frame.colors.data() + (size_t)span.row * width + span.start, span.length);
+            } else output.write((char*)frame.pixels.data() + (size_t)span.row * width * fontWidth + span.start, span.length);
+        }
+        const uint16_t npalette = (uint16_t)deltaPalette.size();
+        output.write((char*)&npalette, 2);
+        for (uint8_t i : deltaPalette) {
+            output.put(i);
+            output.put(frame.palette[i].r);
+            output.put(frame.palette[i].g);
+            output.put(frame.palette[i].b);
+        }
+    }, deflater);
+    framesSinceKeyframe++;
 }
 
 void RawTerminal::showMessage(uint32_t flags, const char * title, const char * message) {
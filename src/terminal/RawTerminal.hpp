@@ -12,6 +12,7 @@
 #define TERMINAL_RAWTERMINAL_HPP
 #include <set>
 #include <SDL2/SDL.h>
+#include <zlib.h>
 #include <Terminal.hpp>
 #include "../runtime.hpp"
 
@@ -25,7 +26,8 @@ enum {
     CCPC_RAW_FEATURE_FLAGS,
     CCPC_RAW_FILE_REQUEST,
     CCPC_RAW_FILE_RESPONSE,
-    CCPC_RAW_FILE_DATA
+    CCPC_RAW_FILE_DATA,
+    CCPC_RAW_TERMINAL_DELTA
 };
 
 enum {
@@ -55,6 +57,41 @@ enum {
 #define CCPC_RAW_FEATURE_FLAG_SEND_ALL_WINDOWS       0x0004
 #define CCPC_RAW_FEATURE_FLAG_HAS_EXTENDED_FEATURES  0x8000
 
+#define CCPC_RAW_EXTENDED_FEATURE_FLAG_DELTA_FRAMES  0x00000001
+#define CCPC_RAW_EXTENDED_FEATURE_FLAG_BINARY_FRAMES 0x00000002
+#define CCPC_RAW_EXTENDED_FEATURE_FLAG_COMPRESSION   0x00000004
+
+#define CCPC_RAW_COMPRESSED_TYPE   0x80 // Set in the type byte of a packet with a compressed payload
+#define CCPC_RAW_COMPRESSED_RESET  0x01 // Set in the compression flags when the window's deflate stream restarts
+
+#define CCPC_RAW_MAX_BINARY_FRAME_SIZE 0x4000000 // Largest payload accepted in a binary frame (64 MiB); longer frames are dropped
+
+// Compresses the payloads of one window's packets, keeping the deflate dictionary between packets.
+class RawDeflater {
+    z_stream strm;
+    int level;
+    bool reset = true;
+    std::string out;
+public:
+    RawDeflater(int level);
+    ~RawDeflater();
+    RawDeflater(const RawDeflater&) = delete;
+    RawDeflater& operator=(const RawDeflater&) = delete;
+    void restart() {reset = true;} // Starts a new stream with the next packet, so a client can recover from a corrupted one
+    void compress(std::string& packet, size_t offset); // Compresses the payload of the packet starting at `offset` in place
+};
+
+// Decompresses one window's packets, keeping the inflate dictionary between packets.
+class RawInflater {
+    z_stream strm;
+public:
+    RawInflater();
+    ~RawInflater();
+    RawInflater(const RawInflater&) = delete;
+    RawInflater& operator=(const RawInflater&) = delete;
+    bool decompress(std::string& packet); // Replaces a compressed packet with the uncompressed one; returns false if the data was corrupt
+};
+
 class RawTerminal: public Terminal {
 public:
     static uint16_t supportedFeatures;
@@ -65,6 +102,8 @@ public:
     static void pollEvents() {defaultPollEvents();}
     static void showGlobalMessage(uint32_t flags, const char * title, const char * message);
     static void initClient(uint16_t flags, uint32_t extflags = 0);
+    static void requestKeyframe(uint8_t id, uint16_t sequence);
+    bool needsKeyframe = false; // Set when the client asks to resynchronize delta frames; protected by `locked`
     RawTerminal(std::string title, uint8_t computerID = 0);
     ~RawTerminal() override;
     void render() override;
@@ -72,8 +111,27 @@ public:
     void showMessage(uint32_t flags, const char * title, const char * message) override;
     void setLabel(std::string label) override;
     void onActivate() override {}
+private:
+    struct DeltaSpan {
+        uint16_t row;
+        uint16_t start;
+        uint16_t length;
+    };
+    TerminalDamage frameDamage;
+    RawDeflater * deflater = NULL;
+    TerminalSnapshot frame; // the frame being sent
+    TerminalSnapshot lastFrame; // the last frame sent to the client, which delta frames are based on
+    std::vector<DeltaSpan> deltaSpans;
+    std::vector<uint8_t> deltaPalette;
+    int lastMode = -1;
+    bool lastGrayscale = false;
+    uint16_t frameSequence = 0;
+    unsigned framesSinceKeyframe = 0;
+    void sendKeyframe(uint8_t frameMode, bool frameBlink, uint16_t cursorX, uint16_t cursorY, bool frameGrayscale, bool delta);
+    void sendDelta(uint8_t frameMode, bool frameBlink, uint16_t cursorX, uint16_t cursorY, bool frameGrayscale);
 };
 
 extern void sendRawEvent(SDL_Event e);
+extern void setRawBinaryMode();
 
 #endif
\ No newline at end of file
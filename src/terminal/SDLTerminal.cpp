@@ -10,11 +10,17 @@
 
 #include <fstream>
 #include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include <configuration.hpp>
 #include "RawTerminal.hpp"
 #include "SDLTerminal.hpp"
 #include "../gif.hpp"
 #include "../main.hpp"
+#include "../rompack.hpp"
 #include "../runtime.hpp"
 #include "../termsupport.hpp"
 #ifndef NO_WEBP
@@ -62,18 +68,18 @@ static int nextWindowID = 1;
 extern "C" {
     void EMSCRIPTEN_KEEPALIVE nextRenderTarget() {
         if (++renderTarget == renderTargets.end()) renderTarget = renderTargets.begin();
-        (*renderTarget)->changed = true;
+        (*renderTarget)->markAllDirty();
     }
 
     void EMSCRIPTEN_KEEPALIVE previousRenderTarget() {
         if (renderTarget == renderTargets.begin()) renderTarget = renderTargets.end();
         renderTarget--;
-        (*renderTarget)->changed = true;
+        (*renderTarget)->markAllDirty();
     }
 
     bool EMSCRIPTEN_KEEPALIVE selectRenderTarget(int id) {
         for (renderTarget = renderTargets.begin(); renderTarget != renderTargets.end(); renderTarget++) if ((*renderTarget)->id == id) break;
-        (*renderTarget)->changed = true;
+        (*renderTarget)->markAllDirty();
         return renderTarget != renderTargets.end();
     }
 
@@ -198,6 +204,7 @@ SDLTerminal::~SDLTerminal() {
             if (it == renderTargets.end()) break;
         }
     }
+    for (SDL_Surface * sheet : glyphSheets) SDL_FreeSurface(sheet);
     if (!overridden) {
         if (surf != NULL) SDL_FreeSurface(surf);
         if ((!singleWindowMode || renderTargets.size() == 0) && win != NULL) {SDL_DestroyWindow(win); singleWin = NULL;}
@@ -229,15 +236,13 @@ bool operator!=(Color lhs, Color rhs) {
     return lhs.r != rhs.r || lhs.g != rhs.g || lhs.b != rhs.b;
 }
 
-bool SDLTerminal::drawChar(unsigned char c, int x, int y, Color fg, Color bg, bool transparent) {
-    SDL_Rect srcrect = getCharacterRect(c);
-    SDL_Rect destrect = {
+SDL_Rect SDLTerminal::cellBackgroundRect(int x, int y) {
+    SDL_Rect bgdestrect = {
         (int)(x * charWidth * dpiScale + 2 * charScale * dpiScale), 
         (int)(y * charHeight * dpiScale + 2 * charScale * dpiScale), 
         (int)(fontWidth * charScale * dpiScale), 
         (int)(fontHeight * charScale * dpiScale)
     };
-    SDL_Rect bgdestrect = destrect;
     if (config.standardsMode || config.extendMargins) {
         if (x == 0) bgdestrect.x -= (int)(2 * charScale * dpiScale);
         if (y == 0) bgdestrect.y -= (int)(2 * charScale * dpiScale);
@@ -246,6 +251,18 @@ bool SDLTerminal::drawChar(unsigned char c, int x, int y, Color fg, Color bg, bo
         if ((unsigned)x == width - 1) bgdestrect.w += realWidth - (int)(width*charWidth*dpiScale+(4 * charScale * dpiScale));
         if ((unsigned)y == height - 1) bgdestrect.h += realHeight - (int)(height*charHeight*dpiScale+(4 * charScale * dpiScale));
     }
+    return bgdestrect;
+}
+
+bool SDLTerminal::drawChar(unsigned char c, int x, int y, Color fg, Color bg, bool transparent) {
+    SDL_Rect srcrect = getCharacterRect(c);
+    SDL_Rect destrect = {
+        (int)(x * charWidth * dpiScale + 2 * charScale * dpiScale), 
+        (int)(y * charHeight * dpiScale + 2 * charScale * dpiScale), 
+        (int)(fontWidth * charScale * dpiScale), 
+        (int)(fontHeight * charScale * dpiScale)
+    };
+    SDL_Rect bgdestrect = cellBackgroundRect(x, y);
     if (!transparent && bg != palette[15]) {
         if (gotResizeEvent) return false;
         bg = grayscalify(bg);
@@ -261,6 +278,114 @@ bool SDLTerminal::drawChar(unsigned char c, int x, int y, Color fg, Color bg, bo
     return true;
 }
 
+void SDLTerminal::makePixelLUT(const Color * pal, uint32_t * lut) {
+    for (int i = 0; i < 256; i++) lut[i] = rgb(pal[i]);
+}
+
+void SDLTerminal::blitPixels(const unsigned char * src, size_t srcPitch, unsigned w, unsigned h, const uint32_t * lut, unsigned scale, uint8_t * dest, int destPitch) {
+    const size_t rowSize = (size_t)w * scale * 4;
+    for (unsigned y = 0; y < h; y++, src += srcPitch) {
+        uint32_t * out = (uint32_t*)dest;
+        unsigned x = 0;
+        if (scale == 1) {
+            for (; x < w; x++) out[x] = lut[src[x]];
+        } else if (scale == 2) {
+#if defined(__SSE2__)
+            for (; x + 4 <= w; x += 4, out += 8) {
+                const __m128i v = _mm_setr_epi32((int)lut[src[x]], (int)lut[src[x+1]], (int)lut[src[x+2]], (int)lut[src[x+3]]);
+                _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi32(v, v));
+                _mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi32(v, v));
+            }
+#elif defined(__ARM_NEON)
+            for (; x + 4 <= w; x += 4, out += 8) {
+                const uint32_t px[4] = {lut[src[x]], lut[src[x+1]], lut[src[x+2]], lut[src[x+3]]};
+                const uint32x4_t v = vld1q_u32(px);
+                vst2q_u32(out, (uint32x4x2_t){{v, v}});
+            }
+#endif
+            for (; x < w; x++, out += 2) out[0] = out[1] = lut[src[x]];
+        } else {
+            for (; x < w; x++) {
+                const uint32_t c = lut[src[x]];
+                for (unsigned i = 0; i < scale; i++) *out++ = c;
+            }
+        }
+        // the rest of the rows in the scaled pixel are identical
+        for (unsigned i = 1; i < scale; i++) memcpy(dest + (size_t)i * destPitch, dest, rowSize);
+        dest += (size_t)destPitch * scale;
+    }
+}
+
+void SDLTerminal::updateGlyphAtlas(const Color * pal) {
+    const unsigned scale = charScale * dpiScale;
+    if (!glyphSlots.empty() && scale == glyphScale && useOrigFont == glyphOrigFont && grayscale == glyphGrayscale && memcmp(pal, glyphPalette, sizeof(glyphPalette)) == 0) return;
+    if (scale != glyphScale) {
+        for (SDL_Surface * sheet : glyphSheets) SDL_FreeSurface(sheet);
+        glyphSheets.clear();
+    }
+    glyphSlots.assign(65536, 0);
+    glyphSlotCount = 0;
+    glyphScale = scale;
+    glyphOrigFont = useOrigFont;
+    glyphGrayscale = grayscale;
+    memcpy(glyphPalette, pal, sizeof(glyphPalette));
+}
+
+SDL_Surface * SDLTerminal::getGlyph(unsigned char c, unsigned char color, const Color * pal, SDL_Rect * rect) {
+    const int tw = (int)(fontWidth * charScale * dpiScale), th = (int)(fontHeight * charScale * dpiScale);
+    uint16_t& slot = glyphSlots[color << 8 | c];
+    if (slot == 0) {
+        // the atlas is full, so start over instead of growing it any further
+        if (glyphSlotCount >= glyphAtlasSize) {
+            std::fill(glyphSlots.begin(), glyphSlots.end(), 0);
+            glyphSlotCount = 0;
+        }
+        const unsigned idx = glyphSlotCount;
+        if (idx / 256 >= glyphSheets.size()) {
+            SDL_Surface * sheet = SDL_CreateRGBSurfaceWithFormat(0, tw * 16, th * 16, 24, SDL_PIXELFORMAT_RGB888);
+            if (sheet == NULL) return NULL;
+            glyphSheets.push_back(sheet);
+        }
+        SDL_Surface * sheet = glyphSheets[idx / 256];
+        setRect(rect, (int)(idx % 16) * tw, (int)(idx / 16 % 16) * th, tw, th);
+        Color bg = pal[color >> 4];
+        if (bg != pal[15]) bg = grayscalify(bg); // matches the background fill in render()
+        if (SDL_FillRect(sheet, rect, rgb(bg)) != 0) return NULL;
+        if (c != ' ' && c != '\0') {
+            SDL_Rect srcrect = getCharacterRect(c), destrect = *rect;
+            const Color fg = grayscalify(pal[color & 0x0F]);
+            if (SDL_SetSurfaceColorMod(useOrigFont ? origfont : bmp, fg.r, fg.g, fg.b) != 0) return NULL;
+            if (SDL_BlitScaled(useOrigFont ? origfont : bmp, &srcrect, sheet, &destrect) != 0) return NULL;
+        }
+        glyphSlotCount++;
+        slot = (uint16_t)glyphSlotCount;
+        return sheet;
+    }
+    const unsigned idx = slot - 1;
+    setRect(rect, (int)(idx % 16) * tw, (int)(idx / 16 % 16) * th, tw, th);
+    return glyphSheets[idx / 256];
+}
+
+bool SDLTerminal::drawCell(unsigned char c, int x, int y, unsigned char color, const Color * pal) {
+    SDL_Rect destrect = {
+        (int)(x * charWidth * dpiScale + 2 * charScale * dpiScale), 
+        (int)(y * charHeight * dpiScale + 2 * charScale * dpiScale), 
+        (int)(fontWidth * charScale * dpiScale), 
+        (int)(fontHeight * charScale * dpiScale)
+    };
+    SDL_Rect bgdestrect = cellBackgroundRect(x, y);
+    if (bgdestrect.w != destrect.w || bgdestrect.h != destrect.h) {
+        // the background of edge cells extends into the margins
+        Color bg = pal[color >> 4];
+        if (bg != pal[15]) bg = grayscalify(bg);
+        if (SDL_FillRect(surf, &bgdestrect, rgb(bg)) != 0) return false;
+    }
+    SDL_Rect srcrect;
+    SDL_Surface * sheet = getGlyph(c, color, pal, &srcrect);
+    if (sheet == NULL) return false;
+    return SDL_BlitSurface(sheet, &srcrect, surf, &destrect) == 0;
+}
+
 static unsigned char circlePix[] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
     0, 0, 0, 0, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 255, 255, 0, 0, 0, 0,
@@ -275,11 +400,8 @@ static unsigned char circlePix[] = {
 };
 
 void SDLTerminal::render() {
-    // copy the screen data so we can let Lua keep going without waiting for the mutex
-    std::unique_ptr<vector2d<unsigned char> > newscreen;
-    std::unique_ptr<vector2d<unsigned char> > newcolors;
-    std::unique_ptr<vector2d<unsigned char> > newpixels;
-    Color newpalette[256];
+    // copy the modified parts of the screen into the snapshot so we can let Lua keep going without waiting for the mutex
+    const Color * newpalette = snapshot.palette;
     unsigned newwidth, newheight, newcharWidth, newcharHeight, newcharScale;
     int newblinkX, newblinkY, newmode;
     bool newblink;
@@ -291,51 +413,83 @@ void SDLTerminal::render() {
                 this->screen.resize(newWidth, newHeight, ' ');
                 this->colors.resize(newWidth, newHeight, 0xF0);
                 this->pixels.resize(newWidth * fontWidth, newHeight * fontHeight, 0x0F);
-                changed = true;
-            } else changed = false;
+                markAllDirty();
+            } else changed = damaged = false;
             this->width = newWidth;
             this->height = newHeight;
             gotResizeEvent = false;
         }
-        if ((!changed && !shouldScreenshot && !shouldRecord) || width == 0 || height == 0) return;
-        newscreen = std::make_unique<vector2d<unsigned char> >(screen);
-        newcolors = std::make_unique<vector2d<unsigned char> >(colors);
-        newpixels = std::make_unique<vector2d<unsigned char> >(pixels);
-        memcpy(newpalette, palette, sizeof(newpalette));
+        if ((!needsRedraw() && !shouldScreenshot && !shouldRecord) || width == 0 || height == 0) return;
+        takeFrame(snapshot, frameDamage);
         newblinkX = blinkX; newblinkY = blinkY; newmode = mode;
         newblink = blink;
         newcursorColor = cursorColor;
         newwidth = width; newheight = height; newcharWidth = charWidth; newcharHeight = charHeight; newcharScale = charScale;
-        changed = false;
     }
     std::lock_guard<std::mutex> rlock(renderlock);
     int ww = 0, wh = 0;
     SDL_GetWindowSize(win, &ww, &wh);
-    if (surf == NULL) surf = SDL_CreateRGBSurfaceWithFormat(0, ww, wh, 24, SDL_PIXELFORMAT_RGB888);
+    if (surf == NULL) {
+        surf = SDL_CreateRGBSurfaceWithFormat(0, ww, wh, 24, SDL_PIXELFORMAT_RGB888);
+        frameDamage.full = true;
+    }
     if (surf == NULL) {
         fprintf(stderr, "Could not allocate rendering surface: %s\n", SDL_GetError());
         return;
     }
+    // the recording indicator is drawn on top of the surface, so it has to be redrawn completely every frame
+    // if the last frame was interrupted, parts of the surface may still be stale
+    if (shouldRecord || incompleteFrame) frameDamage.full = true;
+    incompleteFrame = true;
     SDL_Rect rect;
-    if (gotResizeEvent || SDL_FillRect(surf, NULL, newmode == 0 ? rgb(newpalette[15]) : rgb(defaultPalette[15])) != 0) return;
+    if (gotResizeEvent || (frameDamage.full && SDL_FillRect(surf, NULL, newmode == 0 ? rgb(newpalette[15]) : rgb(defaultPalette[15])) != 0)) return;
     if (newmode != 0) {
-        for (unsigned y = 0; y < newheight * newcharHeight * dpiScale; y+=newcharScale * dpiScale) {
-            for (unsigned x = 0; x < newwidth * newcharWidth * dpiScale; x+=newcharScale * dpiScale) {
-                unsigned char c = (*newpixels)[y / newcharScale / dpiScale][x / newcharScale / dpiScale];
-                if (gotResizeEvent) return;
-                if (SDL_FillRect(surf, setRect(&rect, (int)(x + 2 * newcharScale * dpiScale),
-                                               (int)(y + 2 * newcharScale * dpiScale),
-                                               (int)newcharScale * dpiScale,
-                                               (int)newcharScale * dpiScale),
-                                 rgb(newpalette[(int)c])) != 0) return;
+        const unsigned pixelScale = newcharScale * dpiScale;
+        const unsigned pixelWidth = newwidth * fontWidth;
+        // only draw whole pixels that fit inside the surface
+        const int fitWidth = surf->w / (int)pixelScale - 2, fitHeight = surf->h / (int)pixelScale - 2;
+        const unsigned maxX = fitWidth < 0 ? 0 : (fitWidth < (int)pixelWidth ? fitWidth : pixelWidth);
+        const unsigned maxY = fitHeight < 0 ? 0 : (fitHeight < (int)(newheight * fontHeight) ? fitHeight : newheight * fontHeight);
+        uint32_t lut[256];
+        makePixelLUT(newpalette, lut);
+        if (SDL_MUSTLOCK(surf) && SDL_LockSurface(surf) != 0) return;
+        for (unsigned cy = 0; cy < newheight; cy++) {
+            if (!frameDamage.row(cy)) continue;
+            if (gotResizeEvent) {
+                if (SDL_MUSTLOCK(surf)) SDL_UnlockSurface(surf);
+                return;
+            }
+            // blit each run of damaged cells in the row at once
+            for (unsigned cx = 0; cx < newwidth;) {
+                if (!frameDamage.cell(cx, cy)) {cx++; continue;}
+                unsigned end = cx + 1;
+                while (end < newwidth && frameDamage.cell(end, cy)) end++;
+                const unsigned x0 = cx * fontWidth, y0 = cy * fontHeight;
+                const unsigned x1 = end * fontWidth < maxX ? end * fontWidth : maxX, y1 = (cy + 1) * fontHeight < maxY ? (cy + 1) * fontHeight : maxY;
+                if (x1 > x0 && y1 > y0)
+                    blitPixels(snapshot.pixels.data() + (size_t)y0 * pixelWidth + x0, pixelWidth, x1 - x0, y1 - y0, lut, pixelScale,
+                               (uint8_t*)surf->pixels + (size_t)(y0 + 2) * pixelScale * surf->pitch + (size_t)(x0 + 2) * pixelScale * 4, surf->pitch);
+                cx = end;
             }
         }
+        if (SDL_MUSTLOCK(surf)) SDL_UnlockSurface(surf);
     } else {
-        for (unsigned y = 0; y < newheight; y++) for (unsigned x = 0; x < newwidth; x++) 
-            if (gotResizeEvent || !drawChar((*newscreen)[y][x], (int)x, (int)y, newpalette[(*newcolors)[y][x] & 0x0F], newpalette[(*newcolors)[y][x] >> 4])) return;
+        updateGlyphAtlas(newpalette);
+        for (unsigned y = 0; y < newheight; y++) {
+            if (!frameDamage.row(y)) continue;
+            for (unsigned x = 0; x < newwidth; x++) {
+                if (!frameDamage.cell(x, y)) continue;
+                const unsigned char c = snapshot.screen[y][x], color = snapshot.colors[y][x];
+                // blank cells are already filled in on full redraws
+                if (frameDamage.full && (c == ' ' || c == '\0') && (color >> 4) == 15) continue;
+                if (gotResizeEvent || !drawCell(c, (int)x, (int)y, color, newpalette)) return;
+            }
+        }
         if (gotResizeEvent) return;
-        if (newblink && newblinkX >= 0 && newblinkY >= 0 && (unsigned)newblinkX < newwidth && (unsigned)newblinkY < newheight) if (!drawChar('_', newblinkX, newblinkY, newpalette[newcursorColor], newpalette[(*newcolors)[newblinkY][newblinkX] >> 4], true)) return;
+        if (newblink && newblinkX >= 0 && newblinkY >= 0 && (unsigned)newblinkX < newwidth && (unsigned)newblinkY < newheight && frameDamage.cell(newblinkX, newblinkY))
+            if (!drawChar('_', newblinkX, newblinkY, newpalette[newcursorColor], newpalette[snapshot.colors[newblinkY][newblinkX] >> 4], true)) return;
     }
+    incompleteFrame = false;
     currentFPS++;
     if (lastSecond != time(0)) {
         lastSecond = time(0);
@@ -477,7 +631,7 @@ bool SDLTerminal::resize(unsigned w, unsigned h) {
             std::lock_guard<std::mutex> lock(renderlock);
             SDL_FreeSurface(surf);
             surf = NULL;
-            changed = true;
+            markAllDirty();
         }
     }
     while (gotResizeEvent && (!singleWindowMode || *renderTarget == this)) std::this_thread::yield(); // this should probably be a condition variable
@@ -536,7 +690,7 @@ void SDLTerminal::record(std::string path) {
         recordingPath /= std::string(tstr) + ".gif";
     }
     recorderHandle = NULL;
-    changed = true;
+    markAllDirty();
 }
 
 void SDLTerminal::stopRecording() {
@@ -563,7 +717,7 @@ void SDLTerminal::stopRecording() {
 #ifdef __EMSCRIPTEN__
     queueTask([](void*)->void*{emsyncfs(); return NULL;}, NULL, true);
 #endif
-    changed = true;
+    markAllDirty();
 }
 
 void SDLTerminal::showMessage(Uint32 flags, const char * title, const char * message) {SDL_ShowSimpleMessageBox(flags, title, message, win);}
@@ -617,9 +771,11 @@ void SDLTerminal::init() {
     setThreadName(*renderThread, "Render Thread");
     SDL_Surface* old_bmp;
     std::string bmp_path = "built-in file";
+    const char * packed_font = NULL;
+    size_t packed_font_size = 0;
 #ifndef STANDALONE_ROM
     if (config.customFontPath == "hdfont") {
-        bmp_path = (getROMPath() / "hdfont.bmp").string();
+        if (!getROMPackFile("hdfont.bmp", &packed_font, &packed_font_size)) bmp_path = (getROMPath() / "hdfont.bmp").string();
         fontScale = 1;
     } else 
 #endif
@@ -629,6 +785,7 @@ void SDLTerminal::init() {
     }
     if (config.customFontPath.empty()) 
         old_bmp = SDL_CreateRGBSurfaceWithFormatFrom((void*)font_image.pixel_data, (int)font_image.width, (int)font_image.height, (int)font_image.bytes_per_pixel * 8, (int)font_image.bytes_per_pixel * (int)font_image.width, SDL_PIXELFORMAT_RGB565);
+    else if (packed_font != NULL) old_bmp = SDL_LoadBMP_RW(SDL_RWFromConstMem(packed_font, (int)packed_font_size), 1);
     else old_bmp = SDL_LoadBMP(bmp_path.c_str());
     if (old_bmp == (SDL_Surface*)0) {
         throw std::runtime_error("Failed to load font: " + std::string(SDL_GetError()));
@@ -714,14 +871,14 @@ bool SDLTerminal::pollEvents() {
                 e.window.windowID = c->term->id;
                 std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                 c->termEventQueue.push(e);
-                c->event_lock.notify_all();
+                wakeComputer(c);
                 std::lock_guard<std::mutex> lock2(c->peripherals_mutex);
                 for (const std::pair<std::string, peripheral*> p : c->peripherals) {
                     monitor * m = dynamic_cast<monitor*>(p.second);
                     if (m != NULL) {
                         e.window.windowID = m->term->id;
                         c->termEventQueue.push(e);
-                        c->event_lock.notify_all();
+                        wakeComputer(c);
                     }
                 }
             }
@@ -767,7 +924,7 @@ bool SDLTerminal::pollEvents() {
                             e.type == SDL_QUIT) {
                             std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                             c->termEventQueue.push(e);
-                            c->event_lock.notify_all();
+                            wakeComputer(c);
                             if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE && e.window.windowID == c->term->id) {
                                 if (c->requestedExit && c->L) {
                                     SDL_MessageBoxData msg;
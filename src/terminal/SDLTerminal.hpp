@@ -92,10 +92,31 @@ protected:
     friend void registerSDLEvent(SDL_EventType type, const sdl_event_handler& handler, void* userdata);
     friend int main(int argc, char*argv[]);
     SDL_Surface *surf = NULL;
+    TerminalDamage frameDamage; // The damage being drawn in the current frame
+    TerminalSnapshot snapshot; // The renderer's copy of the terminal contents
+    bool incompleteFrame = true; // Whether the last frame was interrupted before it was fully drawn
     static SDL_Surface *bmp;
     static SDL_Surface *origfont;
     static Uint32 lastWindow;
 
     SDL_Rect getCharacterRect(unsigned char c);
+    SDL_Rect cellBackgroundRect(int x, int y);
+
+    // Pre-coloured glyph atlas used by drawCell, indexed by (color << 8 | character)
+    static constexpr unsigned glyphAtlasSize = 4096; // The maximum number of cached glyphs before the atlas is flushed
+    std::vector<SDL_Surface*> glyphSheets; // Each sheet holds 16x16 glyphs at the current scale
+    std::vector<uint16_t> glyphSlots; // Slot number + 1 for each glyph, or 0 if it hasn't been rendered yet
+    unsigned glyphSlotCount = 0;
+    unsigned glyphScale = 0;
+    bool glyphOrigFont = false;
+    bool glyphGrayscale = false;
+    Color glyphPalette[16];
+    void updateGlyphAtlas(const Color * pal); // Flushes the atlas if the palette, scale or font changed
+    SDL_Surface * getGlyph(unsigned char c, unsigned char color, const Color * pal, SDL_Rect * rect);
+    bool drawCell(unsigned char c, int x, int y, unsigned char color, const Color * pal);
+
+    // Palette-LUT pixel blitter for graphics modes: converts w*h terminal pixels to 32-bit RGB888, scaling each pixel to scale*scale
+    static void makePixelLUT(const Color * pal, uint32_t * lut);
+    static void blitPixels(const unsigned char * src, size_t srcPitch, unsigned w, unsigned h, const uint32_t * lut, unsigned scale, uint8_t * dest, int destPitch);
 };
 #endif
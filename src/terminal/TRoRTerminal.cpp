@@ -76,7 +76,7 @@ static void trorInputLoop() {
             for (Computer * c : *computers) {
                 std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                 c->termEventQueue.push(e);
-                c->event_lock.notify_all();
+                wakeComputer(c);
             }
         } else if (code == "TR") {
             const int newWidth = std::stoi(payload.substr(0, payload.find(','))), newHeight = std::stoi(payload.substr(payload.find(',') + 1));
@@ -112,7 +112,7 @@ static void trorInputLoop() {
                 if (checkWindowID(c, id)) {
                     std::lock_guard<std::mutex> lock(c->termEventQueueMutex);
                     c->termEventQueue.push(e);
-                    c->event_lock.notify_all();
+                    wakeComputer(c);
                 }
             }
             for (Terminal * t : orphanedTerminals) {
@@ -30,6 +30,7 @@
 #include <Terminal.hpp>
 #include "apis.hpp"
 #include "apis/handles/fs_handle.hpp"
+#include "eventqueue.hpp"
 #include "main.hpp"
 #include "runtime.hpp"
 #include "peripheral/monitor.hpp"
@@ -39,6 +40,7 @@
 #include "terminal/HardwareSDLTerminal.hpp"
 #include "terminal/RawTerminal.hpp"
 #include "terminal/TRoRTerminal.hpp"
+#include "timerwheel.hpp"
 #ifndef NO_CLI
 #include "terminal/CLITerminal.hpp"
 #endif
@@ -341,9 +343,10 @@ int termPanic(lua_State *L) {
     while (!comp->openWebsockets.empty()) stopWebsocket(*comp->openWebsockets.begin());
     for (library_t ** lib = libraries; *lib != NULL; lib++) if ((*lib)->deinit != NULL) (*lib)->deinit(comp);
     lua_close(comp->L);   /* Cya, Lua */
-    if (comp->eventTimeout != 0) SDL_RemoveTimer(comp->eventTimeout);
+    if (comp->eventTimeout != 0) cancelTimer(comp, comp->eventTimeout);
     comp->eventTimeout = 0;
     comp->L = NULL;
+    freeAllocators(comp);
     if (comp->rawFileStack) {
         std::lock_guard<std::mutex> lock(comp->rawFileStackMutex);
         lua_close(comp->rawFileStack);
@@ -356,14 +359,7 @@ int termPanic(lua_State *L) {
 static bool debuggerBreak(lua_State *L, Computer * computer, debugger * dbg, const char * reason) {
     const bool lastBlink = computer->term->canBlink;
     computer->term->canBlink = false;
-    if (computer->eventTimeout != 0) 
-#ifdef __EMSCRIPTEN__
-        queueTask([computer](void*)->void*{
-#endif
-        SDL_RemoveTimer(computer->eventTimeout);
-#ifdef __EMSCRIPTEN__
-        return NULL;}, NULL);
-#endif
+    if (computer->eventTimeout != 0) cancelTimer(computer, computer->eventTimeout);
     computer->eventTimeout = 0;
     dbg->thread = L;
     dbg->breakReason = reason;
@@ -376,14 +372,8 @@ static bool debuggerBreak(lua_State *L, Computer * computer, debugger * dbg, con
     while (dbg->didBreak) dbg->breakNotify.wait_for(lock, std::chrono::milliseconds(500));
     const bool retval = !dbg->running;
     dbg->thread = NULL;
-#ifdef __EMSCRIPTEN__
-    queueTask([computer](void*)->void*{
-#endif
-    if (computer->eventTimeout != 0) SDL_RemoveTimer(computer->eventTimeout);
-    if (config.abortTimeout > 0 || config.standardsMode) computer->eventTimeout = SDL_AddTimer(config.standardsMode ? 7000 : config.abortTimeout, eventTimeoutEvent, computer);
-#ifdef __EMSCRIPTEN__
-    return NULL;}, NULL);
-#endif
+    if (computer->eventTimeout != 0) cancelTimer(computer, computer->eventTimeout);
+    if (config.abortTimeout > 0 || config.standardsMode) computer->eventTimeout = addTimer(computer, config.standardsMode ? 7000 : config.abortTimeout, eventTimeoutEvent, computer);
     computer->last_event = std::chrono::high_resolution_clock::now();
     computer->term->canBlink = lastBlink;
     return retval;
@@ -580,10 +570,10 @@ static bool renderTerminal(Terminal * term, bool& pushEvent) {
         else if (selectedRenderer != 1 && selectedRenderer != 2 && selectedRenderer != 3 && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - term->last_blink).count() > 400) {
             term->blink = !term->blink;
             term->last_blink = std::chrono::high_resolution_clock::now();
-            term->changed = true;
+            term->markDirty(term->blinkX, term->blinkY);
         }
         if (term->frozen) return false;
-        changed = term->changed;
+        changed = term->needsRedraw();
     }
     try {
         term->render();
@@ -663,8 +653,7 @@ static std::string utf8_to_string(const char *utf8str)
     return std::string(buf.data(), buf.size());
 }
 
-static Uint32 mouseDebounce(Uint32 interval, void* param);
-struct comp_term_pair {Computer * comp; Terminal * term;};
+static Uint32 mouseDebounce(Uint32 interval, SDL_TimerID id, void* owner, void* param);
 
 static std::string mouse_move(lua_State *L, void* param) {
     Terminal * term = (Terminal*)param;
@@ -674,30 +663,24 @@ static std::string mouse_move(lua_State *L, void* param) {
     lua_pushinteger(L, term->nextMouseMove.y);
     if (!term->nextMouseMove.side.empty()) lua_pushstring(L, term->nextMouseMove.side.c_str());
     term->nextMouseMove = {0, 0, 0, 0, std::string()};
-    term->mouseMoveDebounceTimer = SDL_AddTimer(config.mouse_move_throttle, mouseDebounce, new comp_term_pair {get_comp(L), term});
+    term->mouseMoveDebounceTimer = addTimer(get_comp(L), config.mouse_move_throttle, mouseDebounce, term);
     return "mouse_move";
 }
 
-static Uint32 mouseDebounce(Uint32 interval, void* param) {
-    comp_term_pair * data = (comp_term_pair*)param;
-    if (freedComputers.find(data->comp) != freedComputers.end()) return 0;
-    std::lock_guard<std::mutex> lock(((SDLTerminal*)data->term)->mouseMoveLock);
-    if (data->term->nextMouseMove.event) queueEvent(data->comp, mouse_move, data->term);
-    else data->term->mouseMoveDebounceTimer = 0;
-    delete data;
+// Debounce timers are owned by the computer receiving the events, so they're cancelled with it
+static Uint32 mouseDebounce(Uint32 interval, SDL_TimerID id, void* owner, void* param) {
+    Terminal * term = (Terminal*)param;
+    std::lock_guard<std::mutex> lock(((SDLTerminal*)term)->mouseMoveLock);
+    if ((SDL_TimerID)term->mouseMoveDebounceTimer != id) return 0;
+    if (term->nextMouseMove.event) queueEvent((Computer*)owner, mouse_move, term);
+    else term->mouseMoveDebounceTimer = 0;
     return 0;
 }
 
 std::string termGetEvent(lua_State *L) {
     Computer * computer = get_comp(L);
-    computer->event_provider_queue_mutex.lock();
-    if (!computer->event_provider_queue.empty()) {
-        const std::pair<event_provider, void*> p = computer->event_provider_queue.front();
-        computer->event_provider_queue.pop();
-        computer->event_provider_queue_mutex.unlock();
-        return p.first(L, p.second);
-    }
-    computer->event_provider_queue_mutex.unlock();
+    std::pair<event_provider, void*> p;
+    if (computer->event_queue_ctx->popProvider(p)) return p.first(L, p.second);
     if (computer->running != 1) return "";
     SDL_Event e;
     if (Computer_getEvent(computer, &e)) {
@@ -883,7 +866,7 @@ std::string termGetEvent(lua_State *L) {
             if (config.mouse_move_throttle > 0 && !e.motion.state) {
                 std::lock_guard<std::mutex> lock(term->mouseMoveLock);
                 if (term->mouseMoveDebounceTimer == 0) {
-                    term->mouseMoveDebounceTimer = SDL_AddTimer(config.mouse_move_throttle, mouseDebounce, new comp_term_pair {computer, term});
+                    term->mouseMoveDebounceTimer = addTimer(computer, config.mouse_move_throttle, mouseDebounce, term);
                     term->nextMouseMove = {0, 0, 0, 0, std::string()};
                 } else {
                     term->nextMouseMove = {x, y, 0, 1, (e.motion.windowID != computer->term->id && config.monitorsUseMouseEvents) ? side : ""};
@@ -1069,7 +1052,7 @@ std::string termGetEvent(lua_State *L) {
             if (term == NULL) return "";
             if (term->mouseMoveDebounceTimer != 0) {
                 std::lock_guard<std::mutex> lock(((SDLTerminal*)term)->mouseMoveLock);
-                SDL_RemoveTimer(term->mouseMoveDebounceTimer);
+                cancelTimer(computer, term->mouseMoveDebounceTimer);
                 term->mouseMoveDebounceTimer = 0;
                 term->nextMouseMove = {0, 0, 0, 0, std::string() };
             }
@@ -1098,7 +1081,7 @@ void displayFailure(Terminal * term, const std::string& message, const std::stri
     strcpy((char*)term->screen.data() + offset, "CraftOS-PC may be installed incorrectly");
     term->canBlink = false;
     term->errorMode = true;
-    term->changed = true;
+    term->markAllDirty();
 }
 
 Terminal * createTerminal(const std::string& title) {
@@ -58,7 +58,7 @@ inline bool checkWindowID(Computer * c, unsigned wid) {
 inline std::list<Terminal*>::iterator& nextRenderTarget() {
     std::lock_guard<std::mutex> lock(renderTargetsLock);
     if (++renderTarget == renderTargets.end()) renderTarget = renderTargets.begin();
-    (*renderTarget)->changed = true;
+    (*renderTarget)->markAllDirty();
     (*renderTarget)->onActivate();
     return renderTarget;
 }
@@ -67,7 +67,7 @@ inline std::list<Terminal*>::iterator& previousRenderTarget() {
     std::lock_guard<std::mutex> lock(renderTargetsLock);
     if (renderTarget == renderTargets.begin()) renderTarget = renderTargets.end();
     --renderTarget;
-    (*renderTarget)->changed = true;
+    (*renderTarget)->markAllDirty();
     (*renderTarget)->onActivate();
     return renderTarget;
 }
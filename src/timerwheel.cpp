@@ -0,0 +1,255 @@
+/*
+ * timerwheel.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the central timer wheel. Timers are stored in a
+ * hierarchical wheel with 1 ms ticks: the first level has 256 slots (one per
+ * tick), and each of the three upper levels has 64 slots, covering up to
+ * 2^26 ms (about 18.6 hours). Timers past that are parked in the last slot and
+ * re-inserted when it cascades. Inserting and cancelling a timer are O(1), and
+ * the thread only wakes up when a timer is due or an upper level cascades.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "platform.hpp"
+#include "timerwheel.hpp"
+
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TV_LEVELS 3
+#define MAX_TVAL ((1ULL << (TVR_BITS + TV_LEVELS * TVN_BITS)) - 1)
+
+struct timer_node {
+    timer_node * next = NULL;
+    timer_node ** pprev = NULL;
+    timer_node * ownerNext = NULL;
+    timer_node ** ownerPprev = NULL;
+    uint64_t expires;
+    void* owner;
+    SDL_TimerID id;
+    Uint32 interval;
+    timer_wheel_callback callback;
+    void* param;
+    bool cancelled = false;
+};
+
+static std::mutex wheelMutex;
+static std::condition_variable wheelNotify;
+static std::condition_variable callbackNotify;
+static std::thread * wheelThread = NULL;
+static bool wheelStopping = false;
+static timer_node * tv1[TVR_SIZE];
+static timer_node * tvn[TV_LEVELS][TVN_SIZE];
+static uint64_t wheelTick = 0; // next tick to be processed
+static uint64_t nextWake = UINT64_MAX;
+static timer_node * runningNode = NULL;
+static std::unordered_map<SDL_TimerID, timer_node*> timersByID;
+static std::unordered_map<void*, timer_node*> timersByOwner;
+static std::atomic<SDL_TimerID> nextTimerID(1);
+static const std::chrono::steady_clock::time_point wheelEpoch = std::chrono::steady_clock::now();
+
+static uint64_t currentTick() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - wheelEpoch).count();
+}
+
+static void listInsert(timer_node ** head, timer_node * node) {
+    node->next = *head;
+    if (*head) (*head)->pprev = &node->next;
+    node->pprev = head;
+    *head = node;
+}
+
+static void listRemove(timer_node * node) {
+    *node->pprev = node->next;
+    if (node->next) node->next->pprev = node->pprev;
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+static void internalAdd(timer_node * node) {
+    const uint64_t expires = node->expires;
+    const uint64_t idx = expires < wheelTick ? 0 : expires - wheelTick;
+    if (expires < wheelTick) listInsert(&tv1[wheelTick & TVR_MASK], node);
+    else if (idx < (1ULL << TVR_BITS)) listInsert(&tv1[expires & TVR_MASK], node);
+    else if (idx < (1ULL << (TVR_BITS + TVN_BITS))) listInsert(&tvn[0][(expires >> TVR_BITS) & TVN_MASK], node);
+    else if (idx < (1ULL << (TVR_BITS + 2 * TVN_BITS))) listInsert(&tvn[1][(expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK], node);
+    else {
+        // Far-away timers sit in the last level until they cascade down
+        const uint64_t e = idx > MAX_TVAL ? wheelTick + MAX_TVAL : expires;
+        listInsert(&tvn[2][(e >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK], node);
+    }
+}
+
+static int cascade(int level, int index) {
+    timer_node * list = tvn[level][index];
+    tvn[level][index] = NULL;
+    while (list) {
+        timer_node * node = list;
+        list = node->next;
+        node->next = NULL;
+        node->pprev = NULL;
+        internalAdd(node);
+    }
+    return index;
+}
+
+static void freeNode(timer_node * node) {
+    if (node->pprev) listRemove(node);
+    timersByID.erase(node->id);
+    *node->ownerPprev = node->ownerNext;
+    if (node->ownerNext) node->ownerNext->ownerPprev = node->ownerPprev;
+    else if (*node->ownerPprev == NULL) {
+        const auto it = timersByOwner.find(node->owner);
+        if (it != timersByOwner.end() && it->second == NULL) timersByOwner.erase(it);
+    }
+    delete node;
+}
+
+// Moves the wheel straight to a later tick by re-inserting every timer, which is
+// cheaper than stepping through a long stretch of empty slots one at a time
+static void advanceWheel(uint64_t tick) {
+    std::vector<timer_node*> nodes;
+    nodes.reserve(timersByID.size());
+    for (const auto& t : timersByID) {
+        if (t.second->pprev == NULL) continue; // running
+        listRemove(t.second);
+        nodes.push_back(t.second);
+    }
+    wheelTick = tick;
+    for (timer_node * node : nodes) internalAdd(node);
+}
+
+static void timerThread() {
+    std::unique_lock<std::mutex> lock(wheelMutex);
+    while (!wheelStopping) {
+        const uint64_t now = currentTick();
+        if (timersByID.empty()) wheelTick = now + 1;
+        uint64_t nextSkipCheck = wheelTick;
+        while (wheelTick <= now && !wheelStopping) {
+            if (now - wheelTick >= TVR_SIZE && wheelTick >= nextSkipCheck) {
+                // After an idle stretch, skip ahead to the first timer that's due instead of catching up tick by tick
+                // (looking for it is O(timers), so only do that once per round)
+                uint64_t first = UINT64_MAX;
+                for (const auto& t : timersByID) if (t.second->pprev != NULL && t.second->expires < first) first = t.second->expires;
+                if (first >= wheelTick + TVR_SIZE) advanceWheel(std::min(first, now));
+                nextSkipCheck = wheelTick + TVR_SIZE;
+            }
+            const int index = wheelTick & TVR_MASK;
+            if (!index) {
+                for (int level = 0; level < TV_LEVELS && cascade(level, (wheelTick >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK) == 0; level++) {}
+            }
+            while (tv1[index] != NULL) {
+                timer_node * node = tv1[index];
+                listRemove(node);
+                runningNode = node;
+                lock.unlock();
+                const Uint32 interval = node->callback(node->interval, node->id, node->owner, node->param);
+                lock.lock();
+                runningNode = NULL;
+                if (node->cancelled || interval == 0) freeNode(node);
+                else {
+                    node->interval = interval;
+                    node->expires = currentTick() + interval;
+                    internalAdd(node);
+                }
+                callbackNotify.notify_all();
+            }
+            wheelTick++;
+        }
+        if (wheelStopping) break;
+        if (timersByID.empty()) {
+            nextWake = UINT64_MAX;
+            wheelNotify.wait(lock);
+            continue;
+        }
+        // Sleep until the next non-empty slot in this round, or the next cascade
+        nextWake = (wheelTick & TVR_MASK) ? (wheelTick | TVR_MASK) + 1 : wheelTick;
+        for (uint64_t t = wheelTick; t < nextWake; t++) {
+            if (tv1[t & TVR_MASK] != NULL) {
+                nextWake = t;
+                break;
+            }
+        }
+        wheelNotify.wait_until(lock, wheelEpoch + std::chrono::milliseconds(nextWake));
+    }
+}
+
+SDL_TimerID addTimer(void* owner, Uint32 interval, timer_wheel_callback callback, void* param) {
+    timer_node * node = new timer_node;
+    node->owner = owner;
+    node->interval = interval;
+    node->callback = callback;
+    node->param = param;
+    do {node->id = nextTimerID++;} while (node->id == 0);
+    std::lock_guard<std::mutex> lock(wheelMutex);
+    if (wheelThread == NULL) {
+        wheelStopping = false;
+        wheelTick = currentTick();
+        wheelThread = new std::thread(timerThread);
+        setThreadName(*wheelThread, "Timer Thread");
+    }
+    node->expires = currentTick() + interval;
+    internalAdd(node);
+    timersByID[node->id] = node;
+    timer_node ** head = &timersByOwner[owner];
+    node->ownerNext = *head;
+    if (*head) (*head)->ownerPprev = &node->ownerNext;
+    node->ownerPprev = head;
+    *head = node;
+    if (node->expires < nextWake) wheelNotify.notify_all();
+    return node->id;
+}
+
+bool cancelTimer(void* owner, SDL_TimerID id) {
+    std::lock_guard<std::mutex> lock(wheelMutex);
+    const auto it = timersByID.find(id);
+    if (it == timersByID.end() || it->second->owner != owner) return false;
+    if (it->second == runningNode) it->second->cancelled = true;
+    else freeNode(it->second);
+    return true;
+}
+
+void cancelOwnerTimers(void* owner) {
+    std::unique_lock<std::mutex> lock(wheelMutex);
+    const auto it = timersByOwner.find(owner);
+    if (it == timersByOwner.end()) return;
+    timer_node * node = it->second;
+    while (node) {
+        timer_node * next = node->ownerNext;
+        if (node == runningNode) node->cancelled = true;
+        else freeNode(node);
+        node = next;
+    }
+    if (wheelThread != NULL && std::this_thread::get_id() != wheelThread->get_id())
+        callbackNotify.wait(lock, [owner]()->bool {return runningNode == NULL || runningNode->owner != owner;});
+}
+
+void stopTimerThread() {
+    std::thread * th;
+    {
+        std::lock_guard<std::mutex> lock(wheelMutex);
+        if (wheelThread == NULL) return;
+        th = wheelThread;
+        wheelStopping = true;
+        wheelNotify.notify_all();
+    }
+    if (th->joinable()) th->join();
+    delete th;
+    std::lock_guard<std::mutex> lock(wheelMutex);
+    wheelThread = NULL;
+    while (!timersByID.empty()) freeNode(timersByID.begin()->second);
+}
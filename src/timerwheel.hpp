@@ -0,0 +1,43 @@
+/*
+ * timerwheel.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the functions for the central timer wheel, which runs all
+ * computer timers, alarms and watchdogs on a single thread.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+#include <SDL2/SDL.h>
+
+// Called on the timer thread when a timer expires. Return a new interval in
+// milliseconds to re-arm the timer with the same ID, or 0 to free it.
+typedef Uint32 (*timer_wheel_callback)(Uint32 interval, SDL_TimerID id, void* owner, void* param);
+
+/*
+ * Schedules a callback to run after the specified number of milliseconds.
+ * Timers are grouped by owner (usually a Computer), which is used to identify
+ * the timer when cancelling, and to cancel all timers for a computer at once.
+ * Returns the timer's ID, which is never 0.
+ */
+extern SDL_TimerID addTimer(void* owner, Uint32 interval, timer_wheel_callback callback, void* param);
+
+/*
+ * Cancels a timer. If the callback is currently running, it will not be
+ * re-armed. Returns whether a timer with that ID existed for the owner.
+ */
+extern bool cancelTimer(void* owner, SDL_TimerID id);
+
+/*
+ * Cancels all timers for an owner, and waits for any running callback for the
+ * owner to finish so that the owner can be safely freed afterwards.
+ */
+extern void cancelOwnerTimers(void* owner);
+
+// Stops the timer thread and frees all pending timers. Called on exit.
+extern void stopTimerThread();
+
+#endif
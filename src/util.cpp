@@ -9,17 +9,24 @@
  */
 
 #include <atomic>
+#include <memory>
+#include <regex>
 #include <sstream>
+#include <unordered_map>
 #include <Computer.hpp>
 #include <dirent.h>
 #include <Poco/Base64Decoder.h>
 #include <Poco/Base64Encoder.h>
 #include <sys/stat.h>
 #include <FileEntry.hpp>
+#include "dircache.hpp"
 #include "platform.hpp"
+#include "romcache.hpp"
+#include "rompack.hpp"
 #include "runtime.hpp"
 #include "terminal/SDLTerminal.hpp"
 #include "util.hpp"
+#include "vfsindex.hpp"
 #ifndef WIN32
 #include <libgen.h>
 #endif
@@ -178,25 +185,99 @@ path_t fixpath_mkdir(Computer * comp, const std::string& path, bool md, std::str
     return fixpath(comp, path, false, true, mountPath);
 }
 
-static bool _nothrow(std::function<void()> f) { try { f(); return true; } catch (...) { return false; } }
-#define nothrow(expr) _nothrow([&](){ expr ;})
+#define MOUNT_CACHE_SIZE 256
 
-inline bool isVFSPath(path_t path) {
-    if (!std::isdigit(path.native()[0])) return false;
-    for (const path_t::value_type& c : path.native()) {
-        if (c == ':') return true;
-        else if (!std::isdigit(c)) return false;
+// A node in the mount trie, keyed by path component
+struct mount_node {
+    std::unordered_map<std::string, std::unique_ptr<mount_node> > children;
+    std::vector<_path_t> roots; // real paths mounted exactly here, in mount order
+    std::vector<int> vfs; // virtual mount index of each root, or -1 for a real directory
+    bool readOnly = false; // whether the first mount here is read-only
+    std::string name; // path of the mount, as reported by fs.getDrive
+};
+
+// The result of looking up a path in the mount trie
+struct resolved_path {
+    const mount_node * mount;
+    std::list<std::string> rest; // components below the mount point
+    path_t hostPath; // first root of the mount with the rest appended
+};
+
+struct mount_cache {
+    mount_node root;
+    unsigned generation; // value of comp->mountGeneration when this was built
+    size_t mountCount; // size of comp->mounts when this was built
+    std::list<std::pair<std::string, resolved_path> > lru; // most recently used first
+    std::unordered_map<std::string, std::list<std::pair<std::string, resolved_path> >::iterator> index;
+};
+
+// This may be called from any thread; the cache is rebuilt on next use
+void invalidateMountCache(Computer * comp) {
+    comp->mountGeneration++;
+}
+
+void freeMountCache(Computer * comp) {
+    delete comp->mount_cache_ctx;
+    comp->mount_cache_ctx = NULL;
+}
+
+// Returns the mount trie for the computer, rebuilding it if the mount list changed
+// mountCacheMutex must be held for as long as the trie is used.
+static mount_cache * getMountCache(Computer * comp) {
+    // Plugins may edit the mount list directly without bumping the generation, so check its size as well
+    const unsigned generation = comp->mountGeneration;
+    if (comp->mount_cache_ctx != NULL && comp->mount_cache_ctx->generation == generation && comp->mount_cache_ctx->mountCount == comp->mounts.size()) return comp->mount_cache_ctx;
+    freeMountCache(comp);
+    mount_cache * cache = comp->mount_cache_ctx = new mount_cache;
+    cache->generation = generation;
+    cache->mountCount = comp->mounts.size();
+    cache->root.roots.push_back(comp->dataDir);
+    cache->root.vfs.push_back(-1);
+    cache->root.name = "hdd";
+    for (const auto& m : comp->mounts) {
+        mount_node * node = &cache->root;
+        for (const std::string& s : std::get<0>(m)) {
+            std::unique_ptr<mount_node>& child = node->children[s];
+            if (child == nullptr) {
+                child.reset(new mount_node);
+                child->name = node == &cache->root ? s : node->name + "/" + s;
+            }
+            node = child.get();
+        }
+        // Mounts at the root don't replace the data directory, and are never read-only
+        if (node->roots.empty()) node->readOnly = std::get<2>(m);
+        const _path_t& p = std::get<1>(m);
+        node->roots.push_back(p);
+        node->vfs.push_back(isVFSPath(p) ? (int)std::stoul(p.substr(0, p.size()-1)) : -1);
     }
-    return false;
+    return cache;
 }
 
-path_t fixpath(Computer *comp, std::string path, bool exists, bool addExt, std::string * mountPath, bool * isRoot) {
+// Finds the deepest mount containing a path, and the number of components it covers
+static const mount_node * findMount(mount_cache * cache, const std::list<std::string>& pathc, size_t * depth = NULL) {
+    const mount_node * node = &cache->root, * best = &cache->root;
+    size_t i = 0;
+    if (depth) *depth = 0;
+    for (const std::string& s : pathc) {
+        const auto it = node->children.find(s);
+        if (it == node->children.end()) break;
+        node = it->second.get();
+        i++;
+        if (!node->roots.empty()) {
+            best = node;
+            if (depth) *depth = i;
+        }
+    }
+    return best;
+}
+
+// Splits a path into components, resolving . and .. and stripping characters that aren't allowed
+static bool normalizePath(std::string path, bool addExt, std::list<std::string>& pathc) {
     path.erase(std::remove_if(path.begin(), path.end(), [](char c)->bool {return c == '"' || c == '*' || c == ':' || c == '<' || c == '>' || c == '?' || c == '|' || c < 32; }), path.end());
     std::vector<std::string> elems = split(path, "/\\");
-    std::list<std::string> pathc;
     for (std::string s : elems) {
         if (s == "..") {
-            if (pathc.empty() && addExt) return path_t();
+            if (pathc.empty() && addExt) return false;
             else if (pathc.empty()) pathc.push_back("..");
             else pathc.pop_back();
         } else if (!s.empty() && s.find_first_not_of(' ') != std::string::npos && !std::all_of(s.begin(), s.end(), [](const char c)->bool{return c == '.';})) {
@@ -211,58 +292,94 @@ path_t fixpath(Computer *comp, std::string path, bool exists, bool addExt, std::
         s = s.substr(0, s.find_last_not_of(' '));
         pathc.push_back(s);
     }
-    if (comp->isDebugger && addExt && pathc.size() == 1 && pathc.front() == "bios.lua")
+    return true;
+}
+
+// Looks up which mount a path is on, using the computer's cache of recently resolved paths
+static const resolved_path * resolvePath(Computer * comp, const std::string& path) {
+    mount_cache * cache = getMountCache(comp);
+    const auto it = cache->index.find(path);
+    if (it != cache->index.end()) {
+        cache->lru.splice(cache->lru.begin(), cache->lru, it->second);
+        return &it->second->second;
+    }
+    resolved_path res;
+    if (!normalizePath(path, true, res.rest)) return NULL;
+    size_t depth;
+    res.mount = findMount(cache, res.rest, &depth);
+    for (size_t i = 0; i < depth; i++) res.rest.pop_front();
+    if (res.mount->vfs.front() < 0) {
+        res.hostPath = res.mount->roots.front();
+        for (const std::string& s : res.rest) res.hostPath /= s;
+    }
+    if (cache->lru.size() >= MOUNT_CACHE_SIZE) {
+        cache->index.erase(cache->lru.back().first);
+        cache->lru.pop_back();
+    }
+    cache->lru.emplace_front(path, std::move(res));
+    cache->index[path] = cache->lru.begin();
+    return &cache->lru.front().second;
+}
+
+path_t fixpath(Computer *comp, std::string path, bool exists, bool addExt, std::string * mountPath, bool * isRoot) {
+    path_t ss;
+    std::error_code e;
+    if (comp->isDebugger && addExt) {
+        std::list<std::string> pathc;
+        if (normalizePath(path, addExt, pathc) && pathc.size() == 1 && pathc.front() == "bios.lua") {
 #ifdef STANDALONE_ROM
-        return path_t(":bios.lua", path_t::format::generic_format);
+            return path_t(":bios.lua", path_t::format::generic_format);
 #else
-        return getROMPath()/"bios.lua";
+            const char * data;
+            size_t size;
+            if (getROMPackFile("bios.lua", &data, &size)) return path_t(":bios.lua", path_t::format::generic_format);
+            return getROMPath()/"bios.lua";
 #endif
-    path_t ss;
-    std::error_code e;
-    if (addExt) {
-        std::pair<size_t, std::vector<_path_t> > max_path = std::make_pair(0, std::vector<_path_t>(1, comp->dataDir));
-        std::list<std::string> * mount_list = NULL;
-        for (auto& m : comp->mounts) {
-            std::list<std::string> &pathlist = std::get<0>(m);
-            if (pathc.size() >= pathlist.size() && std::equal(pathlist.begin(), pathlist.end(), pathc.begin())) {
-                if (pathlist.size() > max_path.first) {
-                    max_path = std::make_pair(pathlist.size(), std::vector<_path_t>(1, std::get<1>(m)));
-                    mount_list = &pathlist;
-                } else if (pathlist.size() == max_path.first) {
-                    max_path.second.push_back(std::get<1>(m));
-                }
-            }
         }
-        for (size_t i = 0; i < max_path.first; i++) pathc.pop_front();
-        if (isRoot != NULL) *isRoot = pathc.empty();
+    }
+    if (addExt) {
+        std::lock_guard<std::mutex> lock(comp->mountCacheMutex);
+        const resolved_path * res = resolvePath(comp, path);
+        if (res == NULL) return path_t();
+        const mount_node * mount = res->mount;
+        if (isRoot != NULL) *isRoot = res->rest.empty();
         if (exists) {
             bool found = false;
-            for (const _path_t& p : max_path.second) {
-                path_t sstmp = p;
-                for (const std::string& s : pathc) sstmp /= s;
+            if (mount->roots.size() == 1 && mount->vfs.front() < 0) {
+                bool isDir;
+                if (cachedIsDir(comp, res->hostPath, &isDir) || hostPathExists(res->hostPath, e)) {
+                    ss = res->hostPath;
+                    found = true;
+                }
+            } else for (size_t i = 0; i < mount->roots.size(); i++) {
+                path_t sstmp = mount->roots[i];
+                for (const std::string& s : res->rest) sstmp /= s;
                 e.clear();
-                if ((isVFSPath(p) && nothrow(comp->virtualMounts[(unsigned)std::stoul(p.substr(0, p.size()-1))]->path(sstmp))) || (fs::exists(sstmp, e))) {
+                std::shared_ptr<const VFSIndex> index;
+                if ((mount->vfs[i] >= 0 && findVFSEntry(comp, sstmp, index) != NULL) || (hostPathExists(sstmp, e))) {
                     ss /= sstmp;
                     found = true;
                     break;
                 }
             }
             if (!found) return path_t();
-        } else if (pathc.size() > 1) {
+        } else if (res->rest.size() > 1) {
+            std::list<std::string> pathc = res->rest;
             bool found = false;
             std::stack<std::string> oldback;
             while (!found && !pathc.empty()) {
                 found = false;
                 std::string back = pathc.back();
                 pathc.pop_back();
-                for (const _path_t& p : max_path.second) {
-                    path_t sstmp = p;
+                for (size_t i = 0; i < mount->roots.size(); i++) {
+                    path_t sstmp = mount->roots[i];
                     for (const std::string& s : pathc) sstmp /= s;
                     e.clear();
+                    const std::shared_ptr<const VFSIndex> vfs = mount->vfs[i] >= 0 ? getVFSIndex(comp, mount->vfs[i]) : nullptr;
+                    const VFSIndex::entry * dir = vfs ? vfs->find(sstmp) : NULL;
                     if (
-                        (isVFSPath(p) && (nothrow(comp->virtualMounts[(unsigned)std::stoul(p.substr(0, p.size()-1))]->path(ss/back)) ||
-                        (nothrow(comp->virtualMounts[(unsigned)std::stoul(p.substr(0, p.size()-1))]->path(sstmp)) && comp->virtualMounts[(unsigned)std::stoul(p.substr(0, p.size()-1))]->path(sstmp).isDir))) ||
-                        (fs::exists(sstmp/back, e)) || (fs::is_directory(sstmp, e))) {
+                        (vfs && (vfs->find(ss/back) != NULL || (dir != NULL && dir->isDir))) ||
+                        (hostPathExists(sstmp/back, e)) || (hostPathIsDir(sstmp, e))) {
                         ss /= sstmp/back;
                         while (!oldback.empty()) {
                             ss /= oldback.top();
@@ -275,22 +392,17 @@ path_t fixpath(Computer *comp, std::string path, bool exists, bool addExt, std::
                 if (!found) oldback.push(back);
             }
             if (!found) return path_t();
-        } else {
-            ss /= max_path.second.front();
-            for (const std::string& s : pathc) ss /= s;
+        } else if (mount->vfs.front() < 0) ss = res->hostPath;
+        else {
+            ss /= mount->roots.front();
+            for (const std::string& s : res->rest) ss /= s;
         }
-        if (mountPath != NULL) {
-            if (mount_list == NULL) *mountPath = "hdd";
-            else {
-                std::stringstream ss2;
-                for (auto it = mount_list->begin(); it != mount_list->end(); ++it) {
-                    if (it != mount_list->begin()) ss2 << "/";
-                    ss2 << *it;
-                }
-                *mountPath = ss2.str();
-            }
-        }
-    } else for (const std::string& s : pathc) ss /= s;
+        if (mountPath != NULL) *mountPath = mount->name;
+    } else {
+        std::list<std::string> pathc;
+        normalizePath(path, addExt, pathc);
+        for (const std::string& s : pathc) ss /= s;
+    }
     if (path_t::preferred_separator != (path_t::value_type)'/' && (!addExt || isVFSPath(ss))) {
         path_t::string_type str = ss.native();
         std::replace(str.begin(), str.end(), path_t::preferred_separator, (path_t::value_type)'/');
@@ -317,11 +429,8 @@ bool fixpath_ro(Computer *comp, std::string path) {
         s = s.substr(0, s.find_last_not_of(' '));
         pathc.push_back(s);
     }
-    std::pair<size_t, bool> max_path = std::make_pair(0, false);
-    for (const auto& m : comp->mounts)
-        if (pathc.size() >= std::get<0>(m).size() && std::get<0>(m).size() > max_path.first && std::equal(std::get<0>(m).begin(), std::get<0>(m).end(), pathc.begin()))
-            max_path = std::make_pair(std::get<0>(m).size(), std::get<2>(m));
-    return max_path.second;
+    std::lock_guard<std::mutex> lock(comp->mountCacheMutex);
+    return findMount(getMountCache(comp), pathc)->readOnly;
 }
 
 std::set<std::string> getMounts(Computer * computer, std::string comp_path) {
@@ -335,12 +444,102 @@ std::set<std::string> getMounts(Computer * computer, std::string comp_path) {
             pathc.push_back(s);
         }
     }
-    for (const auto& m : computer->mounts)
-        if (pathc.size() + 1 == std::get<0>(m).size() && std::equal(pathc.begin(), pathc.end(), std::get<0>(m).begin()))
-            retval.insert(std::get<0>(m).back());
+    std::lock_guard<std::mutex> lock(computer->mountCacheMutex);
+    const mount_node * node = &getMountCache(computer)->root;
+    for (const std::string& s : pathc) {
+        const auto it = node->children.find(s);
+        if (it == node->children.end()) return retval;
+        node = it->second.get();
+    }
+    for (const auto& c : node->children)
+        if (!c.second->roots.empty()) retval.insert(c.first);
     return retval;
 }
 
+bool matchGlob(const std::string& pattern, const std::string& str) {
+    size_t p = 0, s = 0, star = std::string::npos, mark = 0;
+    while (s < str.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {p++; s++;}
+        else if (p < pattern.size() && pattern[p] == '*') {star = p++; mark = s;}
+        else if (star != std::string::npos) {p = star + 1; s = ++mark;} // let the last * eat one more character
+        else return false;
+    }
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+// A directory reached while expanding a glob
+struct glob_dir {
+    std::string path; // path on the computer
+    const mount_node * node; // node in the mount trie at this path, or NULL if there's none
+    std::vector<std::pair<path_t, int> > roots; // where the directory's contents are, with the virtual mount index or -1
+};
+
+// Calls a function with the name of each entry in a directory, and whether it's a directory
+static void forEachEntry(Computer * comp, const path_t& root, int vfs, const std::function<void(const std::string&, bool)>& fn) {
+    if (vfs >= 0) {
+        const std::shared_ptr<const VFSIndex> index = getVFSIndex(comp, vfs);
+        const VFSIndex::entry * d = index ? index->find(root) : NULL;
+        if (d == NULL || !d->isDir) return;
+        for (const std::string& name : d->children) {
+            const VFSIndex::entry * c = index->find(root / name);
+            fn(name, c != NULL && c->isDir);
+        }
+    } else if (const std::shared_ptr<const rom_node> node = findROMNode(root)) {
+        if (node->isDir) for (const auto& c : node->children)
+            if (c.first != ".DS_Store" && c.first != "desktop.ini") fn(c.first, c.second.isDir);
+    } else if (const std::shared_ptr<const dir_listing> listing = listHostDirectory(comp, root)) {
+        for (const dir_entry& e : *listing) fn(e.name, e.isDir);
+    }
+}
+
+std::vector<std::string> expandGlob(Computer * comp, const std::list<std::string>& pattern) {
+    std::vector<std::string> matches;
+    std::lock_guard<std::mutex> lock(comp->mountCacheMutex);
+    mount_cache * cache = getMountCache(comp);
+    std::vector<glob_dir> dirs(1), next;
+    dirs[0].node = &cache->root;
+    for (size_t i = 0; i < cache->root.roots.size(); i++) dirs[0].roots.push_back(std::make_pair(path_t(cache->root.roots[i]), cache->root.vfs[i]));
+    for (auto component = pattern.begin(); component != pattern.end(); ++component) {
+        const bool last = std::next(component) == pattern.end();
+        next.clear();
+        for (const glob_dir& dir : dirs) {
+            // Matching names, with the roots of the ones that are directories on each root
+            std::map<std::string, std::vector<std::pair<path_t, int> > > found;
+            for (const auto& root : dir.roots) {
+                forEachEntry(comp, root.first, root.second, [&](const std::string& name, bool isDir) {
+                    if (!matchGlob(*component, name)) return;
+                    std::vector<std::pair<path_t, int> >& subroots = found[name];
+                    if (isDir && !last) subroots.push_back(std::make_pair(root.first / name, root.second));
+                });
+            }
+            if (dir.node != NULL) for (const auto& c : dir.node->children)
+                if (!c.second->roots.empty() && matchGlob(*component, c.first)) found[c.first];
+            for (auto& f : found) {
+                const std::string path = dir.path.empty() ? f.first : dir.path + "/" + f.first;
+                if (last) {
+                    matches.push_back(path);
+                    continue;
+                }
+                glob_dir sub;
+                sub.path = path;
+                sub.node = NULL;
+                if (dir.node != NULL) {
+                    const auto it = dir.node->children.find(f.first);
+                    if (it != dir.node->children.end()) sub.node = it->second.get();
+                }
+                // A mount replaces whatever is at its path
+                if (sub.node != NULL && !sub.node->roots.empty()) {
+                    for (size_t i = 0; i < sub.node->roots.size(); i++) sub.roots.push_back(std::make_pair(path_t(sub.node->roots[i]), sub.node->vfs[i]));
+                } else sub.roots = std::move(f.second);
+                if (!sub.roots.empty() || (sub.node != NULL && !sub.node->children.empty())) next.push_back(std::move(sub));
+            }
+        }
+        dirs.swap(next);
+    }
+    return matches;
+}
+
 static void xcopy_internal(lua_State *from, lua_State *to, int n, int copies_slot) {
     for (int i = n - 1; i >= 0; i--) {
         size_t sz = 0;
@@ -46,6 +46,15 @@ template<> class std::hash<SDL_EventType>: public std::hash<unsigned short> {};
 template<> struct std::hash<path_t> {size_t operator()(const path_t& path) const noexcept {return fs::hash_value(path);}};
 #endif
 
+// Converts a stat time field (st_m, st_c, st_a) to milliseconds
+#if defined(__APPLE__) // macOS has ns-precise times in st_[x]timespec.tv_nsec
+#define st_time_ms(st) ((st##timespec.tv_nsec / 1000000) + (st##timespec.tv_sec * 1000))
+#elif defined(__linux__) // Linux has ns-precise times in st_[x]tim.tv_nsec
+#define st_time_ms(st) ((st##tim.tv_nsec / 1000000) + (st##time * 1000))
+#else // Other systems have only the standard s-precise times
+#define st_time_ms(st) (st##time * 1000)
+#endif
+
 template<typename T>
 class ProtectedObject {
     friend class LockGuard;
@@ -195,6 +204,16 @@ extern const char * lastCFunction;
 extern Computer * get_comp(lua_State *L);
 extern void uncache_state(lua_State *L);
 
+// Returns whether a path starts with a virtual mount prefix ("<digits>:")
+inline bool isVFSPath(const path_t& path) {
+    if (!std::isdigit(path.native()[0])) return false;
+    for (const path_t::value_type& c : path.native()) {
+        if (c == ':') return true;
+        else if (!std::isdigit(c)) return false;
+    }
+    return false;
+}
+
 template<typename T>
 inline T min(T a, T b) { return a < b ? a : b; }
 template<typename T>
@@ -210,6 +229,12 @@ extern path_t fixpath(Computer *comp, std::string path, bool exists, bool addExt
 extern bool fixpath_ro(Computer *comp, std::string path);
 extern path_t fixpath_mkdir(Computer * comp, const std::string& path, bool md = true, std::string * mountPath = NULL);
 extern std::set<std::string> getMounts(Computer * computer, std::string comp_path);
+// Matches a file name against a pattern, where * matches any run of characters and ? matches any one character
+extern bool matchGlob(const std::string& pattern, const std::string& str);
+// Expands a path pattern with wildcards in any component across all mounts; the results aren't sorted and may repeat
+extern std::vector<std::string> expandGlob(Computer * comp, const std::list<std::string>& pattern);
+extern void invalidateMountCache(Computer * comp);
+extern void freeMountCache(Computer * comp);
 extern void peripheral_update(Computer *comp);
 extern struct computer_configuration getComputerConfig(int id);
 extern void setComputerConfig(int id, const computer_configuration& cfg);
@@ -0,0 +1,130 @@
+/*
+ * vfsindex.cpp
+ * CraftOS-PC 2
+ *
+ * This file implements the flat indexes used to look up files in virtual
+ * mounts. Walking a FileEntry tree means copying every path component into
+ * a string and searching a map at each level, and opening a file used to copy
+ * its contents into a stringstream. The index turns each lookup into a single
+ * hash, and files are opened as views into the blob. Computers keep their
+ * indexes by shared_ptr, and the process-wide table only holds weak
+ * references, so an index is freed when the last computer using it goes away.
+ * The table is keyed by address, which a freed FileEntry's replacement may
+ * reuse, and plugins may edit a mounted tree, so a computer drops its indexes
+ * whenever its mounts change, and only takes another computer's index after
+ * comparing it with the tree.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#include <cstring>
+#include <mutex>
+#include "vfsindex.hpp"
+
+static std::unordered_map<const FileEntry*, std::weak_ptr<const VFSIndex> > sharedIndexes;
+static std::mutex sharedIndexesMutex;
+
+static size_t contentSize(const FileEntry& e) {
+    if (!e.isDir) return e.data.size();
+    size_t size = 0;
+    for (const auto& c : e.dir) size += contentSize(c.second);
+    return size;
+}
+
+static void addEntries(VFSIndex * index, std::string& blob, const FileEntry& e, const std::string& path) {
+    VFSIndex::entry& ent = index->entries[path];
+    ent.isDir = e.isDir;
+    if (e.isDir) {
+        ent.offset = 0;
+        ent.size = 0;
+        ent.children.reserve(e.dir.size());
+        for (const auto& c : e.dir) ent.children.push_back(c.first);
+        for (const auto& c : e.dir) addEntries(index, blob, c.second, path.empty() ? c.first : path + "/" + c.first);
+    } else {
+        ent.offset = blob.size();
+        ent.size = e.data.size();
+        blob.append(e.data);
+    }
+}
+
+VFSIndex::VFSIndex(const FileEntry& root): source(&root) {
+    std::shared_ptr<std::string> contents = std::make_shared<std::string>();
+    contents->reserve(contentSize(root));
+    addEntries(this, *contents, root, "");
+    blob = contents->data();
+    storage = contents;
+}
+
+static bool matchEntries(const VFSIndex& index, const FileEntry& e, const std::string& path) {
+    const auto it = index.entries.find(path);
+    if (it == index.entries.end() || it->second.isDir != e.isDir) return false;
+    const VFSIndex::entry& ent = it->second;
+    if (!e.isDir) return ent.size == e.data.size() && memcmp(index.data(ent), e.data.data(), ent.size) == 0;
+    if (ent.children.size() != e.dir.size()) return false;
+    auto name = ent.children.begin();
+    for (const auto& c : e.dir) {
+        if (*name++ != c.first) return false;
+        if (!matchEntries(index, c.second, path.empty() ? c.first : path + "/" + c.first)) return false;
+    }
+    return true;
+}
+
+bool VFSIndex::matches(const FileEntry& root) const {
+    return matchEntries(*this, root, "");
+}
+
+const VFSIndex::entry * VFSIndex::find(const path_t& path) const {
+    std::string key;
+    for (const auto& item : path) {
+        const std::string s = item.string();
+        if (s.empty() || s == "." || s == "/" || FileEntry::isMountIndex(item.native())) continue;
+        if (!key.empty()) key += '/';
+        key += s;
+    }
+    const auto it = entries.find(key);
+    return it == entries.end() ? NULL : &it->second;
+}
+
+std::shared_ptr<const VFSIndex> getVFSIndex(Computer * comp, unsigned idx) {
+    const auto vfs = comp->virtualMounts.find(idx);
+    if (vfs == comp->virtualMounts.end() || vfs->second == NULL) return NULL;
+    std::lock_guard<std::mutex> slotLock(comp->virtualMountIndexesMutex);
+    const unsigned generation = comp->mountGeneration;
+    if (comp->virtualMountIndexGeneration != generation) {
+        comp->virtualMountIndexes.clear();
+        comp->virtualMountIndexGeneration = generation;
+    }
+    std::shared_ptr<const VFSIndex>& slot = comp->virtualMountIndexes[idx];
+    // Plugins may replace entries in virtualMounts directly, so make sure the index is for the same tree
+    if (slot && slot->source == vfs->second) return slot;
+    std::lock_guard<std::mutex> lock(sharedIndexesMutex);
+    std::weak_ptr<const VFSIndex>& shared = sharedIndexes[vfs->second];
+    slot = shared.lock();
+    if (slot && !slot->external && !slot->matches(*vfs->second)) slot = NULL;
+    if (!slot) {
+        slot = std::make_shared<const VFSIndex>(*vfs->second);
+        shared = slot;
+        // Clean out indexes nobody is using anymore
+        for (auto it = sharedIndexes.begin(); it != sharedIndexes.end();) {
+            if (it->second.expired()) it = sharedIndexes.erase(it);
+            else ++it;
+        }
+    }
+    return slot;
+}
+
+void shareVFSIndex(const std::shared_ptr<const VFSIndex>& index) {
+    std::lock_guard<std::mutex> lock(sharedIndexesMutex);
+    sharedIndexes[index->source] = index;
+}
+
+const VFSIndex::entry * findVFSEntry(Computer * comp, const path_t& path, std::shared_ptr<const VFSIndex>& index) {
+    if (path.empty() || !FileEntry::isMountIndex(path.begin()->native())) return NULL;
+    const path_t::string_type& mount = path.begin()->native();
+    unsigned idx = 0;
+    for (size_t i = 0; i + 1 < mount.size(); i++) idx = idx * 10 + (mount[i] - '0');
+    index = getVFSIndex(comp, idx);
+    if (index == NULL) return NULL;
+    return index->find(path);
+}
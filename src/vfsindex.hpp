@@ -0,0 +1,64 @@
+/*
+ * vfsindex.hpp
+ * CraftOS-PC 2
+ *
+ * This file defines the flat indexes used to look up files in virtual mounts.
+ *
+ * This code is licensed under the MIT license.
+ * Copyright (c) 2019-2024 JackMacWindows.
+ */
+
+#ifndef VFSINDEX_HPP
+#define VFSINDEX_HPP
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <Computer.hpp>
+#include <FileEntry.hpp>
+#include "util.hpp"
+
+/*
+ * An immutable copy of a FileEntry tree, with every file's contents stored
+ * back to back in one blob and every path in one hash table. Indexes are
+ * built once per FileEntry and shared by all computers that mount it, as long
+ * as the tree still matches when another computer picks it up. The blob may
+ * also be memory owned by someone else, like a mapped ROM pack.
+ */
+class VFSIndex {
+public:
+    struct entry {
+        bool isDir;
+        size_t offset; // where the contents start in the blob (files only)
+        size_t size;
+        std::vector<std::string> children; // names of the entries inside, in order (directories only)
+    };
+
+    const FileEntry * source; // the tree this index was built from
+    std::shared_ptr<const void> storage; // keeps the blob alive
+    const char * blob;
+    bool external = false; // whether the entries were filled in by the caller instead of built from source, so they can't be checked against it
+    std::unordered_map<std::string, entry> entries; // keyed on the path in the mount, separated by '/', with "" for the root
+
+    VFSIndex(const FileEntry& root);
+    // Creates an empty index over existing contents; the caller fills in the entries
+    VFSIndex(const FileEntry * source, const std::shared_ptr<const void>& storage, const char * blob): source(source), storage(storage), blob(blob), external(true) {}
+
+    // Looks up a path in the mount, skipping the mount's index component if present; returns NULL if it doesn't exist
+    const entry * find(const path_t& path) const;
+    const char * data(const entry& e) const {return blob + e.offset;}
+    // Checks whether the index still has the same entries and contents as a tree
+    bool matches(const FileEntry& root) const;
+};
+
+// Returns the index for a virtual mount of a computer, building or sharing it on first use, or NULL if there's no such mount
+extern std::shared_ptr<const VFSIndex> getVFSIndex(Computer * comp, unsigned idx);
+
+// Makes an index built elsewhere the one used for its FileEntry; the caller must keep a reference to it
+extern void shareVFSIndex(const std::shared_ptr<const VFSIndex>& index);
+
+// Looks up a VFS path ("<idx>:/...") in the computer's virtual mounts; returns NULL if it doesn't exist
+// index receives the index the entry belongs to; hold on to it while using the entry, since the computer may drop it.
+extern const VFSIndex::entry * findVFSEntry(Computer * comp, const path_t& path, std::shared_ptr<const VFSIndex>& index);
+
+#endif